@@ -19,7 +19,7 @@ CREATE TABLE IF NOT EXISTS `im_user` (
 -- 2. 消息内容表 (Body) - 写扩散模型
 -- ========================================================
 CREATE TABLE IF NOT EXISTS `im_message_body` (
-  `msg_id` BIGINT UNSIGNED NOT NULL AUTO_INCREMENT COMMENT '消息全局唯一ID', -- 简化起见暂用自增, 生产环境应用雪花算法
+  `msg_id` BIGINT UNSIGNED NOT NULL COMMENT '消息全局唯一ID', -- 雪花算法 (IdGenerator), 按时间有序
   `sender_id` BIGINT UNSIGNED NOT NULL COMMENT '发送者ID',
   `group_id` BIGINT UNSIGNED NOT NULL DEFAULT 0 COMMENT '群ID (0=单聊)',
   `msg_type` TINYINT NOT NULL DEFAULT 1 COMMENT '类型: 1-文本',
@@ -80,6 +80,7 @@ CREATE TABLE IF NOT EXISTS `im_group` (
   `group_name` VARCHAR(64) NOT NULL DEFAULT '',
   `owner_id` BIGINT UNSIGNED NOT NULL COMMENT '群主ID',
   `announcement` VARCHAR(256) DEFAULT '',
+  `read_diffusion` TINYINT NOT NULL DEFAULT 0 COMMENT '1-读扩散(大群, 消息写入 im_group_timeline), 一旦开启不再回退',
   `created_at` TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
   PRIMARY KEY (`group_id`)
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COMMENT='群组基础表';
@@ -105,3 +106,54 @@ CREATE TABLE IF NOT EXISTS `im_group_request` (
   PRIMARY KEY (`id`),
   KEY `idx_group_status` (`group_id`, `status`)
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COMMENT='群组申请表';
+
+-- ========================================================
+-- 6. 群消息时间线 - 读扩散模型 (大群)
+-- ========================================================
+-- 成员数超过 chat.read_diffusion_threshold 的群, 每条消息只写一行时间线,
+-- 成员同步时按各自游标 (im_group_cursor) 读取, 不再为每个成员写 im_message_index
+CREATE TABLE IF NOT EXISTS `im_group_timeline` (
+  `id` BIGINT UNSIGNED NOT NULL AUTO_INCREMENT,
+  `group_id` BIGINT UNSIGNED NOT NULL,
+  `group_seq` BIGINT UNSIGNED NOT NULL COMMENT '群内序列号 (Redis im:gseq:{group_id})',
+  `msg_id` BIGINT UNSIGNED NOT NULL COMMENT '关联的消息内容ID',
+  `created_at` TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+  PRIMARY KEY (`id`),
+  UNIQUE KEY `uk_group_seq` (`group_id`, `group_seq`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COMMENT='群消息时间线(读扩散)';
+
+CREATE TABLE IF NOT EXISTS `im_group_cursor` (
+  `user_id` BIGINT UNSIGNED NOT NULL,
+  `group_id` BIGINT UNSIGNED NOT NULL,
+  `read_seq` BIGINT UNSIGNED NOT NULL DEFAULT 0 COMMENT '已同步到的 group_seq',
+  `updated_at` TIMESTAMP DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+  PRIMARY KEY (`user_id`, `group_id`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COMMENT='用户在读扩散群中的同步游标';
+
+-- ========================================================
+-- 7. 升级已有库 (幂等, 可重复执行)
+-- ========================================================
+-- 上面的 CREATE TABLE IF NOT EXISTS 不会改动已存在的表. 旧版本建的库在这里补齐:
+--   - im_group.read_diffusion 列
+--   - im_message_body.msg_id 去掉 AUTO_INCREMENT (改由 IdGenerator 生成)
+-- im_group_timeline / im_group_cursor 是新表, 由上面的 CREATE 直接建出.
+-- MySQL 没有 ADD COLUMN IF NOT EXISTS: 先查 information_schema, 已是新结构时执行空语句.
+-- 升级运行中的集群时只对主库执行 (mysql < sql/init.sql), 从库经复制得到同样的变更.
+SET @ddl = IF(
+  (SELECT COUNT(*) FROM information_schema.COLUMNS
+   WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = 'im_group' AND COLUMN_NAME = 'read_diffusion') = 0,
+  'ALTER TABLE `im_group` ADD COLUMN `read_diffusion` TINYINT NOT NULL DEFAULT 0 COMMENT ''1-读扩散(大群, 消息写入 im_group_timeline), 一旦开启不再回退'' AFTER `announcement`',
+  'DO 0');
+PREPARE migrate_stmt FROM @ddl;
+EXECUTE migrate_stmt;
+DEALLOCATE PREPARE migrate_stmt;
+
+SET @ddl = IF(
+  (SELECT COUNT(*) FROM information_schema.COLUMNS
+   WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = 'im_message_body' AND COLUMN_NAME = 'msg_id'
+     AND EXTRA LIKE '%auto_increment%') > 0,
+  'ALTER TABLE `im_message_body` MODIFY `msg_id` BIGINT UNSIGNED NOT NULL COMMENT ''消息全局唯一ID''',
+  'DO 0');
+PREPARE migrate_stmt FROM @ddl;
+EXECUTE migrate_stmt;
+DEALLOCATE PREPARE migrate_stmt;
@@ -61,34 +61,24 @@ Status AuthServiceImpl::Login(ServerContext* context, const tinyim::auth::LoginR
     DBConn conn(DBConn::READ);
     if (!conn.valid()) return Status(grpc::INTERNAL, "Database error");
 
-    char sql[256];
-    snprintf(sql, sizeof(sql), "SELECT user_id, nickname, password_hash FROM im_user WHERE username='%s'", username.c_str());
-
-    if (mysql_query(conn.get(), sql)) {
+    // Prepared: username is bound, not spliced into the SQL
+    DBStmt* stmt = conn.Prepare("SELECT user_id, nickname, password_hash FROM im_user WHERE username=?");
+    if (!stmt || !stmt->Bind(username).Execute()) {
         reply->set_success(false);
         reply->set_error_message("DB Query Error");
         return Status::OK;
     }
 
-    MYSQL_RES* res = mysql_store_result(conn.get());
-    if (!res) {
+    if (!stmt->Fetch()) {
         reply->set_success(false);
         reply->set_error_message("User not found");
         return Status::OK;
     }
 
-    MYSQL_ROW row = mysql_fetch_row(res);
-    if (!row) {
-        reply->set_success(false);
-        reply->set_error_message("User not found");
-        mysql_free_result(res);
-        return Status::OK;
-    }
-
-    int64_t user_id = std::stoll(row[0]);
-    std::string db_nick = row[1] ? row[1] : "";
-    std::string db_pass = row[2] ? row[2] : "";
-    mysql_free_result(res);
+    int64_t user_id = stmt->GetInt64(0);
+    std::string db_nick = stmt->GetString(1);
+    std::string db_pass = stmt->GetString(2);
+    while (stmt->Fetch()) {} // Drain (username is unique)
 
     if (db_pass != password) { // Plaintext comparison for MVP
         reply->set_success(false);
@@ -132,21 +122,6 @@ Status AuthServiceImpl::Login(ServerContext* context, const tinyim::auth::LoginR
     RedisClient::GetInstance().HSet(session_key, device, token);
     RedisClient::GetInstance().Expire(session_key, 3600 * 24); // Refresh Session TTL
     
-    // Load Balancer: Pick a random gateway
-    std::string gateway_url = "ws://127.0.0.1:8080/ws"; // default fallback
-    auto keys = RedisClient::GetInstance().Keys("im:gateway:*");
-    if (!keys.empty()) {
-        static std::random_device rd;
-        static std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, keys.size() - 1);
-        std::string chosen_key = keys[dis(gen)];
-        
-        std::string addr = RedisClient::GetInstance().Get(chosen_key); // "127.0.0.1:8081"
-        if (!addr.empty()) {
-            gateway_url = "ws://" + addr + "/ws";
-        }
-    }
-
     reply->set_success(true);
     reply->set_user_id(user_id);
     reply->set_token(token);
@@ -4,6 +4,8 @@
 #include "db_pool.h"
 #include "redis_client.h"
 #include "config.h"
+#include "metrics.h"
+#include "rpc_metrics.h"
 
 void RunServer() {
     // Init Config
@@ -11,18 +13,7 @@ void RunServer() {
         Config::GetInstance().Load("../config.json");
     }
 
-    int port = Config::GetInstance().GetInt("auth_service.port", 50051);
-    std::string server_address("0.0.0.0:" + std::to_string(port));
-    AuthServiceImpl service;
-
-    grpc::ServerBuilder builder;
-    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
-    builder.RegisterService(&service);
-    
-    std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
-    spdlog::info("Auth Server listening on {}", server_address);
-
-    // Initialize DB & Redis
+    // Initialize DB & Redis before the server takes requests
     std::string db_host = Config::GetInstance().GetString("mysql.host", "127.0.0.1");
     int db_port = Config::GetInstance().GetInt("mysql.port", 3306);
     std::string db_user = Config::GetInstance().GetString("mysql.user", "root");
@@ -35,9 +26,27 @@ void RunServer() {
         db_port, db_user, db_pass, db_name, 5
     );
     
-    std::string redis_host = Config::GetInstance().GetString("redis.host", "127.0.0.1");
-    int redis_port = Config::GetInstance().GetInt("redis.port", 6379);
-    RedisClient::GetInstance().Init(redis_host, redis_port);
+    std::vector<std::string> redis_nodes = Config::GetInstance().GetStringList("redis.nodes");
+    if (!redis_nodes.empty()) {
+        RedisClient::GetInstance().Init(redis_nodes);
+    } else {
+        std::string redis_host = Config::GetInstance().GetString("redis.host", "127.0.0.1");
+        int redis_port = Config::GetInstance().GetInt("redis.port", 6379);
+        RedisClient::GetInstance().Init(redis_host, redis_port);
+    }
+
+    int port = Config::GetInstance().GetInt("auth_service.port", 50051);
+    std::string server_address("0.0.0.0:" + std::to_string(port));
+    AuthServiceImpl service;
+
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+    builder.RegisterService(&service);
+    AddRpcMetrics(builder);
+    
+    std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+    spdlog::info("Auth Server listening on {}", server_address);
+    MetricsServer::Start(Config::GetInstance().GetInt("metrics.auth_port", 9101));
 
     server->Wait();
 }
@@ -2,8 +2,110 @@
 #include <spdlog/spdlog.h>
 #include <sstream>
 #include <grpcpp/grpcpp.h>
-#include "gateway.grpc.pb.h"
-#include "grpc_channel_pool.h"
+#include "push_dispatcher.h"
+#include "timeline_cache.h"
+#include "id_generator.h"
+#include "message_writer.h"
+#include "trace.h"
+#include "config.h"
+#include <algorithm>
+#include <ctime>
+#include <map>
+#include <optional>
+
+// Body shared by every inbox entry of one message in the TimelineCache.
+// created_at uses the chat server's clock in the same format MySQL returns.
+static TimelineCache::Body MakeCachedBody(int64_t msg_id, int64_t sender_id, int64_t group_id,
+                                          int type, const std::string& content) {
+    auto body = std::make_shared<tinyim::chat::MessageItem>();
+    body->set_msg_id(msg_id);
+    body->set_sender_id(sender_id);
+    body->set_group_id(group_id);
+    body->set_type((tinyim::chat::MsgType)type);
+    body->set_content(content);
+
+    std::time_t now = std::time(nullptr);
+    std::tm tm_now;
+    localtime_r(&now, &tm_now);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm_now);
+    body->set_created_at(buf);
+    return body;
+}
+
+// Inline push: messages up to chat.inline_push_max_bytes of content travel inside the
+// notify to receivers that are caught up (0 disables)
+static size_t InlinePushMaxBytes() {
+    int max_bytes = Config::GetInstance().GetInt("chat.inline_push_max_bytes", 0);
+    return max_bytes > 0 ? static_cast<size_t>(max_bytes) : 0;
+}
+
+// Per-user flag, "1" if the user is in any read-diffusion group and "0" if not, so
+// SyncMessages only reads group timelines for users that have one. Computed from the
+// DB on a miss and cached for kReadDiffusionFlagTtlSec. Dropped when the user joins a
+// group (user_server) and for every member when a group switches to read diffusion.
+static constexpr int kReadDiffusionFlagTtlSec = 600;
+
+static std::string ReadDiffusionFlagKey(int64_t user_id) {
+    return "im:rdgroup:" + std::to_string(user_id);
+}
+
+// One DEL per node for the flags of all members
+static void ClearReadDiffusionFlags(const std::vector<int64_t>& members) {
+    RedisClient& redis = RedisClient::GetInstance();
+    std::map<size_t, std::vector<std::string>> per_node;
+    for (int64_t uid : members) {
+        std::string key = ReadDiffusionFlagKey(uid);
+        size_t shard = redis.ShardOf(key);
+        std::vector<std::string>& argv = per_node[shard];
+        if (argv.empty()) argv.push_back("DEL");
+        argv.push_back(std::move(key));
+    }
+    for (const auto& [shard, argv] : per_node) {
+        RedisPipeline pipe(shard);
+        if (pipe.valid()) {
+            pipe.Append(argv);
+            auto replies = pipe.Exec();
+            if (!replies.empty() && replies[0]) continue;
+        }
+        spdlog::error("Clear Read Diffusion Flags Failed on node {}", shard);
+    }
+}
+
+// Hybrid storage for group messages:
+//  - Write diffusion (default): one im_message_index row per member.
+//  - Read diffusion: groups with more than chat.read_diffusion_threshold members
+//    store one im_group_timeline row per message; members read it in SyncMessages
+//    through their im_group_cursor. The switch is sticky (im_group.read_diffusion),
+//    so a group never has new messages split across both modes.
+// Returns true if the group (now) uses read diffusion.
+static bool UseReadDiffusion(MYSQL* read_conn, MYSQL* write_conn, int64_t group_id,
+                             const std::vector<int64_t>& members) {
+    size_t member_count = members.size();
+    std::string sql = "SELECT read_diffusion FROM im_group WHERE group_id=" + std::to_string(group_id);
+    if (mysql_query(read_conn, sql.c_str()) == 0) {
+        MYSQL_RES* res = mysql_store_result(read_conn);
+        if (res) {
+            MYSQL_ROW row = mysql_fetch_row(res);
+            bool flagged = row && row[0] && std::stoi(row[0]) == 1;
+            mysql_free_result(res);
+            if (flagged) return true;
+        }
+    }
+
+    // 0 disables the hybrid mode for groups that have not switched yet
+    int threshold = Config::GetInstance().GetInt("chat.read_diffusion_threshold", 0);
+    if (threshold <= 0 || member_count <= static_cast<size_t>(threshold)) return false;
+
+    sql = "UPDATE im_group SET read_diffusion=1 WHERE group_id=" + std::to_string(group_id);
+    if (mysql_query(write_conn, sql.c_str())) {
+        spdlog::error("Enable Read Diffusion Failed: {}", mysql_error(write_conn));
+        return false;
+    }
+    spdlog::info("Group {} switched to read diffusion ({} members)", group_id, member_count);
+    ClearReadDiffusionFlags(members);
+    return true;
+}
 
 Status ChatServiceImpl::SendMessage(ServerContext* context, const tinyim::chat::SendMessageReq* request,
                                     tinyim::chat::SendMessageResp* reply) {
@@ -13,215 +115,179 @@ Status ChatServiceImpl::SendMessage(ServerContext* context, const tinyim::chat::
 
 
 
-    DBConn conn; // Write Connection
-    DBConn read_conn(DBConn::READ); // Read Connection
-    
-    if (!conn.valid() || !read_conn.valid()) return Status(grpc::INTERNAL, "Database Error");
-
-    // Escape Content
-    std::vector<char> escaped_buffer(content.length() * 2 + 1);
-    mysql_real_escape_string(conn.get(), escaped_buffer.data(), content.c_str(), content.length());
-    std::string safe_content = escaped_buffer.data();
-    
     int64_t group_id = request->group_id();
     int type = (int)request->type();
 
-    // --- 1. Store Message Body (Write Once) ---
-    // In production, use Snowflake ID. Here use auto-increment from DB.
-    std::string sql_body = "INSERT INTO im_message_body (sender_id, group_id, msg_type, msg_content) VALUES (" + 
-                           std::to_string(sender_id) + ", " + 
-                           std::to_string(group_id) + ", " + 
-                           std::to_string(type) + ", '" + safe_content + "')";
-    
-    if (mysql_query(conn.get(), sql_body.c_str())) {
-        spdlog::error("Insert Body Failed: {}", mysql_error(conn.get()));
+    // Stage timestamps, if the sender's gateway started a trace
+    Trace trace = Trace::FromMetadata(*context);
+    if (!trace.empty()) trace.Mark(TraceStage::kChatRecv);
+
+    // --- 1. Message Body (Write Once) ---
+    // msg_id is a time-ordered snowflake ID generated locally, so it is known
+    // before anything is written.
+    int64_t msg_id = IdGenerator::GetInstance().NextId();
+    if (msg_id == 0) {
+        spdlog::error("No msg_id node id leased, rejecting message");
         reply->set_success(false);
-        reply->set_error_message("Save Body Failed");
+        reply->set_error_message("ID Unavailable");
         return Status::OK;
     }
-    int64_t msg_id = mysql_insert_id(conn.get());
-
-    // --- 3. Store Inbox Index (Timeline) ---
-    // Handle Group or Single
-    if (group_id > 0) {
-        // Group Chat: Write Diffusion (Fan-out)
-        // 1. Get All Members
-        std::vector<int64_t> members;
-        std::string sql_mem = "SELECT user_id FROM im_group_member WHERE group_id=" + std::to_string(group_id);
-        if (mysql_query(read_conn.get(), sql_mem.c_str())) {
-             spdlog::error("Get Group Members Failed: {}", mysql_error(read_conn.get()));
-        } else {
-             MYSQL_RES* res = mysql_store_result(read_conn.get());
-             if (res) {
-                 MYSQL_ROW row;
-                 while ((row = mysql_fetch_row(res))) {
-                     members.push_back(std::stoll(row[0]));
-                 }
-                 mysql_free_result(res);
-             }
-        }
-        
-        // 2. Loop Insert & Push (Optimize: Batch Insert)
-        if (members.empty()) {
-             // Handle empty group?
-             reply->set_msg_id(msg_id);
-             reply->set_success(true);
-             return Status::OK;
-        }
 
-        std::string batch_sql = "INSERT INTO im_message_index (owner_id, other_id, msg_id, seq_id, is_sender) VALUES ";
-        
-        // We need SeqID for each member. 
-        // Ideal: Lua script to INCR multiple keys.
-        // MVP: Sequential INCR (Redis is fast enough compared to DB). 
-        // Optimization: Use Redis Pipelining here if possible, but let's stick to simple Batch SQL first.
-        
-        std::vector<std::pair<int64_t, int64_t>> push_targets; // uid, seq
-
-        for (size_t i = 0; i < members.size(); ++i) {
-             int64_t member_uid = members[i];
-             
-             // Get Seq
-             std::string m_seq_key = "im:seq:" + std::to_string(member_uid);
-             long long m_seq = 0;
-             // Note: using local scope RedisConn for each INCR is slightly inefficient but OK for MVP vs DB batching
-             // TODO: Use Pipeline
-             RedisConn r_conn; 
-             if (r_conn.get()) {
-                 redisReply* r = (redisReply*)redisCommand(r_conn.get(), "INCR %s", m_seq_key.c_str());
-                 if (r && r->type == REDIS_REPLY_INTEGER) m_seq = r->integer;
-                 if (r) freeReplyObject(r);
-             }
-             
-             // Append to Batch SQL
-             batch_sql += "(" + std::to_string(member_uid) + ", " + 
-                          std::to_string(group_id) + ", " + 
-                          std::to_string(msg_id) + ", " + 
-                          std::to_string(m_seq) + ", 0)";
-             
-             if (i < members.size() - 1) batch_sql += ",";
-             
-             push_targets.push_back({member_uid, m_seq});
-        }
-        
-        // Execute Batch SQL
-        if (mysql_query(conn.get(), batch_sql.c_str())) {
-            spdlog::error("Batch Insert Failed: {}", mysql_error(conn.get()));
-            // Continue to push? Or Fail? Partial fail usage?
-        }
+    MessageWrite write;
+    write.bodies.push_back({msg_id, sender_id, group_id, type, content});
+    std::vector<PushTarget> targets;
+    int64_t reply_seq = 0;
+
+    // --- 2. Recipients & Inbox Index (Timeline) ---
+    // Connections are scoped to this phase: the write below waits for a flusher
+    // that needs a master connection from the same pool.
+    {
+        DBConn conn; // Write Connection
+        DBConn read_conn(DBConn::READ); // Read Connection
         
-        // Parallel Push (or Sequential with Pool)
-        // Group Push is heavy.
-        for (auto& target : push_targets) {
-             int64_t uid = target.first;
-             int64_t seq = target.second;
-             
-             bool m_online = RedisClient::GetInstance().Exists("im:session:" + std::to_string(uid));
-             if (m_online) {
-                 std::string loc_key = "im:location:" + std::to_string(uid);
-                 auto locations = RedisClient::GetInstance().HGetAll(loc_key);
-                 for (auto& kv : locations) {
-                    // device = kv.first, addr = kv.second
-                    try {
-                        // Use GRPC Pool
-                        auto channel = GRPCChannelPool::GetInstance().GetChannel(kv.second);
-                        auto stub = tinyim::gateway::GatewayService::NewStub(channel);
-                        
-                        grpc::ClientContext ctx;
-                        tinyim::gateway::PushNotifyReq pr;
-                        pr.set_user_id(uid); pr.set_max_seq(seq); pr.set_msg_type(request->type());
-                        
-                        // Async or short timeout? 
-                        // For MVP: Sync with short deadline
-                         std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(500);
-                         ctx.set_deadline(deadline);
-                         
-                        tinyim::gateway::PushNotifyResp presp;
-                        stub->PushNotify(&ctx, pr, &presp);
-                    } catch(...) {}
+        if (!conn.valid() || !read_conn.valid()) return Status(grpc::INTERNAL, "Database Error");
+
+        // Handle Group or Single
+        if (group_id > 0) {
+            // Group Chat
+            // 1. Get All Members
+            std::vector<int64_t> members;
+            std::string sql_mem = "SELECT user_id FROM im_group_member WHERE group_id=" + std::to_string(group_id);
+            if (mysql_query(read_conn.get(), sql_mem.c_str())) {
+                 spdlog::error("Get Group Members Failed: {}", mysql_error(read_conn.get()));
+            } else {
+                 MYSQL_RES* res = mysql_store_result(read_conn.get());
+                 if (res) {
+                     MYSQL_ROW row;
+                     while ((row = mysql_fetch_row(res))) {
+                         members.push_back(std::stoll(row[0]));
+                     }
+                     mysql_free_result(res);
                  }
-             }
-        }
-        
-        // Reply to Sender
-        reply->set_msg_id(msg_id);
-        reply->set_seq_id(0); 
-        reply->set_success(true);
-        return Status::OK;
-        
-    } else {
-        // Single Chat (Existing Logic)
-        
-        // --- RELATION CHECK (Check if they are friends) ---
-        // We select status from im_relation
-        // status 1 = normal, 2 = block
-        std::string sql_rel = "SELECT status FROM im_relation WHERE user_id=" + std::to_string(sender_id) + 
-                              " AND friend_id=" + std::to_string(receiver_id);
-        
-        bool is_friend = false;
-        // Use Master (conn) to avoid replication lag
-        if (mysql_query(conn.get(), sql_rel.c_str()) == 0) {
-             MYSQL_RES* res = mysql_store_result(conn.get());
-             if (res) {
-                 MYSQL_ROW row = mysql_fetch_row(res);
-                 if (row && std::stol(row[0]) == 1) {
-                     is_friend = true;
+            }
+            
+            if (members.empty()) {
+                 // Empty group: nothing to fan out, only the body is stored
+            } else if (UseReadDiffusion(read_conn.get(), conn.get(), group_id, members)) {
+                 // Read Diffusion: one timeline row for the whole group
+                 std::vector<long long> gseq = RedisClient::GetInstance().IncrBatch({"im:gseq:" + std::to_string(group_id)});
+                 if (gseq.size() != 1) {
+                     spdlog::error("Allocate Group Timeline Seq Failed: group {}", group_id);
+                     reply->set_success(false);
+                     reply->set_error_message("Allocate Seq Failed");
+                     return Status::OK;
                  }
-                 mysql_free_result(res);
-             }
-        }
-        
-        // Allow SYSTEM messages (type=3) or Friend Request (type=4) even if not friend
-        if (!is_friend && type != 3 && type != 4) {
-             reply->set_success(false);
-             reply->set_error_message("Not friends");
-             return Status::OK;
-        }
+                 write.timelines.push_back({group_id, gseq[0], msg_id});
 
-        // Get Seq
-        std::string seq_key = "im:seq:" + std::to_string(receiver_id);
-        long long seq_id = 0;
-        
-        RedisConn redis_conn; // Declare here
-        if (redis_conn.get()) {
-            redisReply* r_seq = (redisReply*)redisCommand(redis_conn.get(), "INCR %s", seq_key.c_str());
-            if (r_seq && r_seq->type == REDIS_REPLY_INTEGER) seq_id = r_seq->integer;
-            if (r_seq) freeReplyObject(r_seq);
-        }
+                 // Personal max_seq is unchanged: the notify carries the group position instead
+                 targets.reserve(members.size());
+                 for (int64_t member_uid : members) {
+                     targets.push_back({member_uid, 0, group_id, gseq[0]});
+                 }
+            } else {
+                 // Write Diffusion (Fan-out)
+                 // We need SeqID for each member: one Lua call INCRs every member's key
+                 // (pipelined in chunks), so this is a few RTTs regardless of group size.
+                 std::vector<std::string> seq_keys;
+                 seq_keys.reserve(members.size());
+                 for (int64_t member_uid : members) {
+                     seq_keys.push_back("im:seq:" + std::to_string(member_uid));
+                 }
+                 std::vector<long long> seqs = RedisClient::GetInstance().IncrBatch(seq_keys);
+                 if (seqs.size() != members.size()) {
+                     // Without seqs the index rows would collide on seq 0
+                     spdlog::error("Allocate Group Seq Failed: group {}", group_id);
+                     reply->set_success(false);
+                     reply->set_error_message("Allocate Seq Failed");
+                     return Status::OK;
+                 }
 
-        std::string sql_index = "INSERT INTO im_message_index (owner_id, other_id, msg_id, seq_id, is_sender) VALUES (" +
-                                std::to_string(receiver_id) + ", " + std::to_string(sender_id) + ", " + 
-                                std::to_string(msg_id) + ", " + std::to_string(seq_id) + ", 0)";
-        
-        if (mysql_query(conn.get(), sql_index.c_str())) {
-            spdlog::error("Insert Index Receiver Failed: {}", mysql_error(conn.get()));
-            reply->set_success(false);
-            return Status::OK;
-        }
-        
-        // Push
-        std::string status_key = "im:location:" + std::to_string(receiver_id);
-        if (RedisClient::GetInstance().Exists(status_key)) {
-             std::string loc_key = "im:location:" + std::to_string(receiver_id);
-             auto locations = RedisClient::GetInstance().HGetAll(loc_key);
-             for (auto& kv : locations) {
-                try {
-                    auto channel = grpc::CreateChannel(kv.second, grpc::InsecureChannelCredentials());
-                    auto stub = tinyim::gateway::GatewayService::NewStub(channel);
-                    grpc::ClientContext ctx;
-                    tinyim::gateway::PushNotifyReq pr;
-                    pr.set_user_id(receiver_id); pr.set_max_seq(seq_id); pr.set_msg_type(request->type());
-                    tinyim::gateway::PushNotifyResp presp;
-                    stub->PushNotify(&ctx, pr, &presp);
-                } catch(...) {}
-             }
+                 write.indexes.reserve(members.size());
+                 targets.reserve(members.size());
+                 for (size_t i = 0; i < members.size(); ++i) {
+                     write.indexes.push_back({members[i], group_id, msg_id, seqs[i], 0});
+                     targets.push_back({members[i], seqs[i]});
+                 }
+            }
+        } else {
+            // Single Chat (Existing Logic)
+            
+            // --- RELATION CHECK (Check if they are friends) ---
+            // We select status from im_relation
+            // status 1 = normal, 2 = block
+            bool is_friend = false;
+            // Use Master (conn) to avoid replication lag
+            DBStmt* stmt_rel = conn.Prepare("SELECT status FROM im_relation WHERE user_id=? AND friend_id=?");
+            if (stmt_rel && stmt_rel->Bind(sender_id).Bind(receiver_id).Execute()) {
+                 while (stmt_rel->Fetch()) {
+                     if (stmt_rel->GetInt64(0) == 1) is_friend = true;
+                 }
+            }
+            
+            // Allow SYSTEM messages (type=3) or Friend Request (type=4) even if not friend
+            if (!is_friend && type != 3 && type != 4) {
+                 reply->set_success(false);
+                 reply->set_error_message("Not friends");
+                 return Status::OK;
+            }
+
+            // Get Seq
+            std::string seq_key = "im:seq:" + std::to_string(receiver_id);
+            long long seq_id = 0;
+            
+            RedisConn redis_conn(seq_key); // The node owning the key
+            if (redis_conn.get()) {
+                redisReply* r_seq = (redisReply*)redisCommand(redis_conn.get(), "INCR %s", seq_key.c_str());
+                if (r_seq && r_seq->type == REDIS_REPLY_INTEGER) seq_id = r_seq->integer;
+                if (r_seq) freeReplyObject(r_seq);
+            }
+
+            write.indexes.push_back({receiver_id, sender_id, msg_id, seq_id, 0});
+            targets.push_back({receiver_id, seq_id});
+            reply_seq = seq_id;
         }
-        
-        reply->set_msg_id(msg_id);
-        reply->set_seq_id(seq_id);
-        reply->set_success(true);
+    }
+
+    if (!trace.empty()) {
+        trace.Mark(TraceStage::kSeqAlloc);
+        write.trace = &trace;
+    }
+
+    // --- 3. Store: body + index/timeline rows, group-committed with concurrent senders ---
+    // Acked only once the batch holding these rows has committed.
+    if (!MessageWriter::GetInstance().Submit(std::move(write)).get()) {
+        reply->set_success(false);
+        reply->set_error_message("Save Message Failed");
         return Status::OK;
     }
+
+    // Inbox messages (not read diffusion) share one body between the hot timelines
+    // and the inline push
+    bool inbox = !targets.empty() && targets.front().max_seq > 0;
+    bool inline_push = inbox && content.size() <= InlinePushMaxBytes();
+    TimelineCache::Body body;
+    if (inbox && (TimelineCache::GetInstance().enabled() || inline_push)) {
+        body = MakeCachedBody(msg_id, sender_id, group_id, type, content);
+    }
+
+    // Write through to the hot timelines: every recipient's entry shares one body
+    if (inbox && TimelineCache::GetInstance().enabled()) {
+        for (const auto& target : targets) {
+            TimelineCache::GetInstance().Append(target.user_id, target.max_seq, body);
+        }
+    }
+
+    // Push: one BatchPushNotify per gateway, issued async
+    if (!targets.empty()) {
+        PushDispatcher::GetInstance().Push(targets, request->type(), inline_push ? body : nullptr,
+                                           trace.empty() ? nullptr : &trace);
+    }
+
+    // Reply to Sender
+    reply->set_msg_id(msg_id);
+    reply->set_seq_id(reply_seq);
+    reply->set_success(true);
+    return Status::OK;
 }
 
 Status ChatServiceImpl::SyncMessages(ServerContext* context, const tinyim::chat::SyncMessagesReq* request,
@@ -231,7 +297,13 @@ Status ChatServiceImpl::SyncMessages(ServerContext* context, const tinyim::chat:
     int limit = request->limit();
     if (limit <= 0) limit = 10;
 
-    DBConn conn(DBConn::READ);
+    // Checked out by the first query: a TimelineCache hit for a user in no
+    // read-diffusion group runs none
+    std::optional<DBConn> conn;
+    auto read_conn = [&conn]() -> DBConn& {
+        if (!conn) conn.emplace(DBConn::READ);
+        return *conn;
+    };
     
     // JOIN query to get content
     // SELECT idx.seq_id, idx.msg_id, idx.other_id, body.msg_content, body.created_at
@@ -242,55 +314,188 @@ Status ChatServiceImpl::SyncMessages(ServerContext* context, const tinyim::chat:
 
     bool reverse = request->reverse();
     
-    char sql[512];
-    if (reverse) {
-        // Web Mode: Pull latest N messages.
-        snprintf(sql, sizeof(sql), 
-                 "SELECT idx.seq_id, idx.msg_id, body.sender_id, body.group_id, body.msg_type, body.msg_content, body.created_at "
-                 "FROM im_message_index idx "
-                 "LEFT JOIN im_message_body body ON idx.msg_id = body.msg_id "
-                 "WHERE idx.owner_id=%ld "
-                 "ORDER BY idx.seq_id DESC LIMIT %d",
-                 user_id, limit);
-    } else {
-        // PC Mode: Resume from local_seq
-        snprintf(sql, sizeof(sql), 
-                 "SELECT idx.seq_id, idx.msg_id, body.sender_id, body.group_id, body.msg_type, body.msg_content, body.created_at "
-                 "FROM im_message_index idx "
-                 "LEFT JOIN im_message_body body ON idx.msg_id = body.msg_id "
-                 "WHERE idx.owner_id=%ld AND idx.seq_id > %ld "
-                 "ORDER BY idx.seq_id ASC LIMIT %d",
-                 user_id, local_seq, limit);
+    // Personal inbox rows first, then the read-diffusion group timelines; merged by msg_id
+    // (global, monotonic) below.
+    std::vector<tinyim::chat::MessageItem> items;
+
+    // Hot path: the inbox tail is in the TimelineCache and ends at the current seq
+    bool cached = false;
+    TimelineCache& cache = TimelineCache::GetInstance();
+    if (cache.enabled()) {
+        std::string seq_str = RedisClient::GetInstance().Get("im:seq:" + std::to_string(user_id));
+        if (!seq_str.empty()) {
+            int64_t server_seq = std::stoll(seq_str);
+            cached = reverse ? cache.Latest(user_id, server_seq, limit, items)
+                             : cache.Since(user_id, local_seq, server_seq, limit, items);
+        }
     }
 
-    if (mysql_query(conn.get(), sql)) {
-        reply->set_success(false);
-        spdlog::error("Sync Query Failed: {}", mysql_error(conn.get()));
-        return Status::OK;
+    if (!cached) {
+        DBStmt* stmt_sync = nullptr;
+        if (reverse) {
+            // Web Mode: Pull latest N messages.
+            stmt_sync = read_conn().Prepare(
+                "SELECT idx.seq_id, idx.msg_id, body.sender_id, body.group_id, body.msg_type, body.msg_content, body.created_at "
+                "FROM im_message_index idx "
+                "LEFT JOIN im_message_body body ON idx.msg_id = body.msg_id "
+                "WHERE idx.owner_id=? "
+                "ORDER BY idx.seq_id DESC LIMIT ?");
+            if (stmt_sync) stmt_sync->Bind(user_id).Bind(limit);
+        } else {
+            // PC Mode: Resume from local_seq
+            stmt_sync = read_conn().Prepare(
+                "SELECT idx.seq_id, idx.msg_id, body.sender_id, body.group_id, body.msg_type, body.msg_content, body.created_at "
+                "FROM im_message_index idx "
+                "LEFT JOIN im_message_body body ON idx.msg_id = body.msg_id "
+                "WHERE idx.owner_id=? AND idx.seq_id > ? "
+                "ORDER BY idx.seq_id ASC LIMIT ?");
+            if (stmt_sync) stmt_sync->Bind(user_id).Bind(local_seq).Bind(limit);
+        }
+
+        if (!stmt_sync || !stmt_sync->Execute()) {
+            reply->set_success(false);
+            spdlog::error("Sync Query Failed: {}", stmt_sync ? stmt_sync->error()
+                          : read_conn().valid() ? mysql_error(read_conn().get()) : "no connection");
+            return Status::OK;
+        }
+
+        while (stmt_sync->Fetch()) {
+            tinyim::chat::MessageItem msg;
+            msg.set_seq_id(stmt_sync->GetInt64(0));
+            msg.set_msg_id(stmt_sync->GetInt64(1));
+            msg.set_sender_id(stmt_sync->GetInt64(2)); // Real sender_id from body
+            msg.set_group_id(stmt_sync->GetInt64(3));  // Real group_id from body
+            msg.set_type((tinyim::chat::MsgType)stmt_sync->GetInt64(4));
+            msg.set_content(stmt_sync->GetString(5));
+            msg.set_created_at(stmt_sync->GetString(6));
+            items.push_back(std::move(msg));
+        }
     }
 
-    MYSQL_RES* res = mysql_store_result(conn.get());
-    if (!res) {
-        reply->set_success(true);
-        return Status::OK;
+    // Timelines of the read-diffusion groups the user is in, if any.
+    // Forward sync reads past the user's cursor; reverse (Web) mode just takes the latest rows.
+    // Only messages sent after the user joined are visible.
+    size_t inbox_count = items.size();
+    std::string flag_key = ReadDiffusionFlagKey(user_id);
+    std::string in_read_diffusion = RedisClient::GetInstance().Get(flag_key);
+    if (in_read_diffusion.empty()) {
+        DBStmt* stmt_rd = read_conn().Prepare(
+            "SELECT 1 FROM im_group_member mem "
+            "JOIN im_group g ON g.group_id = mem.group_id AND g.read_diffusion = 1 "
+            "WHERE mem.user_id=? LIMIT 1");
+        if (stmt_rd && stmt_rd->Bind(user_id).Execute()) {
+            bool found = false;
+            while (stmt_rd->Fetch()) found = true;
+            in_read_diffusion = found ? "1" : "0";
+            RedisClient::GetInstance().SetEx(flag_key, in_read_diffusion, kReadDiffusionFlagTtlSec);
+        } else {
+            in_read_diffusion = "1"; // Unknown: read the timelines
+        }
+    }
+
+    if (in_read_diffusion == "1") {
+        DBStmt* stmt_tl = nullptr;
+        if (reverse) {
+            stmt_tl = read_conn().Prepare(
+                "SELECT tl.group_seq, tl.msg_id, body.sender_id, tl.group_id, body.msg_type, body.msg_content, body.created_at "
+                "FROM im_group_member mem "
+                "JOIN im_group g ON g.group_id = mem.group_id AND g.read_diffusion = 1 "
+                "JOIN im_group_timeline tl ON tl.group_id = mem.group_id AND tl.created_at >= mem.created_at "
+                "LEFT JOIN im_message_body body ON tl.msg_id = body.msg_id "
+                "WHERE mem.user_id=? "
+                "ORDER BY tl.msg_id DESC LIMIT ?");
+        } else {
+            stmt_tl = read_conn().Prepare(
+                "SELECT tl.group_seq, tl.msg_id, body.sender_id, tl.group_id, body.msg_type, body.msg_content, body.created_at "
+                "FROM im_group_member mem "
+                "JOIN im_group g ON g.group_id = mem.group_id AND g.read_diffusion = 1 "
+                "JOIN im_group_timeline tl ON tl.group_id = mem.group_id AND tl.created_at >= mem.created_at "
+                "LEFT JOIN im_group_cursor cur ON cur.user_id = mem.user_id AND cur.group_id = mem.group_id "
+                "LEFT JOIN im_message_body body ON tl.msg_id = body.msg_id "
+                "WHERE mem.user_id=? AND tl.group_seq > IFNULL(cur.read_seq, 0) "
+                "ORDER BY tl.group_seq ASC LIMIT ?"); // Each group's rows: a prefix past its cursor
+        }
+
+        if (!stmt_tl || !stmt_tl->Bind(user_id).Bind(limit).Execute()) {
+            // Inbox is still served; the timelines are picked up on the next sync
+            spdlog::error("Sync Group Timeline Failed: {}", stmt_tl ? stmt_tl->error() : "no statement");
+        } else {
+            while (stmt_tl->Fetch()) {
+                tinyim::chat::MessageItem msg;
+                msg.set_group_seq(stmt_tl->GetInt64(0));
+                msg.set_msg_id(stmt_tl->GetInt64(1));
+                msg.set_sender_id(stmt_tl->GetInt64(2));
+                msg.set_group_id(stmt_tl->GetInt64(3));
+                msg.set_type((tinyim::chat::MsgType)stmt_tl->GetInt64(4)); // NULL body: TEXT
+                msg.set_content(stmt_tl->GetString(5));
+                msg.set_created_at(stmt_tl->GetString(6));
+                items.push_back(std::move(msg));
+            }
+        }
+    }
+
+    if (items.size() > inbox_count && reverse) {
+        std::stable_sort(items.begin(), items.end(), [](const tinyim::chat::MessageItem& a, const tinyim::chat::MessageItem& b) {
+            return a.msg_id() > b.msg_id();
+        });
+        if (items.size() > static_cast<size_t>(limit)) items.resize(limit);
+    } else if (items.size() > inbox_count) {
+        // Forward sync: the cursors move to the highest seq handed out, so each stream
+        // (the inbox by seq, each timeline by group_seq) must go out as a prefix. msg_id
+        // is taken before the seq and can disagree with seq order, so sorting by msg_id
+        // and cutting at the limit could drop seq N yet keep N+1. Merge the streams by
+        // the msg_id of their heads instead.
+        std::map<int64_t, std::vector<tinyim::chat::MessageItem>> streams; // group_id, or -1 for the inbox
+        for (auto& msg : items) streams[msg.group_seq() > 0 ? msg.group_id() : -1].push_back(std::move(msg));
+        std::vector<std::pair<std::vector<tinyim::chat::MessageItem>*, size_t>> heads; // (rows, next)
+        for (auto& [id, rows] : streams) heads.emplace_back(&rows, 0);
+
+        std::vector<tinyim::chat::MessageItem> merged;
+        merged.reserve(std::min(items.size(), static_cast<size_t>(limit)));
+        while (merged.size() < static_cast<size_t>(limit)) {
+            std::pair<std::vector<tinyim::chat::MessageItem>*, size_t>* next = nullptr;
+            for (auto& head : heads) {
+                if (head.second == head.first->size()) continue;
+                if (!next || (*head.first)[head.second].msg_id() < (*next->first)[next->second].msg_id()) next = &head;
+            }
+            if (!next) break;
+            merged.push_back(std::move((*next->first)[next->second++]));
+        }
+        items = std::move(merged);
     }
 
-    MYSQL_ROW row;
     int64_t max_seq_found = local_seq;
-    while ((row = mysql_fetch_row(res))) {
-        auto* msg = reply->add_msgs();
-        int64_t s_id = std::stoll(row[0]);
-        msg->set_seq_id(s_id);
-        msg->set_msg_id(std::stoll(row[1]));
-        msg->set_sender_id(std::stoll(row[2])); // Real sender_id from body
-        msg->set_group_id(std::stoll(row[3]));  // Real group_id from body
-        msg->set_type((tinyim::chat::MsgType)std::stoi(row[4]));
-        msg->set_content(row[5] ? row[5] : "");
-        msg->set_created_at(row[6] ? row[6] : "");
-        
-        if (s_id > max_seq_found) max_seq_found = s_id;
+    std::map<int64_t, int64_t> cursors; // group_id -> highest group_seq returned
+    for (auto& msg : items) {
+        if (msg.seq_id() > max_seq_found) max_seq_found = msg.seq_id();
+        if (msg.group_seq() > 0) {
+            int64_t& c = cursors[msg.group_id()];
+            c = std::max(c, msg.group_seq());
+        }
+        *reply->add_msgs() = std::move(msg);
+    }
+
+    // Advance cursors past what was handed out (forward sync only). Rows dropped by
+    // the limit stay beyond the cursor and come with the next sync.
+    if (!reverse && !cursors.empty()) {
+        std::string sql_cur = "INSERT INTO im_group_cursor (user_id, group_id, read_seq) VALUES ";
+        bool first = true;
+        for (const auto& [gid, gseq] : cursors) {
+            if (!first) sql_cur += ",";
+            first = false;
+            sql_cur += "(" + std::to_string(user_id) + ", " + std::to_string(gid) + ", " + std::to_string(gseq) + ")";
+        }
+        sql_cur += " ON DUPLICATE KEY UPDATE read_seq = GREATEST(read_seq, VALUES(read_seq))";
+        DBConn write_conn;
+        if (!write_conn.valid() || mysql_query(write_conn.get(), sql_cur.c_str())) {
+            spdlog::error("Update Group Cursor Failed: {}", write_conn.valid() ? mysql_error(write_conn.get()) : "no connection");
+        }
+    }
+
+    // What this client now holds: inline pushes go to receivers whose next seq is the new one
+    if (!reverse && InlinePushMaxBytes() > 0) {
+        RedisClient::GetInstance().Set("im:ack:" + std::to_string(user_id), std::to_string(max_seq_found));
     }
-    mysql_free_result(res);
 
     reply->set_max_seq(max_seq_found);
     reply->set_success(true);
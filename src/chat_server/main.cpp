@@ -5,8 +5,11 @@
 #include "redis_client.h"
 
 #include "service_registry.h" // Added
+#include "id_generator.h"
 
 #include "config.h"
+#include "metrics.h"
+#include "rpc_metrics.h"
 
 void RunServer() {
     // Init Config
@@ -14,18 +17,6 @@ void RunServer() {
         Config::GetInstance().Load("../config.json");
     }
 
-    int port = Config::GetInstance().GetInt("chat_service.port", 50052);
-    std::string server_address = "0.0.0.0:" + std::to_string(port);
-    
-    ChatServiceImpl service;
-
-    grpc::ServerBuilder builder;
-    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
-    builder.RegisterService(&service);
-    
-    std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
-    spdlog::info("Chat Server listening on {}", server_address);
-
     // Initialize DB Pool
     std::string db_host = Config::GetInstance().GetString("mysql.host", "127.0.0.1");
     int db_port = Config::GetInstance().GetInt("mysql.port", 3306);
@@ -41,9 +32,19 @@ void RunServer() {
         db_port, db_user, db_pass, db_name, 5
     );
     
-    std::string redis_host = Config::GetInstance().GetString("redis.host", "127.0.0.1");
-    int redis_port = Config::GetInstance().GetInt("redis.port", 6379);
-    RedisClient::GetInstance().Init(redis_host, redis_port);
+    int port = Config::GetInstance().GetInt("chat_service.port", 50052);
+    std::string server_address = "0.0.0.0:" + std::to_string(port);
+    
+    ChatServiceImpl service;
+
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+    builder.RegisterService(&service);
+    AddRpcMetrics(builder);
+    
+    std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
+    spdlog::info("Chat Server listening on {}", server_address);
+    MetricsServer::Start(Config::GetInstance().GetInt("metrics.chat_port", 9102));
 
     server->Wait();
 }
@@ -56,18 +57,30 @@ int main(int argc, char** argv) {
     }
     
     // Config loaded in RunServer, but we need it for Registry?
-    // Let's load it here.
+    // Let's load it here. Redis is initialized once, here: the registry
+    // heartbeat and the node id lease use it before RunServer starts.
     if (!Config::GetInstance().Load("config.json")) {
          Config::GetInstance().Load("../config.json");
     }
     
-    std::string redis_host = Config::GetInstance().GetString("redis.host", "127.0.0.1");
-    int redis_port = Config::GetInstance().GetInt("redis.port", 6379);
-    RedisClient::GetInstance().Init(redis_host, redis_port);
+    std::vector<std::string> redis_nodes = Config::GetInstance().GetStringList("redis.nodes");
+    if (!redis_nodes.empty()) {
+        RedisClient::GetInstance().Init(redis_nodes);
+    } else {
+        std::string redis_host = Config::GetInstance().GetString("redis.host", "127.0.0.1");
+        int redis_port = Config::GetInstance().GetInt("redis.port", 6379);
+        RedisClient::GetInstance().Init(redis_host, redis_port);
+    }
     
     // Registry
     int port = Config::GetInstance().GetInt("chat_service.port", 50052);
     ServiceRegistry::GetInstance().Register("chat_server", "127.0.0.1", port);
+
+    // msg_id generator: node id leased among all chat servers
+    ServiceRegistry::GetInstance().AcquireNodeId("msg_id", IdGenerator::kMaxNodeId,
+        [](int node_id, std::chrono::steady_clock::time_point valid_until) {
+            IdGenerator::GetInstance().SetNodeId(node_id, valid_until);
+        });
     
     RunServer();
     return 0;
@@ -0,0 +1,207 @@
+#include "message_writer.h"
+#include <chrono>
+#include <spdlog/spdlog.h>
+#include "config.h"
+#include "db_pool.h"
+
+MessageWriter& MessageWriter::GetInstance() {
+    static MessageWriter instance;
+    return instance;
+}
+
+MessageWriter::MessageWriter() {
+    window_ms_ = Config::GetInstance().GetInt("chat.write_batch_window_ms", 2);
+    int max_rows = Config::GetInstance().GetInt("chat.write_batch_max_rows", 1000);
+    max_rows_ = max_rows > 0 ? max_rows : 1;
+    int max_bytes = Config::GetInstance().GetInt("chat.write_batch_max_bytes", 1024 * 1024);
+    max_bytes_ = max_bytes > 0 ? max_bytes : 1;
+
+    // More than one flusher: the next batch fills and flushes while the previous one commits
+    int flushers = Config::GetInstance().GetInt("chat.write_flushers", 2);
+    if (flushers < 1) flushers = 1;
+    for (int i = 0; i < flushers; ++i) {
+        flushers_.emplace_back(&MessageWriter::FlushLoop, this);
+    }
+}
+
+MessageWriter::~MessageWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : flushers_) {
+        if (t.joinable()) t.join();
+    }
+}
+
+std::future<bool> MessageWriter::Submit(MessageWrite write) {
+    std::future<bool> result;
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        queued_rows_ += write.rows();
+        queued_bytes_ += write.bytes();
+        queue_.push_back(Pending{std::move(write), {}});
+        result = queue_.back().done.get_future();
+        // The first request wakes a flusher to open the window; a full batch cuts it short
+        wake = queue_.size() == 1 || queued_rows_ >= max_rows_ || queued_bytes_ >= max_bytes_;
+    }
+    if (wake) cv_.notify_one();
+    return result;
+}
+
+void MessageWriter::FlushLoop() {
+    while (true) {
+        std::deque<Pending> batch;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (stop_ && queue_.empty()) return;
+
+            // Batching window: let concurrent senders join this commit
+            if (window_ms_ > 0 && queued_rows_ < max_rows_ && queued_bytes_ < max_bytes_) {
+                cv_.wait_for(lock, std::chrono::milliseconds(window_ms_), [this] {
+                    return stop_ || queued_rows_ >= max_rows_ || queued_bytes_ >= max_bytes_;
+                });
+            }
+
+            // Take whole messages up to max_rows_ and max_bytes_ (at least one)
+            size_t rows = 0, bytes = 0;
+            while (!queue_.empty() &&
+                   (batch.empty() || (rows + queue_.front().write.rows() <= max_rows_ &&
+                                      bytes + queue_.front().write.bytes() <= max_bytes_))) {
+                rows += queue_.front().write.rows();
+                bytes += queue_.front().write.bytes();
+                batch.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+            queued_rows_ -= rows;
+            queued_bytes_ -= bytes;
+            if (!queue_.empty()) cv_.notify_one(); // Leftovers go to another flusher
+        }
+
+        std::vector<Pending*> all;
+        for (auto& p : batch) all.push_back(&p);
+
+        DBConn conn;
+        if (conn.valid() && Commit(conn, all)) {
+            for (auto& p : batch) p.done.set_value(true);
+            continue;
+        }
+
+        // Batch failed: isolate the culprit by retrying message by message
+        if (batch.size() > 1) {
+            spdlog::warn("Message batch of {} failed, retrying individually", batch.size());
+        }
+        for (auto& p : batch) {
+            bool ok = conn.valid() && Commit(conn, {&p});
+            p.done.set_value(ok);
+        }
+    }
+}
+
+// Rows per statement come in powers of two up to this: a handful of cached
+// statements per table covers any batch size
+static constexpr size_t kMaxStmtRows = 256;
+
+// INSERT of `rows` rows of `cols` placeholders each, after head ("INSERT INTO t (...) VALUES ")
+static std::string InsertSql(const char* head, int cols, size_t rows) {
+    std::string row = "(?";
+    for (int c = 1; c < cols; ++c) row += ",?";
+    row += ")";
+    std::string sql = head;
+    sql.reserve(sql.size() + rows * (row.size() + 1));
+    for (size_t r = 0; r < rows; ++r) {
+        if (r) sql += ",";
+        sql += row;
+    }
+    return sql;
+}
+
+// Inserts rows through the largest cached statement that fits, then smaller ones
+// for the rest; bind_row binds one row's parameters
+template <class Row, class BindRow>
+static bool InsertRows(DBConn& conn, const char* head, int cols, const std::vector<const Row*>& rows,
+                       BindRow bind_row) {
+    size_t done = 0;
+    while (done < rows.size()) {
+        size_t n = kMaxStmtRows;
+        while (n > rows.size() - done) n /= 2;
+        DBStmt* stmt = conn.Prepare(InsertSql(head, cols, n));
+        if (!stmt) return false;
+        for (size_t i = done; i < done + n; ++i) bind_row(*stmt, *rows[i]);
+        if (!stmt->Execute()) {
+            spdlog::error("Message batch insert failed: {}", stmt->error());
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+bool MessageWriter::Commit(DBConn& conn, const std::vector<Pending*>& batch) {
+    std::vector<const MessageWrite::Body*> bodies;
+    std::vector<const MessageWrite::Index*> indexes;
+    std::vector<const MessageWrite::Timeline*> timelines;
+    for (const Pending* p : batch) {
+        for (const auto& b : p->write.bodies) bodies.push_back(&b);
+        for (const auto& i : p->write.indexes) indexes.push_back(&i);
+        for (const auto& t : p->write.timelines) timelines.push_back(&t);
+    }
+
+    if (mysql_query(conn.get(), "START TRANSACTION")) {
+        spdlog::error("Message batch begin failed: {}", mysql_error(conn.get()));
+        return false;
+    }
+    // Stamps a stage on every traced message in the batch
+    auto mark = [&batch](TraceStage stage) {
+        int64_t now_us = 0;
+        for (const Pending* p : batch) {
+            if (!p->write.trace) continue;
+            if (now_us == 0) now_us = Trace::NowUs();
+            p->write.trace->Mark(stage, now_us);
+        }
+    };
+    auto rollback = [&conn] {
+        mysql_rollback(conn.get());
+        return false;
+    };
+
+    if (!bodies.empty()) {
+        if (!InsertRows(conn, "INSERT INTO im_message_body (msg_id, sender_id, group_id, msg_type, msg_content) VALUES ",
+                        5, bodies, [](DBStmt& stmt, const MessageWrite::Body& b) {
+                            stmt.Bind(b.msg_id).Bind(b.sender_id).Bind(b.group_id)
+                                .Bind(static_cast<int64_t>(b.type)).Bind(b.content);
+                        })) {
+            return rollback();
+        }
+        mark(TraceStage::kBodyWrite);
+    }
+    if (!indexes.empty()) {
+        if (!InsertRows(conn, "INSERT INTO im_message_index (owner_id, other_id, msg_id, seq_id, is_sender) VALUES ",
+                        5, indexes, [](DBStmt& stmt, const MessageWrite::Index& i) {
+                            stmt.Bind(i.owner_id).Bind(i.other_id).Bind(i.msg_id).Bind(i.seq_id)
+                                .Bind(static_cast<int64_t>(i.is_sender));
+                        })) {
+            return rollback();
+        }
+        mark(TraceStage::kIndexWrite);
+    }
+    if (!timelines.empty()) {
+        if (!InsertRows(conn, "INSERT INTO im_group_timeline (group_id, group_seq, msg_id) VALUES ",
+                        3, timelines, [](DBStmt& stmt, const MessageWrite::Timeline& t) {
+                            stmt.Bind(t.group_id).Bind(t.group_seq).Bind(t.msg_id);
+                        })) {
+            return rollback();
+        }
+        mark(TraceStage::kIndexWrite);
+    }
+
+    if (mysql_commit(conn.get())) {
+        spdlog::error("Message batch commit failed: {}", mysql_error(conn.get()));
+        return rollback();
+    }
+    mark(TraceStage::kCommit);
+    return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "trace.h"
+
+class DBConn;
+
+// Rows produced by one SendMessage
+struct MessageWrite {
+    struct Body {
+        int64_t msg_id;
+        int64_t sender_id;
+        int64_t group_id;
+        int type;
+        std::string content;
+    };
+    struct Index {
+        int64_t owner_id;
+        int64_t other_id;
+        int64_t msg_id;
+        int64_t seq_id;
+        int is_sender;
+    };
+    struct Timeline {
+        int64_t group_id;
+        int64_t group_seq;
+        int64_t msg_id;
+    };
+
+    std::vector<Body> bodies;
+    std::vector<Index> indexes;
+    std::vector<Timeline> timelines;
+    // Stamped body_write / index_write / commit by the flusher; the submitter
+    // keeps it alive until its future resolves
+    Trace* trace = nullptr;
+
+    size_t rows() const { return bodies.size() + indexes.size() + timelines.size(); }
+    // Rough size of the parameters sent for it: the contents plus a fixed cost per row
+    size_t bytes() const {
+        size_t n = rows() * 48;
+        for (const auto& b : bodies) n += b.content.size();
+        return n;
+    }
+};
+
+// Group commit for message writes.
+// Concurrent SendMessage calls hand their rows to Submit; flusher threads
+// collect everything queued within chat.write_batch_window_ms (or up to
+// chat.write_batch_max_rows rows / chat.write_batch_max_bytes, which keeps a
+// batch under max_allowed_packet) and write it as multi-row INSERTs in one
+// transaction, so N messages cost one commit (one fsync) instead of 2-3 each.
+// The INSERTs are prepared statements cached on the connection, one per
+// power-of-two row count: a batch of N rows runs about log2(N) of them.
+// The future resolves once the caller's rows are committed (true) or failed.
+// If a batch fails, its messages are retried one transaction each, so a bad
+// message only fails itself.
+class MessageWriter {
+public:
+    static MessageWriter& GetInstance();
+
+    std::future<bool> Submit(MessageWrite write);
+
+private:
+    MessageWriter();
+    ~MessageWriter();
+
+    struct Pending {
+        MessageWrite write;
+        std::promise<bool> done;
+    };
+
+    void FlushLoop();
+    // Writes all of batch in one transaction on conn
+    static bool Commit(DBConn& conn, const std::vector<Pending*>& batch);
+
+    int window_ms_;
+    size_t max_rows_;
+    size_t max_bytes_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<Pending> queue_;
+    size_t queued_rows_ = 0;
+    size_t queued_bytes_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> flushers_;
+};
@@ -0,0 +1,102 @@
+#include "push_dispatcher.h"
+#include <spdlog/spdlog.h>
+#include <chrono>
+#include "grpc_channel_pool.h"
+#include "redis_client.h"
+
+// State of one in-flight BatchPushNotify, kept alive by its completion callback
+struct BatchPushCall {
+    grpc::ClientContext ctx;
+    tinyim::gateway::BatchPushNotifyReq req;
+    tinyim::gateway::BatchPushNotifyResp resp;
+};
+
+PushDispatcher& PushDispatcher::GetInstance() {
+    static PushDispatcher instance;
+    return instance;
+}
+
+tinyim::gateway::GatewayService::Stub* PushDispatcher::GetStub(const std::string& addr) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto& stub = stubs_[addr];
+    if (!stub) {
+        stub = tinyim::gateway::GatewayService::NewStub(GRPCChannelPool::GetInstance().GetChannel(addr));
+    }
+    return stub.get();
+}
+
+void PushDispatcher::Push(const std::vector<PushTarget>& targets, tinyim::chat::MsgType type,
+                          std::shared_ptr<const tinyim::chat::MessageItem> inline_msg,
+                          const Trace* trace) {
+    // gateway addr -> batch
+    std::unordered_map<std::string, std::shared_ptr<BatchPushCall>> batches;
+
+    // im:location:<uid> -> {device: gateway addr}; empty when offline.
+    // One pipelined round trip for all targets.
+    std::vector<std::string> keys;
+    keys.reserve(targets.size());
+    for (const auto& target : targets) {
+        keys.push_back("im:location:" + std::to_string(target.user_id));
+    }
+    auto all_locations = RedisClient::GetInstance().HGetAllBatch(keys);
+
+    // Online receivers caught up to max_seq - 1 get the message inline
+    std::vector<bool> inlined(targets.size(), false);
+    if (inline_msg) {
+        std::vector<std::string> ack_keys;
+        std::vector<long long> expected, desired;
+        std::vector<size_t> which;
+        for (size_t t = 0; t < targets.size(); ++t) {
+            if (targets[t].max_seq <= 0 || t >= all_locations.size() || all_locations[t].empty()) continue;
+            ack_keys.push_back("im:ack:" + std::to_string(targets[t].user_id));
+            expected.push_back(targets[t].max_seq - 1);
+            desired.push_back(targets[t].max_seq);
+            which.push_back(t);
+        }
+        auto swapped = RedisClient::GetInstance().CompareAndSetBatch(ack_keys, expected, desired);
+        for (size_t i = 0; i < swapped.size(); ++i) inlined[which[i]] = swapped[i];
+    }
+
+    for (size_t t = 0; t < targets.size(); ++t) {
+        const auto& target = targets[t];
+        for (const auto& kv : all_locations[t]) {
+            auto& call = batches[kv.second];
+            if (!call) call = std::make_shared<BatchPushCall>();
+
+            // Several devices on the same gateway: one item, the gateway fans out to all of them
+            auto& items = *call->req.mutable_items();
+            if (!items.empty() && items[items.size() - 1].user_id() == target.user_id) continue;
+
+            auto* item = call->req.add_items();
+            item->set_user_id(target.user_id);
+            item->set_max_seq(target.max_seq);
+            item->set_msg_type(type);
+            item->set_group_id(target.group_id);
+            item->set_group_seq(target.group_seq);
+            if (inlined[t]) {
+                tinyim::chat::MessageItem msg = *inline_msg;
+                msg.set_seq_id(target.max_seq);
+                msg.SerializeToString(item->mutable_payload());
+            }
+        }
+    }
+
+    std::string trace_md;
+    if (trace && !batches.empty()) {
+        Trace issued = *trace;
+        issued.Mark(TraceStage::kPushIssued);
+        trace_md = issued.Encode();
+    }
+
+    for (auto& [addr, call] : batches) {
+        call->ctx.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(500));
+        if (!trace_md.empty()) call->ctx.AddMetadata(Trace::kMetadataKey, trace_md);
+        GetStub(addr)->async()->BatchPushNotify(&call->ctx, &call->req, &call->resp,
+            [call, addr = addr](grpc::Status status) {
+                if (!status.ok()) {
+                    spdlog::warn("BatchPushNotify to {} failed ({} items): {}",
+                                 addr, call->req.items_size(), status.error_message());
+                }
+            });
+    }
+}
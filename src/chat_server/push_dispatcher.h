@@ -0,0 +1,48 @@
+#pragma once
+
+#include <grpcpp/grpcpp.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "gateway.grpc.pb.h"
+#include "trace.h"
+
+// One push recipient: the user's new max seq in their inbox, or for
+// read-diffusion groups the group timeline position (max_seq is then 0)
+struct PushTarget {
+    int64_t user_id;
+    int64_t max_seq;
+    int64_t group_id = 0;
+    int64_t group_seq = 0;
+};
+
+// Delivers push notifies to the gateways holding the targets' sessions.
+// Targets are grouped by gateway address and each gateway gets a single
+// BatchPushNotify; the batches are issued in parallel with the async stub
+// and never awaited, so the sender's ack does not wait for delivery.
+//
+// With inline_msg set, inbox targets whose acked seq (im:ack:<uid>, last seq
+// handed out by SyncMessages or inlined) is exactly max_seq - 1 receive the
+// message itself in the notify and skip the sync round trip. Their ack moves to
+// max_seq in the same atomic step; the client still checks the seq for gaps.
+//
+// A message trace, if given, is stamped push_issued and sent along in every
+// batch's metadata.
+class PushDispatcher {
+public:
+    static PushDispatcher& GetInstance();
+
+    void Push(const std::vector<PushTarget>& targets, tinyim::chat::MsgType type,
+              std::shared_ptr<const tinyim::chat::MessageItem> inline_msg = nullptr,
+              const Trace* trace = nullptr);
+
+private:
+    PushDispatcher() = default;
+
+    tinyim::gateway::GatewayService::Stub* GetStub(const std::string& addr);
+
+    std::mutex mtx_;
+    std::unordered_map<std::string, std::unique_ptr<tinyim::gateway::GatewayService::Stub>> stubs_;
+};
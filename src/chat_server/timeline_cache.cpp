@@ -0,0 +1,89 @@
+#include "timeline_cache.h"
+#include "config.h"
+
+TimelineCache& TimelineCache::GetInstance() {
+    static TimelineCache instance;
+    return instance;
+}
+
+TimelineCache::TimelineCache() {
+    int entries = Config::GetInstance().GetInt("chat.timeline_cache_entries", 32);
+    int users = Config::GetInstance().GetInt("chat.timeline_cache_users", 100000);
+    max_entries_ = entries > 0 ? entries : 0;
+    max_users_per_shard_ = users > 0 ? (users + kShards - 1) / kShards : 1;
+}
+
+void TimelineCache::Append(int64_t user_id, int64_t seq, const Body& body) {
+    if (!enabled() || seq <= 0) return;
+
+    Shard& shard = ShardFor(user_id);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+
+    auto it = shard.users.find(user_id);
+    if (it == shard.users.end()) {
+        if (shard.users.size() >= max_users_per_shard_) {
+            shard.users.erase(shard.lru.back());
+            shard.lru.pop_back();
+        }
+        shard.lru.push_front(user_id);
+        it = shard.users.emplace(user_id, Ring{{}, shard.lru.begin()}).first;
+    } else {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+    }
+
+    auto& entries = it->second.entries;
+    if (!entries.empty()) {
+        int64_t last = entries.back().seq;
+        if (seq <= last) return;                  // Already cached (or older than the window)
+        if (seq != last + 1) entries.clear();     // Gap: restart the contiguous run here
+    }
+    entries.push_back({seq, body});
+    if (entries.size() > max_entries_) entries.pop_front();
+}
+
+void TimelineCache::Emit(const Entry& e, std::vector<tinyim::chat::MessageItem>& out) {
+    out.push_back(*e.body);
+    out.back().set_seq_id(e.seq);
+}
+
+bool TimelineCache::Since(int64_t user_id, int64_t local_seq, int64_t server_seq, int limit,
+                          std::vector<tinyim::chat::MessageItem>& out) {
+    if (!enabled()) return false;
+
+    Shard& shard = ShardFor(user_id);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.users.find(user_id);
+    if (it == shard.users.end()) return false;
+
+    const auto& entries = it->second.entries;
+    if (entries.empty() || entries.back().seq != server_seq) return false;
+    if (local_seq >= server_seq) return true; // Up to date: nothing to send
+    if (local_seq + 1 < entries.front().seq) return false;
+
+    // Contiguous: entry for seq s sits at index s - first
+    size_t begin = static_cast<size_t>(local_seq + 1 - entries.front().seq);
+    for (size_t i = begin; i < entries.size() && out.size() < static_cast<size_t>(limit); ++i) {
+        Emit(entries[i], out);
+    }
+    return true;
+}
+
+bool TimelineCache::Latest(int64_t user_id, int64_t server_seq, int limit,
+                           std::vector<tinyim::chat::MessageItem>& out) {
+    if (!enabled()) return false;
+
+    Shard& shard = ShardFor(user_id);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.users.find(user_id);
+    if (it == shard.users.end()) return false;
+
+    const auto& entries = it->second.entries;
+    if (entries.empty() || entries.back().seq != server_seq) return false;
+    // Seqs start at 1: a ring starting there holds the whole inbox
+    if (entries.size() < static_cast<size_t>(limit) && entries.front().seq != 1) return false;
+
+    for (auto rit = entries.rbegin(); rit != entries.rend() && out.size() < static_cast<size_t>(limit); ++rit) {
+        Emit(*rit, out);
+    }
+    return true;
+}
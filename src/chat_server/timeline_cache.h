@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "chat.pb.h"
+
+// Hot tail of each user's inbox, kept in the chat server so that the common
+// "give me what just arrived" sync is answered without touching MySQL.
+//
+// Per user it holds the last chat.timeline_cache_entries index entries with
+// their message bodies (bodies are shared between the members of a group).
+// SendMessage writes through after the index row is stored. An entry only
+// extends the ring when its seq is exactly last+1, so a ring is always a
+// contiguous run of seqs; a gap (seq allocated by another chat server, or a
+// failed insert) restarts the ring at the new entry.
+//
+// Since other chat servers write inboxes too, a ring is only trusted when its
+// last seq equals the authoritative im:seq:<uid> in Redis (checked by the
+// caller). At most chat.timeline_cache_users users are kept, LRU per shard.
+class TimelineCache {
+public:
+    using Body = std::shared_ptr<const tinyim::chat::MessageItem>;
+
+    static TimelineCache& GetInstance();
+
+    bool enabled() const { return max_entries_ > 0; }
+
+    // body's seq_id is ignored: the entry is stored under seq
+    void Append(int64_t user_id, int64_t seq, const Body& body);
+
+    // Forward sync: entries with seq > local_seq (at most limit, ascending).
+    // Returns false (miss) unless the ring ends at server_seq and covers local_seq+1.
+    bool Since(int64_t user_id, int64_t local_seq, int64_t server_seq, int limit,
+               std::vector<tinyim::chat::MessageItem>& out);
+
+    // Reverse sync: the latest limit entries (descending).
+    // Returns false unless the ring ends at server_seq and holds limit entries
+    // (or the user's whole inbox).
+    bool Latest(int64_t user_id, int64_t server_seq, int limit,
+                std::vector<tinyim::chat::MessageItem>& out);
+
+private:
+    TimelineCache();
+
+    struct Entry {
+        int64_t seq;
+        Body body;
+    };
+    struct Ring {
+        std::deque<Entry> entries;
+        std::list<int64_t>::iterator lru;
+    };
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<int64_t, Ring> users;
+        std::list<int64_t> lru; // front = most recently used
+    };
+
+    static constexpr size_t kShards = 16;
+
+    Shard& ShardFor(int64_t user_id) { return shards_[static_cast<uint64_t>(user_id) % kShards]; }
+    static void Emit(const Entry& e, std::vector<tinyim::chat::MessageItem>& out);
+
+    size_t max_entries_;
+    size_t max_users_per_shard_;
+    std::array<Shard, kShards> shards_;
+};
@@ -0,0 +1,227 @@
+#include "async_redis_client.h"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+#include <spdlog/spdlog.h>
+#include "metrics.h"
+
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+
+static Histogram& CommandLatency(const char* name) {
+    static HistogramFamily latency("tinyim_redis_command_seconds", "Redis command latency", "command");
+    return latency.With(name);
+}
+
+AsyncRedisConnection::AsyncRedisConnection(net::io_context& ioc, std::string host, int port)
+    : ioc_(ioc), socket_(ioc), resolver_(ioc), host_(std::move(host)), port_(port),
+      timer_(ioc), reader_(redisReaderCreate()) {}
+
+AsyncRedisConnection::~AsyncRedisConnection() {
+    redisReaderFree(reader_);
+}
+
+void AsyncRedisConnection::Send(const char* name, const std::vector<std::string>& argv, Callback cb) {
+    if (state_ == State::kDisconnected) {
+        if (std::chrono::steady_clock::now() < retry_at_) {
+            // Still backing off after a failure: fail fast, but not reentrantly
+            if (cb) net::post(ioc_, [cb = std::move(cb)]() { cb(nullptr); });
+            return;
+        }
+        Connect();
+    }
+
+    std::vector<const char*> args;
+    std::vector<size_t> lens;
+    args.reserve(argv.size());
+    lens.reserve(argv.size());
+    for (const auto& a : argv) {
+        args.push_back(a.data());
+        lens.push_back(a.size());
+    }
+    char* cmd = nullptr;
+    long long len = redisFormatCommandArgv(&cmd, static_cast<int>(args.size()), args.data(), lens.data());
+    if (len < 0) {
+        if (cb) net::post(ioc_, [cb = std::move(cb)]() { cb(nullptr); });
+        return;
+    }
+    out_.append(cmd, static_cast<size_t>(len));
+    redisFreeCommand(cmd);
+    pending_.push_back(Pending{std::move(cb), name, std::chrono::steady_clock::now()});
+
+    if (state_ == State::kConnected) {
+        ArmDeadline();
+        DoWrite();
+    }
+}
+
+void AsyncRedisConnection::Connect() {
+    state_ = State::kConnecting;
+    uint64_t gen = ++generation_;
+    connect_deadline_ = std::chrono::steady_clock::now() + kConnectTimeout;
+    ArmDeadline();
+    resolver_.async_resolve(host_, std::to_string(port_),
+        [self = shared_from_this(), gen](boost::system::error_code ec, tcp::resolver::results_type results) {
+            if (gen != self->generation_) return;
+            if (ec) return self->Fail("resolve: " + ec.message());
+            net::async_connect(self->socket_, results,
+                [self, gen](boost::system::error_code ec, const tcp::endpoint&) {
+                    if (gen != self->generation_) return;
+                    if (ec) return self->Fail("connect: " + ec.message());
+                    self->state_ = State::kConnected;
+                    self->socket_.set_option(tcp::no_delay(true), ec);
+                    self->ArmDeadline(); // Commands queued while connecting
+                    self->DoRead();
+                    self->DoWrite(); // Commands queued while connecting
+                });
+        });
+}
+
+void AsyncRedisConnection::DoWrite() {
+    if (is_writing_ || out_.empty()) return;
+    is_writing_ = true;
+    writing_.clear();
+    writing_.swap(out_);
+    net::async_write(socket_, net::buffer(writing_),
+        [self = shared_from_this(), gen = generation_](boost::system::error_code ec, std::size_t) {
+            if (gen != self->generation_) return;
+            self->is_writing_ = false;
+            self->writing_.clear();
+            if (ec) return self->Fail("write: " + ec.message());
+            self->DoWrite();
+        });
+}
+
+void AsyncRedisConnection::DoRead() {
+    socket_.async_read_some(net::buffer(read_buf_),
+        [self = shared_from_this(), gen = generation_](boost::system::error_code ec, std::size_t n) {
+            if (gen != self->generation_) return;
+            if (ec) return self->Fail("read: " + ec.message());
+            if (redisReaderFeed(self->reader_, self->read_buf_.data(), n) != REDIS_OK) {
+                return self->Fail("feed failed");
+            }
+            while (true) {
+                void* r = nullptr;
+                if (redisReaderGetReply(self->reader_, &r) != REDIS_OK) {
+                    return self->Fail(std::string("protocol error: ") + self->reader_->errstr);
+                }
+                if (!r) break; // Need more data
+                RedisReplyPtr reply(static_cast<redisReply*>(r));
+                if (self->pending_.empty()) {
+                    return self->Fail("unexpected reply");
+                }
+                Pending p = std::move(self->pending_.front());
+                self->pending_.pop_front();
+                CommandLatency(p.name).Record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - p.sent).count());
+                if (p.cb) p.cb(std::move(reply));
+                if (gen != self->generation_) return; // The callback tore the connection down
+            }
+            self->DoRead();
+        });
+}
+
+void AsyncRedisConnection::Fail(const std::string& why) {
+    if (state_ == State::kDisconnected) return;
+    spdlog::error("Async Redis {}:{} {}, {} commands failed", host_, port_, why, pending_.size());
+
+    state_ = State::kDisconnected;
+    ++generation_; // Aborted handlers of this connection must not touch the next one
+    is_writing_ = false;
+    retry_at_ = std::chrono::steady_clock::now() + kReconnectDelay;
+    boost::system::error_code ec;
+    socket_.close(ec);
+    resolver_.cancel();
+    out_.clear();
+    redisReaderFree(reader_);
+    reader_ = redisReaderCreate();
+
+    // Callbacks may queue new commands: detach the failed ones first
+    std::deque<Pending> failed;
+    failed.swap(pending_);
+    for (auto& p : failed) {
+        if (p.cb) p.cb(nullptr);
+    }
+}
+
+void AsyncRedisConnection::ArmDeadline() {
+    std::chrono::steady_clock::time_point deadline;
+    if (state_ == State::kConnecting) deadline = connect_deadline_;
+    else if (state_ == State::kConnected && !pending_.empty()) deadline = pending_.front().sent + kCommandTimeout;
+    else return;
+    // One wait at a time, re-armed only to move it earlier
+    if (timer_armed_ && timer_.expiry() <= deadline) return;
+
+    timer_armed_ = true;
+    timer_.expires_at(deadline); // Aborts the later wait, if any
+    timer_.async_wait([self = shared_from_this()](boost::system::error_code ec) {
+        if (ec == net::error::operation_aborted) return; // Replaced by an earlier one
+        self->timer_armed_ = false;
+        self->CheckDeadline();
+    });
+}
+
+void AsyncRedisConnection::CheckDeadline() {
+    auto now = std::chrono::steady_clock::now();
+    if (state_ == State::kConnecting && now >= connect_deadline_) {
+        return Fail("connect timed out");
+    }
+    if (state_ == State::kConnected && !pending_.empty() && now >= pending_.front().sent + kCommandTimeout) {
+        return Fail("command timed out");
+    }
+    ArmDeadline(); // Next connect or oldest command, if any
+}
+
+AsyncRedisClient::AsyncRedisClient(net::io_context& ioc, const std::vector<std::string>& nodes)
+    : ioc_(ioc), nodes_(nodes), ring_(nodes), conns_(nodes.size()) {}
+
+AsyncRedisConnection& AsyncRedisClient::NodeOf(const std::string& key) {
+    size_t shard = ring_.NodeOf(key);
+    auto& conn = conns_[shard];
+    if (!conn) {
+        auto [host, port] = ParseRedisNode(nodes_[shard]);
+        conn = std::make_shared<AsyncRedisConnection>(ioc_, host, port);
+    }
+    return *conn;
+}
+
+void AsyncRedisClient::Command(const std::vector<std::string>& argv, Callback cb) {
+    if (argv.empty() || nodes_.empty()) return;
+    NodeOf(argv.size() > 1 ? argv[1] : std::string()).Send("ASYNC", argv, std::move(cb));
+}
+
+void AsyncRedisClient::HSet(const std::string& key, const std::string& field, const std::string& value,
+                            std::function<void(bool)> cb) {
+    if (nodes_.empty()) return;
+    NodeOf(key).Send("HSET", {"HSET", key, field, value}, [cb = std::move(cb)](RedisReplyPtr reply) {
+        if (cb) cb(reply && reply->type != REDIS_REPLY_ERROR);
+    });
+}
+
+void AsyncRedisClient::HDel(const std::string& key, const std::string& field, std::function<void(bool)> cb) {
+    if (nodes_.empty()) return;
+    NodeOf(key).Send("HDEL", {"HDEL", key, field}, [cb = std::move(cb)](RedisReplyPtr reply) {
+        if (cb) cb(reply && reply->type != REDIS_REPLY_ERROR);
+    });
+}
+
+void AsyncRedisClient::HDelIfEquals(const std::string& key, const std::string& field, const std::string& value,
+                                    std::function<void(bool)> cb) {
+    static const std::string script =
+        "if redis.call('HGET', KEYS[1], ARGV[1]) == ARGV[2] then "
+        "return redis.call('HDEL', KEYS[1], ARGV[1]) end return 0";
+    if (nodes_.empty()) return;
+    NodeOf(key).Send("HDEL", {"EVAL", script, "1", key, field, value}, [cb = std::move(cb)](RedisReplyPtr reply) {
+        if (cb) cb(reply && reply->type == REDIS_REPLY_INTEGER && reply->integer == 1);
+    });
+}
+
+void AsyncRedisClient::HGet(const std::string& key, const std::string& field,
+                            std::function<void(std::optional<std::string>)> cb) {
+    if (nodes_.empty()) return cb(std::nullopt);
+    NodeOf(key).Send("HGET", {"HGET", key, field}, [cb = std::move(cb)](RedisReplyPtr reply) {
+        if (!reply || reply->type == REDIS_REPLY_ERROR) return cb(std::nullopt);
+        if (reply->type == REDIS_REPLY_STRING) return cb(std::string(reply->str, reply->len));
+        cb(std::string());
+    });
+}
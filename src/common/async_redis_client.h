@@ -0,0 +1,122 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "redis_client.h"
+
+// Non-blocking connection to one Redis node, for one Asio event loop.
+//
+// Every command is appended to its output buffer and all commands queued while
+// a write is in flight go out in the next write, so a burst of N commands costs
+// one syscall and one round trip instead of N blocking ones. Replies are parsed
+// with hiredis' redisReader and matched to callbacks in order (Redis answers a
+// connection in order).
+//
+// Not thread-safe: call it, and get called back, on the io_context's thread.
+// Callbacks receive nullptr if the connection failed; a failed connection is
+// reopened by the next command, at most once per kReconnectDelay. Like the
+// blocking client, a connection that takes over kConnectTimeout to open, or
+// leaves a command unanswered for kCommandTimeout, is failed.
+class AsyncRedisConnection : public std::enable_shared_from_this<AsyncRedisConnection> {
+public:
+    using Callback = std::function<void(RedisReplyPtr)>;
+
+    static constexpr std::chrono::seconds kReconnectDelay{1};
+    static constexpr std::chrono::milliseconds kConnectTimeout{RedisClient::kConnectTimeoutMs};
+    static constexpr std::chrono::milliseconds kCommandTimeout{RedisClient::kCommandTimeoutMs};
+
+    AsyncRedisConnection(boost::asio::io_context& ioc, std::string host, int port);
+    ~AsyncRedisConnection();
+
+    AsyncRedisConnection(const AsyncRedisConnection&) = delete;
+    AsyncRedisConnection& operator=(const AsyncRedisConnection&) = delete;
+
+    // Binary-safe arguments; name labels the latency histogram (a literal)
+    void Send(const char* name, const std::vector<std::string>& argv, Callback cb);
+
+private:
+    enum class State { kDisconnected, kConnecting, kConnected };
+
+    struct Pending {
+        Callback cb;
+        const char* name; // Command label for the latency histogram
+        std::chrono::steady_clock::time_point sent;
+    };
+
+    void Connect();
+    void DoWrite();
+    void DoRead();
+    // Drops the connection and fails every outstanding command
+    void Fail(const std::string& why);
+    // Keeps the timer set for the connect in progress or the oldest pending command
+    void ArmDeadline();
+    void CheckDeadline();
+
+    boost::asio::io_context& ioc_;
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::ip::tcp::resolver resolver_;
+    std::string host_;
+    int port_;
+
+    State state_ = State::kDisconnected;
+    uint64_t generation_ = 0; // Bumped per connection: handlers of a dropped one are ignored
+    std::chrono::steady_clock::time_point retry_at_{};
+    std::chrono::steady_clock::time_point connect_deadline_{};
+    boost::asio::steady_timer timer_;
+    bool timer_armed_ = false;
+
+    std::string out_;     // Encoded commands not yet written
+    std::string writing_; // Commands of the write in flight
+    bool is_writing_ = false;
+    std::deque<Pending> pending_; // Awaiting replies, in send order
+
+    redisReader* reader_;
+    std::array<char, 16 * 1024> read_buf_;
+};
+
+// Non-blocking Redis client for one Asio event loop: one AsyncRedisConnection
+// per node of RedisClient's ring, opened on first use. Commands go to the node
+// that owns their key, exactly as with the blocking RedisClient.
+//
+// Not thread-safe: call it, and get called back, on the io_context's thread.
+//
+// Usage:
+//   redis.HSet("im:location:42", "PC", addr);
+//   redis.HGet(key, device, [self](std::optional<std::string> token) { ... });
+class AsyncRedisClient {
+public:
+    using Callback = AsyncRedisConnection::Callback;
+
+    // nodes are "host:port", in the same order RedisClient was given them
+    AsyncRedisClient(boost::asio::io_context& ioc, const std::vector<std::string>& nodes);
+
+    // Arbitrary command, sent to the node of argv[1]
+    void Command(const std::vector<std::string>& argv, Callback cb = {});
+
+    void HSet(const std::string& key, const std::string& field, const std::string& value,
+              std::function<void(bool)> cb = {});
+    void HDel(const std::string& key, const std::string& field, std::function<void(bool)> cb = {});
+    // HDEL only while the field still holds value (one atomic script); cb gets whether it did
+    void HDelIfEquals(const std::string& key, const std::string& field, const std::string& value,
+                      std::function<void(bool)> cb = {});
+    // Empty string if the field is missing, nullopt on error
+    void HGet(const std::string& key, const std::string& field,
+              std::function<void(std::optional<std::string>)> cb);
+
+private:
+    AsyncRedisConnection& NodeOf(const std::string& key);
+
+    boost::asio::io_context& ioc_;
+    std::vector<std::string> nodes_;
+    RedisRing ring_;
+    std::vector<std::shared_ptr<AsyncRedisConnection>> conns_; // By node, created lazily
+};
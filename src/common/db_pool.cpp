@@ -1,6 +1,63 @@
 #include "db_pool.h"
+#include <mysql/errmsg.h>
 #include <spdlog/spdlog.h>
 #include <random>
+#include "metrics.h"
+
+static const char* RoleName(DBPool::Role role) {
+    return role == DBPool::MASTER ? "master" : "slave";
+}
+
+// Time to check a connection out of a pool, including lazy connects
+static Histogram& PoolWait(DBPool::Role role) {
+    static HistogramFamily wait("tinyim_db_pool_wait_seconds", "Time to check out a DBPool connection", "pool");
+    return wait.With(RoleName(role));
+}
+
+DBStmt* DBConnection::Prepare(const std::string& sql) {
+    auto it = stmts.find(sql);
+    if (it != stmts.end()) {
+        if (!it->second->broken()) return it->second.get();
+        stmts.erase(it); // Re-prepare below
+    }
+
+    MYSQL_STMT* stmt = mysql_stmt_init(mysql);
+    if (!stmt) {
+        spdlog::error("mysql_stmt_init failed: {}", mysql_error(mysql));
+        return nullptr;
+    }
+    if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size())) {
+        spdlog::error("Prepare failed: {} ({})", mysql_stmt_error(stmt), sql);
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+    auto& slot = stmts[sql];
+    slot = std::make_unique<DBStmt>(stmt);
+    return slot.get();
+}
+
+DBConnection::~DBConnection() {
+    stmts.clear(); // ~DBStmt closes the statements while the connection is still open
+    if (mysql) mysql_close(mysql);
+}
+
+// This thread's slots, one per role. When the thread exits its parked
+// connections go back to the shared idle list and the slots to other threads.
+struct DBThreadSlots {
+    DBPool::Slot* slots[2] = {nullptr, nullptr};
+
+    ~DBThreadSlots() {
+        if (!slots[0] && !slots[1]) return;
+        DBPool& pool = DBPool::GetInstance();
+        for (int r = 0; r < 2; ++r) {
+            if (!slots[r]) continue;
+            if (DBConnection* conn = slots[r]->conn.exchange(nullptr)) pool.PushIdle(pool.pools_[r], conn);
+            slots[r]->owned.store(false);
+        }
+    }
+};
+
+static thread_local DBThreadSlots tls_slots;
 
 DBPool& DBPool::GetInstance() {
     static DBPool instance;
@@ -8,38 +65,34 @@ DBPool& DBPool::GetInstance() {
 }
 
 DBPool::~DBPool() {
-    // Cleanup Master
     {
-        std::lock_guard<std::mutex> lock(master_mtx_);
-        while (!master_queue_.empty()) {
-            MYSQL* conn = master_queue_.front();
-            master_queue_.pop();
-            mysql_close(conn);
-        }
+        std::lock_guard<std::mutex> lock(stop_mtx_);
+        stop_ = true;
     }
-    // Cleanup Slave
-    {
-        std::lock_guard<std::mutex> lock(slave_mtx_);
-        while (!slave_queue_.empty()) {
-            MYSQL* conn = slave_queue_.front();
-            slave_queue_.pop();
-            mysql_close(conn);
-        }
+    stop_cv_.notify_all();
+    if (health_thread_.joinable()) health_thread_.join();
+
+    for (Pool& p : pools_) {
+        std::lock_guard<std::mutex> lock(p.mtx);
+        for (DBConnection* conn : p.idle) delete conn;
+        p.idle.clear();
+        std::lock_guard<std::mutex> slots_lock(p.slots_mtx);
+        for (auto& slot : p.slots) delete slot->conn.exchange(nullptr);
     }
 }
 
 // Single Host Init (Treat as Master only)
-void DBPool::Init(const std::string& host, int port, const std::string& user, 
+void DBPool::Init(const std::string& host, int port, const std::string& user,
                   const std::string& password, const std::string& dbname, int max_conns) {
     Init(host, {}, port, user, password, dbname, max_conns);
 }
 
 // Master-Slave Init
-void DBPool::Init(const std::string& master_host, const std::vector<std::string>& slave_hosts, 
-                  int port, const std::string& user, const std::string& password, 
+void DBPool::Init(const std::string& master_host, const std::vector<std::string>& slave_hosts,
+                  int port, const std::string& user, const std::string& password,
                   const std::string& dbname, int max_conns) {
-    master_host_ = master_host;
-    slave_hosts_ = slave_hosts;
+    pools_[MASTER].hosts = {master_host};
+    pools_[SLAVE].hosts = slave_hosts; // No slaves: reads go to the master
     port_ = port;
     user_ = user;
     password_ = password;
@@ -48,29 +101,23 @@ void DBPool::Init(const std::string& master_host, const std::vector<std::string>
 
     // Pre-create Master Connections (Min 2)
     for (int i = 0; i < 2; ++i) {
-        MYSQL* conn = CreateConnection(master_host_);
-        if (conn) {
-            master_queue_.push(conn);
-            master_active_count_++;
-        }
+        if (DBConnection* conn = TryOpen(pools_[MASTER], MASTER)) PushIdle(pools_[MASTER], conn);
+    }
+    // One connection per slave host
+    for (const auto& host : slave_hosts) {
+        if (DBConnection* conn = TryOpen(pools_[SLAVE], SLAVE, host)) PushIdle(pools_[SLAVE], conn);
     }
 
-    // Pre-create Slave Connections (If any slaves exist)
-    if (!slave_hosts_.empty()) {
-        // Create at least one connection per slave host, up to min 2 total
-        for (const auto& host : slave_hosts_) {
-            MYSQL* conn = CreateConnection(host);
-            if (conn) {
-                slave_queue_.push(conn);
-                slave_active_count_++;
-            }
-        }
-    } else {
-        // No slaves? Just use Master for reads too?
-        // Our GetReadConnection will gracefully fallback to master if slave_hosts is empty.
+    for (Role role : {MASTER, SLAVE}) {
+        Metrics::GetInstance().AddGaugeCallback("tinyim_db_pool_connections", "Open DBPool connections",
+            {{"pool", RoleName(role)}}, [this, role]() { return static_cast<double>(pools_[role].total.load()); });
     }
-    
-    spdlog::info("DBPool Initialized. Master: {}, Slaves: {}", master_host_, slave_hosts_.size());
+
+    if (!health_thread_.joinable()) {
+        health_thread_ = std::thread(&DBPool::HealthCheckLoop, this);
+    }
+
+    spdlog::info("DBPool Initialized. Master: {}, Slaves: {}", master_host, slave_hosts.size());
 }
 
 MYSQL* DBPool::CreateConnection(const std::string& host) {
@@ -79,7 +126,7 @@ MYSQL* DBPool::CreateConnection(const std::string& host) {
         spdlog::error("MySQL init failed");
         return nullptr;
     }
-    
+
     // Set timeout options
     int timeout = 3;
     mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
@@ -92,111 +139,206 @@ MYSQL* DBPool::CreateConnection(const std::string& host) {
     return conn;
 }
 
-std::shared_ptr<MYSQL> DBPool::GetWriteConnection() {
-    std::unique_lock<std::mutex> lock(master_mtx_);
-    
-    // Lazy create
-    if (master_queue_.empty() && master_active_count_ < max_conns_) {
-        MYSQL* conn = CreateConnection(master_host_);
-        if (conn) {
-            master_active_count_++;
-            // Return directly
-            return std::shared_ptr<MYSQL>(conn, [this](MYSQL* c) { ReleaseMasterConnection(c); });
-        }
+DBConnection* DBPool::Acquire(Role role) {
+    if (role == SLAVE && pools_[SLAVE].hosts.empty()) role = MASTER;
+    DBConnection* conn = Checkout(role);
+    if (!conn && role == SLAVE) {
+        spdlog::error("DBPool Slave Timeout (Fallbacking to Master)");
+        conn = Checkout(MASTER);
     }
+    return conn;
+}
+
+DBConnection* DBPool::Checkout(Role role) {
+    ScopedLatency timer(PoolWait(role));
+    Pool& p = pools_[role];
+
+    // Fast path: the connection this thread released last
+    if (DBConnection* conn = MySlot(role)->conn.exchange(nullptr)) return conn;
 
-    // Wait
-    if(master_queue_.empty()) {
-         if (master_cv_.wait_for(lock, std::chrono::seconds(3), [this] { return !master_queue_.empty(); }) == false) {
-             spdlog::error("DBPool Master Timeout");
-             return nullptr;
-         }
+    {
+        std::lock_guard<std::mutex> lock(p.mtx);
+        if (!p.idle.empty()) {
+            DBConnection* conn = p.idle.front();
+            p.idle.pop_front();
+            return conn;
+        }
     }
+    if (DBConnection* conn = Steal(p)) return conn;
+    if (DBConnection* conn = TryOpen(p, role)) return conn;
+    return Wait(p, role);
+}
 
-    MYSQL* conn = master_queue_.front();
-    master_queue_.pop();
+DBConnection* DBPool::Wait(Pool& p, Role role) {
+    auto deadline = std::chrono::steady_clock::now() + kCheckoutTimeout;
+    std::unique_lock<std::mutex> lock(p.mtx);
+    // Seen by Release, which then hands connections over through the idle list
+    // instead of parking them
+    p.waiters.fetch_add(1);
 
-    // Ping check
-    if (mysql_ping(conn) != 0) {
-        spdlog::warn("MySQL Master lost, reconnecting...");
-        mysql_close(conn);
-        conn = CreateConnection(master_host_);
-        if (!conn) {
-             master_active_count_--; // Decrement since we failed to replace
-             return nullptr;
+    DBConnection* conn = nullptr;
+    while (true) {
+        if (!p.idle.empty()) {
+            conn = p.idle.front();
+            p.idle.pop_front();
+            break;
+        }
+        // Parked before Release could see us waiting
+        if ((conn = Steal(p))) break;
+        // A broken connection was dropped: open its replacement outside the lock
+        if (p.total.load() < max_conns_) {
+            lock.unlock();
+            conn = TryOpen(p, role);
+            lock.lock();
+            if (conn) break;
+        }
+        if (p.cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+            if (!p.idle.empty()) {
+                conn = p.idle.front();
+                p.idle.pop_front();
+            }
+            break;
         }
     }
 
-    return std::shared_ptr<MYSQL>(conn, [this](MYSQL* c) { ReleaseMasterConnection(c); });
+    p.waiters.fetch_sub(1);
+    if (!conn) spdlog::error("DBPool {} Timeout", RoleName(role));
+    return conn;
 }
 
-std::shared_ptr<MYSQL> DBPool::GetReadConnection() {
-    if (slave_hosts_.empty()) {
-        return GetWriteConnection(); // Fallback to Master
+DBConnection* DBPool::Steal(Pool& p) {
+    std::lock_guard<std::mutex> lock(p.slots_mtx);
+    for (auto& slot : p.slots) {
+        if (DBConnection* conn = slot->conn.exchange(nullptr)) return conn;
     }
+    return nullptr;
+}
 
-    std::unique_lock<std::mutex> lock(slave_mtx_);
+DBConnection* DBPool::TryOpen(Pool& p, Role role) {
+    if (p.hosts.size() == 1) return TryOpen(p, role, p.hosts[0]);
+    thread_local std::mt19937 gen(std::random_device{}());
+    std::uniform_int_distribution<size_t> dis(0, p.hosts.size() - 1);
+    return TryOpen(p, role, p.hosts[dis(gen)]);
+}
 
-    // Lazy create
-    if (slave_queue_.empty() && slave_active_count_ < max_conns_) {
-        // Pick random slave host
-        static std::random_device rd;
-        static std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, slave_hosts_.size() - 1);
-        std::string host = slave_hosts_[dis(gen)];
+DBConnection* DBPool::TryOpen(Pool& p, Role role, const std::string& host) {
+    // Reserve the place first so concurrent openers cannot overshoot max_conns_
+    int n = p.total.load();
+    do {
+        if (n >= max_conns_) return nullptr;
+    } while (!p.total.compare_exchange_weak(n, n + 1));
 
-        MYSQL* conn = CreateConnection(host);
-        if (conn) {
-            slave_active_count_++;
-            return std::shared_ptr<MYSQL>(conn, [this](MYSQL* c) { ReleaseSlaveConnection(c); });
-        }
+    MYSQL* mysql = CreateConnection(host);
+    if (!mysql) {
+        p.total.fetch_sub(1);
+        return nullptr;
     }
+    auto* conn = new DBConnection();
+    conn->mysql = mysql;
+    conn->pool = role;
+    return conn;
+}
 
-    // Wait
-    if(slave_queue_.empty()) {
-         if (slave_cv_.wait_for(lock, std::chrono::seconds(3), [this] { return !slave_queue_.empty(); }) == false) {
-             spdlog::error("DBPool Slave Timeout (Fallbacking to Master)");
-             return GetWriteConnection(); // Fallback
-         }
+void DBPool::Release(DBConnection* conn) {
+    if (!conn) return;
+    Pool& p = pools_[conn->pool];
+
+    unsigned int err = mysql_errno(conn->mysql);
+    if (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST) {
+        spdlog::warn("MySQL {} connection lost, dropping it", RoleName(static_cast<Role>(conn->pool)));
+        Drop(p, conn);
+        return;
     }
 
-    MYSQL* conn = slave_queue_.front();
-    slave_queue_.pop();
+    // Park it for this thread's next checkout
+    Slot* slot = MySlot(static_cast<Role>(conn->pool));
+    DBConnection* expected = nullptr;
+    if (slot->conn.compare_exchange_strong(expected, conn)) {
+        if (p.waiters.load() == 0) return;
+        // Someone is blocked in Wait: hand it over, unless it was stolen already
+        conn = slot->conn.exchange(nullptr);
+        if (!conn) return;
+    }
+    PushIdle(p, conn);
+}
 
-    // Ping check
-    if (mysql_ping(conn) != 0) {
-        spdlog::warn("MySQL Slave lost, reconnecting...");
-        mysql_close(conn);
-        // Reconnect to a random slave
-        static std::random_device rd;
-        static std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, slave_hosts_.size() - 1);
-        std::string host = slave_hosts_[dis(gen)];
-        
-        conn = CreateConnection(host);
-        if (!conn) {
-             slave_active_count_--;
-             return nullptr;
-        }
+void DBPool::PushIdle(Pool& p, DBConnection* conn) {
+    {
+        std::lock_guard<std::mutex> lock(p.mtx);
+        p.idle.push_back(conn);
     }
+    p.cv.notify_one();
+}
 
-    return std::shared_ptr<MYSQL>(conn, [this](MYSQL* c) { ReleaseSlaveConnection(c); });
+void DBPool::Drop(Pool& p, DBConnection* conn) {
+    delete conn;
+    p.total.fetch_sub(1);
+    // A waiter may now open the replacement
+    std::lock_guard<std::mutex> lock(p.mtx);
+    p.cv.notify_one();
 }
 
-std::shared_ptr<MYSQL> DBPool::GetConnection() {
-    return GetWriteConnection();
+DBPool::Slot* DBPool::MySlot(Role role) {
+    Slot*& mine = tls_slots.slots[role];
+    if (mine) return mine;
+
+    Pool& p = pools_[role];
+    std::lock_guard<std::mutex> lock(p.slots_mtx);
+    for (auto& slot : p.slots) {
+        bool owned = false;
+        if (slot->owned.compare_exchange_strong(owned, true)) return mine = slot.get();
+    }
+    p.slots.push_back(std::make_unique<Slot>());
+    p.slots.back()->owned.store(true);
+    return mine = p.slots.back().get();
 }
 
-void DBPool::ReleaseMasterConnection(MYSQL* conn) {
-    if (!conn) return;
-    std::lock_guard<std::mutex> lock(master_mtx_);
-    master_queue_.push(conn);
-    master_cv_.notify_one();
+void DBPool::HealthCheckLoop() {
+    std::unique_lock<std::mutex> lock(stop_mtx_);
+    while (!stop_cv_.wait_for(lock, kHealthCheckInterval, [this] { return stop_; })) {
+        lock.unlock();
+        for (Role role : {MASTER, SLAVE}) {
+            Pool& p = pools_[role];
+
+            // Idle connections one at a time, so the others stay available
+            size_t n;
+            {
+                std::lock_guard<std::mutex> idle_lock(p.mtx);
+                n = p.idle.size();
+            }
+            for (size_t i = 0; i < n; ++i) {
+                DBConnection* conn;
+                {
+                    std::lock_guard<std::mutex> idle_lock(p.mtx);
+                    if (p.idle.empty()) break;
+                    conn = p.idle.front();
+                    p.idle.pop_front();
+                }
+                Check(p, role, conn);
+            }
+
+            // Parked ones come back through the idle list
+            size_t slots;
+            {
+                std::lock_guard<std::mutex> slots_lock(p.slots_mtx);
+                slots = p.slots.size();
+            }
+            for (size_t i = 0; i < slots; ++i) {
+                DBConnection* conn = Steal(p);
+                if (!conn) break;
+                Check(p, role, conn);
+            }
+        }
+        lock.lock();
+    }
 }
 
-void DBPool::ReleaseSlaveConnection(MYSQL* conn) {
-    if (!conn) return;
-    std::lock_guard<std::mutex> lock(slave_mtx_);
-    slave_queue_.push(conn);
-    slave_cv_.notify_one();
+void DBPool::Check(Pool& p, Role role, DBConnection* conn) {
+    if (mysql_ping(conn->mysql) == 0) {
+        PushIdle(p, conn);
+        return;
+    }
+    spdlog::warn("MySQL {} lost, reconnecting...", RoleName(role));
+    Drop(p, conn);
+    if (DBConnection* fresh = TryOpen(p, role)) PushIdle(p, fresh);
 }
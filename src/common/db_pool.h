@@ -3,27 +3,60 @@
 #include <mysql/mysql.h>
 #include <string>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <memory>
+#include <unordered_map>
 #include <spdlog/spdlog.h>
+#include "db_stmt.h"
 
+// One pooled MySQL connection and the statements prepared on it.
+// Only the thread holding it (through DBConn) touches either, so the
+// statement cache needs no lock.
+struct DBConnection {
+    MYSQL* mysql = nullptr;
+    int pool = 0; // DBPool::Role it belongs to
+    std::unordered_map<std::string, std::unique_ptr<DBStmt>> stmts;
+
+    // Cached prepared statement (see DBStmt); nullptr if it cannot be prepared
+    DBStmt* Prepare(const std::string& sql);
+
+    ~DBConnection(); // Closes the statements, then the connection
+};
+
+// Connection pool with one master and any number of slaves.
+//
+// Checkout is lock-free in the common case: every thread parks the connection
+// it releases in its own slot and takes it back on the next checkout (one
+// atomic exchange). Only when its slot is empty does a thread go to the shared
+// idle list, steal a connection parked by another thread, open a new one
+// (outside any lock) or wait. Liveness is checked by a background thread that
+// pings idle connections, not on every checkout.
 class DBPool {
 public:
+    enum Role { MASTER = 0, SLAVE = 1 };
+
     static DBPool& GetInstance();
 
-    void Init(const std::string& master_host, const std::vector<std::string>& slave_hosts, 
-              int port, const std::string& user, const std::string& password, 
+    void Init(const std::string& master_host, const std::vector<std::string>& slave_hosts,
+              int port, const std::string& user, const std::string& password,
               const std::string& dbname, int max_conns = 10);
 
     // Legacy Init for single DB (compatible)
-    void Init(const std::string& host, int port, const std::string& user, 
+    void Init(const std::string& host, int port, const std::string& user,
               const std::string& password, const std::string& dbname, int max_conns = 10);
-    
-    std::shared_ptr<MYSQL> GetWriteConnection();
-    std::shared_ptr<MYSQL> GetReadConnection();
-    std::shared_ptr<MYSQL> GetConnection(); // Defaults to Write (Master)
+
+    // nullptr if no connection frees up within kCheckoutTimeout. Reads go to the
+    // master when there are no slaves or none is available. Hand back with Release.
+    DBConnection* Acquire(Role role);
+    void Release(DBConnection* conn);
+
+    static constexpr std::chrono::seconds kCheckoutTimeout{3};
+    static constexpr std::chrono::seconds kHealthCheckInterval{30};
 
 private:
     DBPool() = default;
@@ -31,53 +64,81 @@ private:
     DBPool(const DBPool&) = delete;
     DBPool& operator=(const DBPool&) = delete;
 
-    // Helper to release correctly
-    void ReleaseMasterConnection(MYSQL* conn);
-    void ReleaseSlaveConnection(MYSQL* conn);
-    
-    MYSQL* CreateConnection(const std::string& host);
+    // A connection parked by one thread; other threads may steal it
+    struct alignas(64) Slot {
+        std::atomic<DBConnection*> conn{nullptr};
+        std::atomic<bool> owned{false}; // Claimed by a live thread
+    };
+
+    struct Pool {
+        std::vector<std::string> hosts;
+        std::atomic<int> total{0};   // Open connections: idle, parked or checked out
+        std::atomic<int> waiters{0}; // Threads blocked in Wait
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<DBConnection*> idle; // Guarded by mtx
+
+        std::mutex slots_mtx;
+        std::vector<std::unique_ptr<Slot>> slots; // Guarded by slots_mtx; never shrinks
+    };
 
-    // Master Pool
-    std::queue<MYSQL*> master_queue_;
-    std::mutex master_mtx_;
-    std::condition_variable master_cv_;
-    int master_active_count_ = 0;
+    DBConnection* Checkout(Role role);
+    // Blocks until a connection is released or can be opened; nullptr on timeout
+    DBConnection* Wait(Pool& p, Role role);
+    DBConnection* Steal(Pool& p);
+    // Opens a connection (to a random host of the pool) if it is below max_conns_
+    DBConnection* TryOpen(Pool& p, Role role);
+    DBConnection* TryOpen(Pool& p, Role role, const std::string& host);
+    void PushIdle(Pool& p, DBConnection* conn);
+    void Drop(Pool& p, DBConnection* conn);
 
-    // Slave Pool
-    std::queue<MYSQL*> slave_queue_;
-    std::mutex slave_mtx_;
-    std::condition_variable slave_cv_;
-    int slave_active_count_ = 0;
+    // This thread's slot in role's pool, claimed on first use
+    Slot* MySlot(Role role);
+    friend struct DBThreadSlots;
+
+    MYSQL* CreateConnection(const std::string& host);
+    void HealthCheckLoop();
+    // Pings one idle connection, replacing it if the server is gone
+    void Check(Pool& p, Role role, DBConnection* conn);
+
+    Pool pools_[2];
 
     // Config
-    std::string master_host_;
-    std::vector<std::string> slave_hosts_;
     int port_;
     std::string user_;
     std::string password_;
     std::string dbname_;
     int max_conns_;
+
+    std::thread health_thread_;
+    std::mutex stop_mtx_;
+    std::condition_variable stop_cv_;
+    bool stop_ = false;
 };
 
-// RAII Helper
+// RAII checkout; moves only, no allocation
 class DBConn {
 public:
     enum Type { READ, WRITE };
-    
-    DBConn(Type type = WRITE) { 
-        if (type == READ) conn_ = DBPool::GetInstance().GetReadConnection();
-        else conn_ = DBPool::GetInstance().GetWriteConnection();
-    }
-    
-    // Legacy support
-    // DBConn() : DBConn(WRITE) {} 
-    
-    // No manual release in dtor needed because shared_ptr has custom deleter
-    ~DBConn() = default; 
-    
-    MYSQL* get() { return conn_.get(); }
+
+    DBConn(Type type = WRITE)
+        : conn_(DBPool::GetInstance().Acquire(type == READ ? DBPool::SLAVE : DBPool::MASTER)) {}
+
+    ~DBConn() { if (conn_) DBPool::GetInstance().Release(conn_); }
+
+    DBConn(DBConn&& other) noexcept : conn_(other.conn_) { other.conn_ = nullptr; }
+    DBConn(const DBConn&) = delete;
+    DBConn& operator=(const DBConn&) = delete;
+
+    MYSQL* get() { return conn_ ? conn_->mysql : nullptr; }
     bool valid() { return conn_ != nullptr; }
 
+    // Cached prepared statement on this connection (see DBStmt)
+    DBStmt* Prepare(const std::string& sql) {
+        return conn_ ? conn_->Prepare(sql) : nullptr;
+    }
+
 private:
-    std::shared_ptr<MYSQL> conn_;
+    DBConnection* conn_;
 };
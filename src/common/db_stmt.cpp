@@ -0,0 +1,186 @@
+#include "db_stmt.h"
+#include <algorithm>
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+DBStmt::DBStmt(MYSQL_STMT* stmt) : stmt_(stmt), param_count_(mysql_stmt_param_count(stmt)) {
+    params_.reserve(param_count_);
+
+    // Needed to size string result buffers from the buffered result set
+    bool update_max_length = true;
+    mysql_stmt_attr_set(stmt_, STMT_ATTR_UPDATE_MAX_LENGTH, &update_max_length);
+}
+
+DBStmt::~DBStmt() {
+    if (has_result_) mysql_stmt_free_result(stmt_);
+    mysql_stmt_close(stmt_);
+}
+
+DBStmt::Param* DBStmt::NextParam() {
+    // params_ must not grow past param_count_ (MYSQL_BIND points into it): count the
+    // extra ones so Execute fails instead of running with the first param_count_
+    if (params_.size() >= param_count_) {
+        extra_params_++;
+        return nullptr;
+    }
+    return &params_.emplace_back();
+}
+
+DBStmt& DBStmt::Bind(int64_t value) {
+    if (Param* p = NextParam()) {
+        p->int_value = value;
+    }
+    return *this;
+}
+
+DBStmt& DBStmt::Bind(const std::string& value) {
+    if (Param* p = NextParam()) {
+        p->str_value = value;
+        p->length = value.size();
+        p->is_string = true;
+    }
+    return *this;
+}
+
+DBStmt& DBStmt::BindNull() {
+    if (Param* p = NextParam()) {
+        p->is_null = true;
+    }
+    return *this;
+}
+
+bool DBStmt::Execute() {
+    if (has_result_) {
+        mysql_stmt_free_result(stmt_);
+        has_result_ = false;
+    }
+
+    if (params_.size() + extra_params_ != param_count_) {
+        spdlog::error("DBStmt: {} parameters bound, {} expected", params_.size() + extra_params_, param_count_);
+        params_.clear();
+        extra_params_ = 0;
+        return false;
+    }
+
+    if (!params_.empty()) {
+        param_binds_.assign(params_.size(), MYSQL_BIND{});
+        for (size_t i = 0; i < params_.size(); ++i) {
+            Param& p = params_[i];
+            MYSQL_BIND& b = param_binds_[i];
+            b.is_null = &p.is_null;
+            if (p.is_null) {
+                b.buffer_type = MYSQL_TYPE_NULL;
+            } else if (p.is_string) {
+                b.buffer_type = MYSQL_TYPE_STRING;
+                b.buffer = p.str_value.data();
+                b.buffer_length = p.length;
+                b.length = &p.length;
+            } else {
+                b.buffer_type = MYSQL_TYPE_LONGLONG;
+                b.buffer = &p.int_value;
+            }
+        }
+        if (mysql_stmt_bind_param(stmt_, param_binds_.data())) {
+            spdlog::error("DBStmt bind failed: {}", mysql_stmt_error(stmt_));
+            params_.clear();
+            return false;
+        }
+    }
+
+    int rc = mysql_stmt_execute(stmt_);
+    params_.clear();
+    if (rc) {
+        CheckBroken();
+        return false;
+    }
+
+    if (mysql_stmt_field_count(stmt_) == 0) return true; // INSERT / UPDATE
+
+    if (mysql_stmt_store_result(stmt_)) {
+        CheckBroken();
+        return false;
+    }
+    has_result_ = true;
+    return BindResult();
+}
+
+void DBStmt::CheckBroken() {
+    // Client-side errors (CR_*, >= 2000: lost connection etc.), or the server no longer
+    // knows the handle (ER_UNKNOWN_STMT_HANDLER) / wants it re-prepared (ER_NEED_REPREPARE).
+    // Plain SQL errors such as duplicate keys leave the statement usable.
+    unsigned int err = mysql_stmt_errno(stmt_);
+    if (err >= 2000 || err == 1243 || err == 1615) broken_ = true;
+}
+
+bool DBStmt::BindResult() {
+    MYSQL_RES* meta = mysql_stmt_result_metadata(stmt_);
+    if (!meta) return false;
+
+    unsigned int count = mysql_num_fields(meta);
+    MYSQL_FIELD* fields = mysql_fetch_fields(meta);
+    columns_.resize(count);
+    result_binds_.assign(count, MYSQL_BIND{});
+
+    for (unsigned int i = 0; i < count; ++i) {
+        Column& c = columns_[i];
+        MYSQL_BIND& b = result_binds_[i];
+        switch (fields[i].type) {
+            case MYSQL_TYPE_TINY:
+            case MYSQL_TYPE_SHORT:
+            case MYSQL_TYPE_INT24:
+            case MYSQL_TYPE_LONG:
+            case MYSQL_TYPE_LONGLONG:
+                c.is_int = true;
+                b.buffer_type = MYSQL_TYPE_LONGLONG;
+                b.buffer = &c.int_value;
+                b.is_unsigned = (fields[i].flags & UNSIGNED_FLAG) != 0;
+                break;
+            default: {
+                // Everything else (text, blobs, temporals) is fetched as text.
+                // max_length is the longest value in this result set; temporals need room for
+                // their string form, which max_length does not account for.
+                c.is_int = false;
+                size_t size = std::max<size_t>(fields[i].max_length, 64) + 1;
+                if (c.buffer.size() < size) c.buffer.resize(size);
+                b.buffer_type = MYSQL_TYPE_STRING;
+                b.buffer = c.buffer.data();
+                b.buffer_length = c.buffer.size();
+                break;
+            }
+        }
+        b.length = &c.length;
+        b.is_null = &c.is_null;
+        b.error = &c.error;
+    }
+    mysql_free_result(meta);
+
+    if (mysql_stmt_bind_result(stmt_, result_binds_.data())) {
+        spdlog::error("DBStmt bind result failed: {}", mysql_stmt_error(stmt_));
+        return false;
+    }
+    return true;
+}
+
+bool DBStmt::Fetch() {
+    if (!has_result_) return false;
+    int rc = mysql_stmt_fetch(stmt_);
+    if (rc == 0 || rc == MYSQL_DATA_TRUNCATED) return true;
+    if (rc != MYSQL_NO_DATA) spdlog::error("DBStmt fetch failed: {}", mysql_stmt_error(stmt_));
+    mysql_stmt_free_result(stmt_);
+    has_result_ = false;
+    return false;
+}
+
+int64_t DBStmt::GetInt64(int col) const {
+    const Column& c = columns_[col];
+    if (c.is_null) return 0;
+    if (c.is_int) return c.int_value;
+    return std::strtoll(c.buffer.data(), nullptr, 10);
+}
+
+std::string DBStmt::GetString(int col) const {
+    const Column& c = columns_[col];
+    if (c.is_null) return "";
+    if (c.is_int) return std::to_string(c.int_value);
+    return std::string(c.buffer.data(), std::min<size_t>(c.length, c.buffer.size()));
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <mysql/mysql.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Prepared statement bound to one pooled connection.
+// Obtained from DBConn::Prepare (cached per connection, keyed by the SQL text),
+// so the statement is parsed once per connection instead of once per request,
+// parameters travel in the binary protocol (no escaping), and integer columns
+// come back as integers (no text round trip through std::stoll).
+//
+// Usage:
+//   DBStmt* stmt = conn.Prepare("SELECT user_id, nickname FROM im_user WHERE username=?");
+//   if (stmt && stmt->Bind(username).Execute()) {
+//       while (stmt->Fetch()) { int64_t id = stmt->GetInt64(0); ... }
+//   }
+//
+// Not thread-safe: like the connection it belongs to, use it from one thread at a time.
+class DBStmt {
+public:
+    DBStmt(MYSQL_STMT* stmt);
+    ~DBStmt();
+    DBStmt(const DBStmt&) = delete;
+    DBStmt& operator=(const DBStmt&) = delete;
+
+    // Parameters in placeholder order; values are copied. Execute clears them, and
+    // fails if more or fewer than the placeholders were bound.
+    DBStmt& Bind(int64_t value);
+    DBStmt& Bind(const std::string& value);
+    DBStmt& BindNull();
+
+    // Runs the statement. Result sets are buffered client-side.
+    bool Execute();
+
+    // Advances to the next row; false at the end (the result set is then freed)
+    bool Fetch();
+    bool IsNull(int col) const { return columns_[col].is_null; }
+    int64_t GetInt64(int col) const;
+    std::string GetString(int col) const;
+
+    uint64_t InsertId() { return mysql_stmt_insert_id(stmt_); }
+    uint64_t AffectedRows() { return mysql_stmt_affected_rows(stmt_); }
+    const char* error() { return mysql_stmt_error(stmt_); }
+
+    // A statement whose handle is no longer usable is re-prepared on next use
+    bool broken() const { return broken_; }
+
+private:
+    struct Param {
+        int64_t int_value = 0;
+        std::string str_value;
+        unsigned long length = 0;
+        bool is_string = false;
+        bool is_null = false;
+    };
+    struct Column {
+        bool is_int = false;
+        int64_t int_value = 0;
+        std::vector<char> buffer;
+        unsigned long length = 0;
+        bool is_null = false;
+        bool error = false;
+    };
+
+    Param* NextParam(); // nullptr once param_count_ are bound
+    bool BindResult();
+    void CheckBroken();
+
+    MYSQL_STMT* stmt_;
+    size_t param_count_;
+    std::vector<Param> params_;       // reserved to param_count_: MYSQL_BIND points into it
+    size_t extra_params_ = 0;         // Bound past param_count_: Execute fails
+    std::vector<MYSQL_BIND> param_binds_;
+    std::vector<Column> columns_;
+    std::vector<MYSQL_BIND> result_binds_;
+    bool has_result_ = false;
+    bool broken_ = false;
+};
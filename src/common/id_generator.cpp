@@ -0,0 +1,40 @@
+#include "id_generator.h"
+#include <chrono>
+
+IdGenerator& IdGenerator::GetInstance() {
+    static IdGenerator instance;
+    return instance;
+}
+
+int64_t IdGenerator::NextId() {
+    // Read the id with its own deadline: if the id changed meanwhile, the
+    // deadline read may belong to the new one
+    int node;
+    Clock::rep valid_until;
+    do {
+        node = node_id();
+        if (node < 0) return 0;
+        valid_until = valid_until_.load(std::memory_order_acquire);
+    } while (node_id() != node);
+    // Past the deadline the lease may have expired and the id been taken by another process
+    if (Clock::now().time_since_epoch().count() >= valid_until) return 0;
+
+    uint64_t now = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count() - kEpochMs);
+
+    uint64_t old_state = state_.load(std::memory_order_relaxed);
+    uint64_t new_state;
+    do {
+        if (now > (old_state >> kSeqBits)) {
+            new_state = now << kSeqBits;   // New millisecond: sequence restarts at 0
+        } else {
+            new_state = old_state + 1;     // Same ms (or clock behind): next sequence, carrying into the ms
+        }
+    } while (!state_.compare_exchange_weak(old_state, new_state, std::memory_order_relaxed));
+
+    uint64_t ms = new_state >> kSeqBits;
+    uint64_t seq = new_state & ((1u << kSeqBits) - 1);
+    return static_cast<int64_t>((ms << (kNodeBits + kSeqBits)) |
+                                (static_cast<uint64_t>(node) << kSeqBits) | seq);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Snowflake-style 64-bit IDs, generated in process without locks:
+//
+//   | 0 | 41 bits: ms since kEpochMs | 10 bits: node id | 12 bits: sequence |
+//
+// IDs are unique as long as node ids are (leased through
+// ServiceRegistry::AcquireNodeId) and increase with time, so they sort by
+// creation time across nodes (to clock skew) and can drive time-range queries.
+//
+// The clock and sequence live in one atomic word updated by CAS. When the
+// sequence overflows within a millisecond, or the wall clock steps backwards,
+// the generator runs ahead on its own counter instead of blocking, so NextId
+// never waits and never repeats.
+//
+// A leased node id is only valid until its lease could have expired: past the
+// deadline given with it NextId fails rather than risk sharing the id with the
+// process that leased it next.
+class IdGenerator {
+public:
+    static constexpr int kNodeBits = 10;
+    static constexpr int kSeqBits = 12;
+    static constexpr int kMaxNodeId = (1 << kNodeBits) - 1;
+    static constexpr int64_t kEpochMs = 1704067200000; // 2024-01-01 00:00:00 UTC
+
+    static IdGenerator& GetInstance();
+
+    using Clock = std::chrono::steady_clock;
+
+    // -1 = unassigned. valid_until: when the lease behind node_id may run out
+    // (the id is stored first; NextId rereads it to pair it with its own deadline)
+    void SetNodeId(int node_id, Clock::time_point valid_until = Clock::time_point::max()) {
+        node_id_.store(node_id, std::memory_order_release);
+        valid_until_.store(valid_until.time_since_epoch().count(), std::memory_order_release);
+    }
+    int node_id() const { return node_id_.load(std::memory_order_acquire); }
+
+    // 0 if no node id is assigned or its lease is past its deadline
+    int64_t NextId();
+
+    // Creation time of an id, in ms since the Unix epoch
+    static int64_t TimestampOf(int64_t id) { return (id >> (kNodeBits + kSeqBits)) + kEpochMs; }
+
+private:
+    IdGenerator() = default;
+
+    std::atomic<int> node_id_{-1};
+    std::atomic<Clock::rep> valid_until_{Clock::time_point::max().time_since_epoch().count()};
+    std::atomic<uint64_t> state_{0}; // (ms since kEpochMs << kSeqBits) | sequence
+};
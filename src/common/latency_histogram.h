@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+// Lock-free latency histogram in microseconds, safe to Record from any thread.
+//
+// Buckets are log-linear: values below 8 get one bucket each, above that every
+// power of two is split into 8 sub-buckets, so a bucket is at most 12.5% wide
+// and the whole range up to ~2^35 us (about 9.5 hours) fits in 272 counters.
+// Recording is one relaxed fetch_add per counter; percentiles are read from a
+// racy but monotonic snapshot, which is fine for monitoring.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 3;
+    static constexpr int kSubBuckets = 1 << kSubBits;
+    static constexpr int kMaxExponent = 35;
+    static constexpr int kBuckets = (kMaxExponent - kSubBits + 1) * kSubBuckets + kSubBuckets;
+
+    void Record(int64_t us) {
+        if (us < 0) us = 0; // Cross-host clock skew
+        buckets_[BucketOf(static_cast<uint64_t>(us))].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(static_cast<uint64_t>(us), std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the q-th quantile (0 if empty)
+    int64_t Percentile(double q) const {
+        uint64_t total = count();
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * total);
+        if (rank >= total) rank = total - 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen > rank) return UpperBound(i);
+        }
+        return UpperBound(kBuckets - 1);
+    }
+
+    // Count of values that fall in bucket i; bounds are [LowerBound(i), UpperBound(i)]
+    uint64_t BucketCount(int i) const { return buckets_[i].load(std::memory_order_relaxed); }
+
+    static int BucketOf(uint64_t v) {
+        if (v < kSubBuckets) return static_cast<int>(v);
+        int exp = std::bit_width(v) - 1;
+        if (exp > kMaxExponent) return kBuckets - 1;
+        int sub = static_cast<int>((v >> (exp - kSubBits)) & (kSubBuckets - 1));
+        return (exp - kSubBits + 1) * kSubBuckets + sub;
+    }
+
+    static int64_t LowerBound(int i) {
+        if (i < kSubBuckets) return i;
+        int exp = i / kSubBuckets + kSubBits - 1;
+        int sub = i % kSubBuckets;
+        return (int64_t{1} << exp) + (static_cast<int64_t>(sub) << (exp - kSubBits));
+    }
+
+    static int64_t UpperBound(int i) {
+        if (i < kSubBuckets) return i;
+        int exp = i / kSubBuckets + kSubBits - 1;
+        return LowerBound(i) + (int64_t{1} << (exp - kSubBits)) - 1;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+};
@@ -0,0 +1,306 @@
+#include "metrics.h"
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <spdlog/spdlog.h>
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+
+int MetricSlot() {
+    static std::atomic<int> next{0};
+    thread_local int slot = next.fetch_add(1, std::memory_order_relaxed) % kMetricSlots;
+    return slot;
+}
+
+uint64_t Counter::Value() const {
+    uint64_t total = 0;
+    for (const auto& s : slots_) total += s.v.load(std::memory_order_relaxed);
+    return total;
+}
+
+void Gauge::Set(int64_t v) {
+    for (int i = 1; i < kMetricSlots; ++i) slots_[i].v.store(0, std::memory_order_relaxed);
+    slots_[0].v.store(v, std::memory_order_relaxed);
+}
+
+int64_t Gauge::Value() const {
+    int64_t total = 0;
+    for (const auto& s : slots_) total += s.v.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint64_t Histogram::Count() const {
+    uint64_t total = 0;
+    for (const auto& h : slots_) total += h.count();
+    return total;
+}
+
+uint64_t Histogram::Sum() const {
+    uint64_t total = 0;
+    for (const auto& h : slots_) total += h.sum();
+    return total;
+}
+
+int64_t Histogram::Percentile(double q) const {
+    std::array<uint64_t, LatencyHistogram::kBuckets> merged{};
+    uint64_t total = 0;
+    for (const auto& h : slots_) {
+        for (int i = 0; i < LatencyHistogram::kBuckets; ++i) merged[i] += h.BucketCount(i);
+    }
+    for (uint64_t n : merged) total += n;
+    if (total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+        seen += merged[i];
+        if (seen > rank) return LatencyHistogram::UpperBound(i);
+    }
+    return LatencyHistogram::UpperBound(LatencyHistogram::kBuckets - 1);
+}
+
+uint64_t Histogram::CountBelow(int64_t us) const {
+    uint64_t total = 0;
+    for (const auto& h : slots_) {
+        for (int i = 0; i < LatencyHistogram::kBuckets && LatencyHistogram::UpperBound(i) < us; ++i) {
+            total += h.BucketCount(i);
+        }
+    }
+    return total;
+}
+
+namespace {
+
+// Per-thread cache of a family's series, keyed by (family, label value pointer)
+struct FamilyKey {
+    const void* family;
+    const char* value;
+    bool operator==(const FamilyKey& o) const { return family == o.family && value == o.value; }
+};
+struct FamilyKeyHash {
+    size_t operator()(const FamilyKey& k) const {
+        return std::hash<const void*>()(k.family) * 31 + std::hash<const void*>()(k.value);
+    }
+};
+
+} // namespace
+
+Histogram& HistogramFamily::With(const char* value) {
+    thread_local std::unordered_map<FamilyKey, Histogram*, FamilyKeyHash> cache;
+
+    Histogram*& h = cache[FamilyKey{this, value}];
+    if (!h) h = &Metrics::GetInstance().GetHistogram(name_, help_, {{label_, value}});
+    return *h;
+}
+
+Counter& CounterFamily::With(const char* value) {
+    thread_local std::unordered_map<FamilyKey, Counter*, FamilyKeyHash> cache;
+
+    Counter*& c = cache[FamilyKey{this, value}];
+    if (!c) c = &Metrics::GetInstance().GetCounter(name_, help_, {{label_, value}});
+    return *c;
+}
+
+Metrics& Metrics::GetInstance() {
+    static Metrics instance;
+    return instance;
+}
+
+Metrics::Series& Metrics::GetSeries(const std::string& name, const std::string& help, Type type,
+                                    const MetricLabels& labels) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto [it, created] = families_.try_emplace(name);
+    Family& family = it->second;
+    if (created) {
+        family.type = type;
+        family.help = help;
+    } else if (family.type != type) {
+        spdlog::error("Metric {} registered with two types", name);
+    }
+    for (auto& s : family.series) {
+        if (s->labels == labels) return *s;
+    }
+    family.series.push_back(std::make_unique<Series>());
+    family.series.back()->labels = labels;
+    return *family.series.back();
+}
+
+Counter& Metrics::GetCounter(const std::string& name, const std::string& help, const MetricLabels& labels) {
+    Series& s = GetSeries(name, help, Type::kCounter, labels);
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!s.counter) s.counter = std::make_unique<Counter>();
+    return *s.counter;
+}
+
+Gauge& Metrics::GetGauge(const std::string& name, const std::string& help, const MetricLabels& labels) {
+    Series& s = GetSeries(name, help, Type::kGauge, labels);
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!s.gauge) s.gauge = std::make_unique<Gauge>();
+    return *s.gauge;
+}
+
+Histogram& Metrics::GetHistogram(const std::string& name, const std::string& help, const MetricLabels& labels) {
+    Series& s = GetSeries(name, help, Type::kHistogram, labels);
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!s.histogram) s.histogram = std::make_unique<Histogram>();
+    return *s.histogram;
+}
+
+void Metrics::AddGaugeCallback(const std::string& name, const std::string& help, const MetricLabels& labels,
+                               std::function<double()> fn) {
+    Series& s = GetSeries(name, help, Type::kGauge, labels);
+    std::lock_guard<std::mutex> lock(mtx_);
+    s.callback = std::move(fn);
+}
+
+static std::string EscapeLabel(const std::string& v) {
+    std::string out;
+    for (char c : v) {
+        if (c == '\\' || c == '"') out += '\\';
+        if (c == '\n') { out += "\\n"; continue; }
+        out += c;
+    }
+    return out;
+}
+
+// {a="x",b="y"}, with extra appended last (for le); empty if there are no labels
+static std::string FormatLabels(const MetricLabels& labels, const std::string& extra = "") {
+    std::string out;
+    for (const auto& [k, v] : labels) {
+        out += out.empty() ? "{" : ",";
+        out += k + "=\"" + EscapeLabel(v) + "\"";
+    }
+    if (!extra.empty()) {
+        out += out.empty() ? "{" : ",";
+        out += extra;
+    }
+    if (!out.empty()) out += "}";
+    return out;
+}
+
+static std::string FormatDouble(double v) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", v);
+    return buf;
+}
+
+std::string Metrics::Expose() {
+    // Histogram buckets: powers of two microseconds, 8us .. ~16.8s
+    static constexpr int kMinExp = 3;
+    static constexpr int kMaxExp = 24;
+
+    std::string out;
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (const auto& [name, family] : families_) {
+        const char* type = family.type == Type::kCounter ? "counter"
+                         : family.type == Type::kGauge ? "gauge" : "histogram";
+        out += "# HELP " + name + " " + family.help + "\n";
+        out += "# TYPE " + name + " " + type + "\n";
+        for (const auto& s : family.series) {
+            if (s->counter) {
+                out += name + FormatLabels(s->labels) + " " + std::to_string(s->counter->Value()) + "\n";
+            } else if (s->callback) {
+                out += name + FormatLabels(s->labels) + " " + FormatDouble(s->callback()) + "\n";
+            } else if (s->gauge) {
+                out += name + FormatLabels(s->labels) + " " + std::to_string(s->gauge->Value()) + "\n";
+            } else if (s->histogram) {
+                const Histogram& h = *s->histogram;
+                uint64_t count = h.Count();
+                for (int e = kMinExp; e <= kMaxExp; ++e) {
+                    int64_t bound = int64_t{1} << e;
+                    out += name + "_bucket" + FormatLabels(s->labels, "le=\"" + FormatDouble(bound / 1e6) + "\"") +
+                           " " + std::to_string(h.CountBelow(bound)) + "\n";
+                }
+                out += name + "_bucket" + FormatLabels(s->labels, "le=\"+Inf\"") + " " + std::to_string(count) + "\n";
+                out += name + "_sum" + FormatLabels(s->labels) + " " + FormatDouble(h.Sum() / 1e6) + "\n";
+                out += name + "_count" + FormatLabels(s->labels) + " " + std::to_string(count) + "\n";
+            }
+        }
+    }
+    return out;
+}
+
+namespace {
+
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = net::ip::tcp;
+
+// One scrape: read the request, answer, close. Every step runs under a
+// deadline, so a client that connects and sends nothing cannot hold the
+// listener up, and slow clients do not queue behind each other.
+class MetricsConnection : public std::enable_shared_from_this<MetricsConnection> {
+public:
+    static constexpr std::chrono::seconds kTimeout{5};
+
+    explicit MetricsConnection(tcp::socket socket) : stream_(std::move(socket)) {}
+
+    void Run() {
+        stream_.expires_after(kTimeout);
+        http::async_read(stream_, buffer_, req_,
+            [self = shared_from_this()](beast::error_code ec, size_t) { self->OnRead(ec); });
+    }
+
+private:
+    void OnRead(beast::error_code ec) {
+        if (ec) return; // Timed out or gone: the stream closes with us
+
+        res_.version(req_.version());
+        if (req_.method() == http::verb::get && req_.target() == "/metrics") {
+            res_.result(http::status::ok);
+            res_.set(http::field::content_type, "text/plain; version=0.0.4");
+            res_.body() = Metrics::GetInstance().Expose();
+        } else {
+            res_.result(http::status::not_found);
+            res_.body() = "Not Found";
+        }
+        res_.keep_alive(false);
+        res_.prepare_payload();
+
+        stream_.expires_after(kTimeout);
+        http::async_write(stream_, res_, [self = shared_from_this()](beast::error_code, size_t) {
+            beast::error_code ignored;
+            self->stream_.socket().shutdown(tcp::socket::shutdown_both, ignored);
+        });
+    }
+
+    beast::tcp_stream stream_;
+    beast::flat_buffer buffer_;
+    http::request<http::string_body> req_;
+    http::response<http::string_body> res_;
+};
+
+void AcceptMetrics(tcp::acceptor& acceptor) {
+    acceptor.async_accept([&acceptor](beast::error_code ec, tcp::socket socket) {
+        if (!ec) std::make_shared<MetricsConnection>(std::move(socket))->Run();
+        AcceptMetrics(acceptor);
+    });
+}
+
+} // namespace
+
+void MetricsServer::Start(int port) {
+    if (port <= 0) return;
+
+    std::thread([port]() {
+        net::io_context ioc;
+        tcp::acceptor acceptor(ioc);
+        boost::system::error_code ec;
+        tcp::endpoint endpoint(tcp::v4(), static_cast<unsigned short>(port));
+        acceptor.open(endpoint.protocol(), ec);
+        if (!ec) acceptor.set_option(net::socket_base::reuse_address(true), ec);
+        if (!ec) acceptor.bind(endpoint, ec);
+        if (!ec) acceptor.listen(net::socket_base::max_listen_connections, ec);
+        if (ec) {
+            spdlog::error("Metrics listener on port {} failed: {}", port, ec.message());
+            return;
+        }
+        spdlog::info("Metrics served on http://0.0.0.0:{}/metrics", port);
+
+        // Scrapes are rare and cheap: one thread serves them all, asynchronously
+        AcceptMetrics(acceptor);
+        ioc.run();
+    }).detach();
+}
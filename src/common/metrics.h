@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "latency_histogram.h"
+
+// Process-wide metrics in Prometheus text exposition format.
+//
+// Metrics are registered once (under a lock) and then updated from hot paths
+// without locks: counters and histograms are split into kMetricSlots
+// cache-line-sized slots and each thread writes its own slot, so threads do not
+// contend on one cache line; a scrape sums the slots.
+//
+// Usage:
+//   static Counter& sent = Metrics::GetInstance().GetCounter("tinyim_messages_sent_total", "Messages sent");
+//   sent.Inc();
+//   static HistogramFamily rpc("tinyim_rpc_server_seconds", "Server RPC latency", "method");
+//   rpc.With(method_name).Record(us);
+//
+// Latencies are recorded in microseconds and exposed in seconds.
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+constexpr int kMetricSlots = 8;
+
+// This thread's slot, assigned round-robin on first use
+int MetricSlot();
+
+class Counter {
+public:
+    void Inc(uint64_t n = 1) { slots_[MetricSlot()].v.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t Value() const;
+
+private:
+    struct alignas(64) Slot { std::atomic<uint64_t> v{0}; };
+    std::array<Slot, kMetricSlots> slots_;
+};
+
+// Add/Sub may come from any thread; Set is for gauges with a single writer
+class Gauge {
+public:
+    void Add(int64_t n) { slots_[MetricSlot()].v.fetch_add(n, std::memory_order_relaxed); }
+    void Sub(int64_t n) { Add(-n); }
+    void Set(int64_t v);
+    int64_t Value() const;
+
+private:
+    struct alignas(64) Slot { std::atomic<int64_t> v{0}; };
+    std::array<Slot, kMetricSlots> slots_;
+};
+
+class Histogram {
+public:
+    void Record(int64_t us) { slots_[MetricSlot()].Record(us); }
+
+    uint64_t Count() const;
+    uint64_t Sum() const;
+    // Merged across slots; upper bound of the bucket, in us
+    int64_t Percentile(double q) const;
+    // Number of recorded values below us (us a power of two: exact)
+    uint64_t CountBelow(int64_t us) const;
+
+private:
+    std::array<LatencyHistogram, kMetricSlots> slots_;
+};
+
+// Histograms that differ in one label whose values are not known up front
+// (RPC method, Redis command). With() takes a pointer that stays valid for the
+// process (a literal, or a gRPC method name) and caches the lookup per thread.
+class HistogramFamily {
+public:
+    HistogramFamily(std::string name, std::string help, std::string label)
+        : name_(std::move(name)), help_(std::move(help)), label_(std::move(label)) {}
+
+    Histogram& With(const char* value);
+
+private:
+    std::string name_;
+    std::string help_;
+    std::string label_;
+};
+
+// Counters split by one label, looked up like HistogramFamily
+class CounterFamily {
+public:
+    CounterFamily(std::string name, std::string help, std::string label)
+        : name_(std::move(name)), help_(std::move(help)), label_(std::move(label)) {}
+
+    Counter& With(const char* value);
+
+private:
+    std::string name_;
+    std::string help_;
+    std::string label_;
+};
+
+// Records the time from construction to destruction into a histogram
+class ScopedLatency {
+public:
+    explicit ScopedLatency(Histogram& h) : h_(h), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedLatency() {
+        h_.Record(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+    }
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    Histogram& h_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+class Metrics {
+public:
+    static Metrics& GetInstance();
+
+    // Same name and labels return the same metric
+    Counter& GetCounter(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+    Gauge& GetGauge(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+    Histogram& GetHistogram(const std::string& name, const std::string& help, const MetricLabels& labels = {});
+    // Gauge read at scrape time (sizes of structures that already keep a count)
+    void AddGaugeCallback(const std::string& name, const std::string& help, const MetricLabels& labels,
+                          std::function<double()> fn);
+
+    // Text exposition format, version 0.0.4
+    std::string Expose();
+
+private:
+    Metrics() = default;
+
+    enum class Type { kCounter, kGauge, kHistogram };
+
+    struct Series {
+        MetricLabels labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        std::function<double()> callback;
+    };
+
+    struct Family {
+        Type type;
+        std::string help;
+        std::vector<std::unique_ptr<Series>> series;
+    };
+
+    Series& GetSeries(const std::string& name, const std::string& help, Type type, const MetricLabels& labels);
+
+    std::mutex mtx_;
+    std::map<std::string, Family> families_; // Sorted by name for stable output
+};
+
+// Serves GET /metrics over HTTP on its own thread. For services without an
+// HTTP server of their own; the gateway answers /metrics in its HttpSession.
+// port <= 0 disables it.
+class MetricsServer {
+public:
+    static void Start(int port);
+};
@@ -1,6 +1,16 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
+#include <string>
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+constexpr uint8_t PACKET_VERSION_1 = 1;
+constexpr uint8_t PACKET_VERSION_2 = 2; // Adds client seq for request/response correlation
 
 #pragma pack(push, 1)
 struct PacketHeader {
@@ -9,8 +19,47 @@ struct PacketHeader {
     uint16_t cmd_id = 0;
     uint32_t body_len = 0;
 };
+
+// v2: same prefix as v1, followed by the client sequence number.
+// The gateway echoes seq in the response, so clients can pipeline requests.
+// Unsolicited frames (push/kick) are always sent as v1.
+struct PacketHeaderV2 {
+    char magic[2] = {'I', 'M'};
+    uint8_t version = 2;
+    uint16_t cmd_id = 0;
+    uint32_t body_len = 0;
+    uint32_t seq = 0;
+};
 #pragma pack(pop)
 
+inline size_t PacketHeaderSize(uint8_t version) {
+    return version >= PACKET_VERSION_2 ? sizeof(PacketHeaderV2) : sizeof(PacketHeader);
+}
+
+// Build a full packet (header + body) in network byte order
+inline std::string EncodePacket(uint16_t cmd_id, const std::string& body,
+                                uint8_t version = PACKET_VERSION_1, uint32_t seq = 0) {
+    std::string packet;
+    size_t header_size = PacketHeaderSize(version);
+    packet.resize(header_size + body.size());
+    if (version >= PACKET_VERSION_2) {
+        PacketHeaderV2 header;
+        header.cmd_id = htons(cmd_id);
+        header.body_len = htonl(body.size());
+        header.seq = htonl(seq);
+        memcpy(&packet[0], &header, header_size);
+    } else {
+        PacketHeader header;
+        header.cmd_id = htons(cmd_id);
+        header.body_len = htonl(body.size());
+        memcpy(&packet[0], &header, header_size);
+    }
+    if (!body.empty()) {
+        memcpy(&packet[header_size], body.data(), body.size());
+    }
+    return packet;
+}
+
 enum CommandID : uint16_t {
     CMD_LOGIN_REQ = 0x1001, 
     CMD_LOGIN_RESP = 0x1002,
@@ -1,4 +1,74 @@
 #include "redis_client.h"
+#include <algorithm>
+#include <set>
+#include <tuple>
+#include "metrics.h"
+
+// Round-trip latency per command; name must outlive the process (a literal)
+static Histogram& CommandLatency(const char* name) {
+    static HistogramFamily latency("tinyim_redis_command_seconds", "Redis command latency", "command");
+    return latency.With(name);
+}
+
+// Stable label for a command only known at runtime (Command's argv[0]).
+// Each thread remembers the names it has seen; only a new one takes the lock.
+static const char* InternCommand(const std::string& name) {
+    thread_local std::unordered_map<std::string, const char*> seen;
+    auto it = seen.find(name);
+    if (it != seen.end()) return it->second;
+
+    static std::mutex mtx;
+    static std::set<std::string> names;
+    std::lock_guard<std::mutex> lock(mtx);
+    const char* interned = names.insert(name).first->c_str();
+    seen.emplace(name, interned);
+    return interned;
+}
+
+uint32_t RedisRing::Hash(std::string_view key) {
+    // Hash tag: the first {...} with something inside
+    auto open = key.find('{');
+    if (open != std::string_view::npos) {
+        auto close = key.find('}', open + 1);
+        if (close != std::string_view::npos && close > open + 1) key = key.substr(open + 1, close - open - 1);
+    }
+    // FNV-1a, then a murmur3 finalizer so nearby keys spread over the whole ring
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return static_cast<uint32_t>(h);
+}
+
+RedisRing::RedisRing(const std::vector<std::string>& nodes) : nodes_(nodes) {
+    points_.reserve(nodes.size() * kVirtualNodes);
+    for (uint32_t n = 0; n < nodes.size(); ++n) {
+        for (int v = 0; v < kVirtualNodes; ++v) {
+            points_.emplace_back(Hash(nodes[n] + "#" + std::to_string(v)), n);
+        }
+    }
+    std::sort(points_.begin(), points_.end());
+}
+
+size_t RedisRing::NodeOf(std::string_view key) const {
+    if (nodes_.size() <= 1) return 0;
+    uint32_t h = Hash(key);
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(h, uint32_t{0}));
+    if (it == points_.end()) it = points_.begin(); // Wrap around
+    return it->second;
+}
+
+std::pair<std::string, int> ParseRedisNode(const std::string& node) {
+    auto colon = node.rfind(':');
+    if (colon == std::string::npos) return {node, 6379};
+    return {node.substr(0, colon), std::stoi(node.substr(colon + 1))};
+}
 
 RedisClient& RedisClient::GetInstance() {
     static RedisClient instance;
@@ -6,50 +76,88 @@ RedisClient& RedisClient::GetInstance() {
 }
 
 void RedisClient::Init(const std::string& host, int port) {
-    host_ = host;
-    port_ = port;
+    Init(std::vector<std::string>{host + ":" + std::to_string(port)});
+}
+
+void RedisClient::Init(const std::vector<std::string>& nodes) {
+    // Nodes and ring are read without a lock once callers exist: rebuilding
+    // them would free Nodes and leak the pooled contexts under live callers
+    if (!nodes_.empty()) {
+        spdlog::error("RedisClient::Init called twice, keeping the first {} node(s)", nodes_.size());
+        return;
+    }
+    node_addrs_ = nodes;
+    for (const auto& addr : nodes) {
+        auto node = std::make_unique<Node>();
+        std::tie(node->host, node->port) = ParseRedisNode(addr);
+        nodes_.push_back(std::move(node));
+    }
+    ring_ = RedisRing(nodes);
+    if (nodes.size() > 1) spdlog::info("Redis sharded over {} nodes", nodes.size());
 }
 
-redisContext* RedisClient::GetContext() {
+redisContext* RedisClient::GetContext(size_t shard) {
+    if (shard >= nodes_.size()) return nullptr;
+    Node& node = *nodes_[shard];
     {
-        std::lock_guard<std::mutex> lock(mtx_);
-        if (!pool_.empty()) {
-            redisContext* ctx = pool_.back();
-            pool_.pop_back();
+        std::lock_guard<std::mutex> lock(node.mtx);
+        if (!node.pool.empty()) {
+            redisContext* ctx = node.pool.back();
+            node.pool.pop_back();
             return ctx;
         }
     }
     
     // Create new
-    redisContext* c = redisConnect(host_.c_str(), port_);
+    struct timeval connect_timeout = {kConnectTimeoutMs / 1000, (kConnectTimeoutMs % 1000) * 1000};
+    redisContext* c = redisConnectWithTimeout(node.host.c_str(), node.port, connect_timeout);
     if (c == nullptr || c->err) {
         if (c) {
-            spdlog::error("Redis connection error: {}", c->errstr);
+            spdlog::error("Redis connection error ({}:{}): {}", node.host, node.port, c->errstr);
             redisFree(c);
         } else {
             spdlog::error("Redis connection error: can't allocate context");
         }
         return nullptr;
     }
+    struct timeval command_timeout = {kCommandTimeoutMs / 1000, (kCommandTimeoutMs % 1000) * 1000};
+    redisSetTimeout(c, command_timeout);
     return c;
 }
 
-void RedisClient::ReleaseContext(redisContext* ctx) {
+void RedisClient::ReleaseContext(size_t shard, redisContext* ctx) {
     if (!ctx) return;
-    std::lock_guard<std::mutex> lock(mtx_);
-    pool_.push_back(ctx);
+    if (ctx->err) {
+        // Timed out or broken: a late reply would answer the next user's command
+        redisFree(ctx);
+        return;
+    }
+    Node& node = *nodes_[shard];
+    std::lock_guard<std::mutex> lock(node.mtx);
+    node.pool.push_back(ctx);
 }
 
 RedisClient::~RedisClient() {
-    std::lock_guard<std::mutex> lock(mtx_);
-    for (auto c : pool_) {
-        redisFree(c);
+    for (auto& node : nodes_) {
+        std::lock_guard<std::mutex> lock(node->mtx);
+        for (auto c : node->pool) {
+            redisFree(c);
+        }
+        node->pool.clear();
     }
-    pool_.clear();
+}
+
+std::vector<std::vector<size_t>> RedisClient::GroupByShard(const std::vector<std::string>& keys) const {
+    std::vector<std::vector<size_t>> groups(std::max<size_t>(nodes_.size(), 1));
+    for (size_t i = 0; i < keys.size(); ++i) {
+        groups[ShardOf(keys[i])].push_back(i);
+    }
+    return groups;
 }
 
 bool RedisClient::Set(const std::string& key, const std::string& value) {
-    RedisConn conn;
+    ScopedLatency timer(CommandLatency("SET"));
+    RedisConn conn(key);
     if (!conn.get()) return false;
     redisReply* reply = (redisReply*)redisCommand(conn.get(), "SET %s %s", key.c_str(), value.c_str());
     if (!reply) return false;
@@ -59,7 +167,8 @@ bool RedisClient::Set(const std::string& key, const std::string& value) {
 }
 
 bool RedisClient::SetEx(const std::string& key, const std::string& value, int seconds) {
-    RedisConn conn;
+    ScopedLatency timer(CommandLatency("SET"));
+    RedisConn conn(key);
     if (!conn.get()) return false;
     redisReply* reply = (redisReply*)redisCommand(conn.get(), "SET %s %s EX %d", key.c_str(), value.c_str(), seconds);
     bool ret = (reply && reply->type == REDIS_REPLY_STATUS && std::string(reply->str) == "OK");
@@ -68,25 +177,54 @@ bool RedisClient::SetEx(const std::string& key, const std::string& value, int se
 }
 
 std::vector<std::string> RedisClient::Keys(const std::string& pattern) {
+    ScopedLatency timer(CommandLatency("KEYS"));
     std::vector<std::string> result;
-    RedisConn conn;
-    if (!conn.get()) return result;
-    redisReply* reply = (redisReply*)redisCommand(conn.get(), "KEYS %s", pattern.c_str());
-    if (reply) {
-        if (reply->type == REDIS_REPLY_ARRAY) {
-            for (size_t i = 0; i < reply->elements; i++) {
-                if(reply->element[i]->str) {
-                    result.push_back(reply->element[i]->str);
+    for (size_t shard = 0; shard < nodes_.size(); ++shard) {
+        RedisConn conn(shard);
+        if (!conn.get()) continue;
+        redisReply* reply = (redisReply*)redisCommand(conn.get(), "KEYS %s", pattern.c_str());
+        if (reply) {
+            if (reply->type == REDIS_REPLY_ARRAY) {
+                for (size_t i = 0; i < reply->elements; i++) {
+                    if(reply->element[i]->str) {
+                        result.push_back(reply->element[i]->str);
+                    }
                 }
             }
+            freeReplyObject(reply);
         }
-        freeReplyObject(reply);
     }
     return result;
 }
 
+RedisReplyPtr RedisClient::Command(const std::vector<std::string>& argv) {
+    if (argv.empty()) return nullptr;
+    ScopedLatency timer(CommandLatency(InternCommand(argv[0])));
+    // EVAL/EVALSHA script numkeys key...; everything else: command key ...
+    size_t shard = 0;
+    std::string cmd = argv[0];
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    if (cmd == "EVAL" || cmd == "EVALSHA") {
+        if (argv.size() > 3 && argv[2] != "0") shard = ShardOf(argv[3]);
+    } else if (argv.size() > 1) {
+        shard = ShardOf(argv[1]);
+    }
+    RedisConn conn(shard);
+    if (!conn.get()) return nullptr;
+    std::vector<const char*> args;
+    std::vector<size_t> lens;
+    for (const auto& a : argv) {
+        args.push_back(a.data());
+        lens.push_back(a.size());
+    }
+    RedisReplyPtr reply((redisReply*)redisCommandArgv(conn.get(), (int)args.size(), args.data(), lens.data()));
+    if (!reply) conn.Discard();
+    return reply;
+}
+
 std::string RedisClient::Get(const std::string& key) {
-    RedisConn conn;
+    ScopedLatency timer(CommandLatency("GET"));
+    RedisConn conn(key);
     if (!conn.get()) return "";
     redisReply* reply = (redisReply*)redisCommand(conn.get(), "GET %s", key.c_str());
     if (!reply) return "";
@@ -99,7 +237,8 @@ std::string RedisClient::Get(const std::string& key) {
 }
 
 bool RedisClient::Del(const std::string& key) {
-    RedisConn conn;
+    ScopedLatency timer(CommandLatency("DEL"));
+    RedisConn conn(key);
     if (!conn.get()) return false;
     redisReply* reply = (redisReply*)redisCommand(conn.get(), "DEL %s", key.c_str());
     if (!reply) return false;
@@ -108,7 +247,8 @@ bool RedisClient::Del(const std::string& key) {
 }
 
 bool RedisClient::Exists(const std::string& key) {
-    RedisConn conn;
+    ScopedLatency timer(CommandLatency("EXISTS"));
+    RedisConn conn(key);
     if (!conn.get()) return false;
     redisReply* reply = (redisReply*)redisCommand(conn.get(), "EXISTS %s", key.c_str());
     bool exists = false;
@@ -120,7 +260,8 @@ bool RedisClient::Exists(const std::string& key) {
 }
 
 bool RedisClient::Expire(const std::string& key, int seconds) {
-    RedisConn conn;
+    ScopedLatency timer(CommandLatency("EXPIRE"));
+    RedisConn conn(key);
     if (!conn.get()) return false;
     redisReply* reply = (redisReply*)redisCommand(conn.get(), "EXPIRE %s %d", key.c_str(), seconds);
     freeReplyObject(reply);
@@ -128,7 +269,8 @@ bool RedisClient::Expire(const std::string& key, int seconds) {
 }
 
 bool RedisClient::HSet(const std::string& key, const std::string& field, const std::string& value) {
-    RedisConn conn;
+    ScopedLatency timer(CommandLatency("HSET"));
+    RedisConn conn(key);
     if (!conn.get()) return false;
     redisReply* reply = (redisReply*)redisCommand(conn.get(), "HSET %s %s %s", key.c_str(), field.c_str(), value.c_str());
     if (!reply) return false;
@@ -137,7 +279,8 @@ bool RedisClient::HSet(const std::string& key, const std::string& field, const s
 }
 
 std::string RedisClient::HGet(const std::string& key, const std::string& field) {
-    RedisConn conn;
+    ScopedLatency timer(CommandLatency("HGET"));
+    RedisConn conn(key);
     if (!conn.get()) return "";
     redisReply* reply = (redisReply*)redisCommand(conn.get(), "HGET %s %s", key.c_str(), field.c_str());
     if (!reply) return "";
@@ -150,7 +293,8 @@ std::string RedisClient::HGet(const std::string& key, const std::string& field)
 }
 
 bool RedisClient::HDel(const std::string& key, const std::string& field) {
-    RedisConn conn;
+    ScopedLatency timer(CommandLatency("HDEL"));
+    RedisConn conn(key);
     if (!conn.get()) return false;
     redisReply* reply = (redisReply*)redisCommand(conn.get(), "HDEL %s %s", key.c_str(), field.c_str());
     if (!reply) return false;
@@ -159,8 +303,9 @@ bool RedisClient::HDel(const std::string& key, const std::string& field) {
 }
 
 std::unordered_map<std::string, std::string> RedisClient::HGetAll(const std::string& key) {
+    ScopedLatency timer(CommandLatency("HGETALL"));
     std::unordered_map<std::string, std::string> res;
-    RedisConn conn;
+    RedisConn conn(key);
     if (!conn.get()) return res;
     redisReply* reply = (redisReply*)redisCommand(conn.get(), "HGETALL %s", key.c_str());
     if (reply) {
@@ -176,8 +321,226 @@ std::unordered_map<std::string, std::string> RedisClient::HGetAll(const std::str
     return res;
 }
 
+std::vector<std::unordered_map<std::string, std::string>> RedisClient::HGetAllBatch(const std::vector<std::string>& keys) {
+    std::vector<std::unordered_map<std::string, std::string>> res(keys.size());
+    if (keys.empty()) return res;
+
+    // One pipeline per node; flush them all before reading any, so the nodes work in parallel
+    auto groups = GroupByShard(keys);
+    std::vector<std::unique_ptr<RedisPipeline>> pipes(groups.size());
+    for (size_t shard = 0; shard < groups.size(); ++shard) {
+        if (groups[shard].empty()) continue;
+        pipes[shard] = std::make_unique<RedisPipeline>(shard);
+        if (!pipes[shard]->valid()) continue;
+        for (size_t k : groups[shard]) {
+            pipes[shard]->Append({"HGETALL", keys[k]});
+        }
+        pipes[shard]->Flush();
+    }
+
+    for (size_t shard = 0; shard < groups.size(); ++shard) {
+        if (!pipes[shard] || !pipes[shard]->valid()) continue;
+        auto replies = pipes[shard]->Exec();
+        for (size_t j = 0; j < replies.size(); ++j) {
+            redisReply* reply = replies[j].get();
+            if (!reply || reply->type != REDIS_REPLY_ARRAY) continue;
+            auto& out = res[groups[shard][j]];
+            for (size_t i = 0; i + 1 < reply->elements; i += 2) {
+                if (reply->element[i]->str && reply->element[i+1]->str) {
+                    out[reply->element[i]->str] = reply->element[i+1]->str;
+                }
+            }
+        }
+    }
+    return res;
+}
+
+// KEYS -> {INCR(KEYS[1]), INCR(KEYS[2]), ...}
+static const char* kIncrBatchScript =
+    "local r = {} "
+    "for i, k in ipairs(KEYS) do r[i] = redis.call('INCR', k) end "
+    "return r";
+
+static const char* kCompareAndSetBatchScript =
+    "local r = {} "
+    "for i, k in ipairs(KEYS) do "
+    "  local cur = tonumber(redis.call('GET', k) or '0') "
+    "  if cur == tonumber(ARGV[2 * i - 1]) then "
+    "    redis.call('SET', k, ARGV[2 * i]) r[i] = 1 "
+    "  else r[i] = 0 end "
+    "end "
+    "return r";
+
+std::vector<long long> RedisClient::IncrBatch(const std::vector<std::string>& keys) {
+    return EvalBatch(kIncrBatchScript, &Node::incr_script_sha, keys, {});
+}
+
+std::vector<bool> RedisClient::CompareAndSetBatch(const std::vector<std::string>& keys,
+                                                  const std::vector<long long>& expected,
+                                                  const std::vector<long long>& desired) {
+    if (keys.size() != expected.size() || keys.size() != desired.size()) return {};
+
+    // ARGV holds (expected, desired) pairs, two per key
+    std::vector<std::string> args;
+    args.reserve(keys.size() * 2);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        args.push_back(std::to_string(expected[i]));
+        args.push_back(std::to_string(desired[i]));
+    }
+    auto swapped = EvalBatch(kCompareAndSetBatchScript, &Node::cas_script_sha, keys, args);
+    return std::vector<bool>(swapped.begin(), swapped.end());
+}
+
+std::vector<long long> RedisClient::EvalBatch(const char* script, std::string Node::*sha_slot,
+                                              const std::vector<std::string>& keys,
+                                              const std::vector<std::string>& args) {
+    std::vector<long long> res;
+    if (keys.empty()) return res;
+
+    // ARGV values per key (args is either empty or a whole multiple of keys)
+    size_t per_key = args.size() / keys.size();
+
+    // One EVALSHA per chunk of a node's keys; idx lists the keys (indexes into keys)
+    auto build = [&](const std::string& cmd, const std::string& body,
+                     const std::vector<size_t>& idx, size_t begin) {
+        size_t end = std::min(idx.size(), begin + kIncrBatchChunk);
+        std::vector<std::string> argv;
+        argv.reserve((end - begin) * (1 + per_key) + 3);
+        argv.push_back(cmd);
+        argv.push_back(body);
+        argv.push_back(std::to_string(end - begin));
+        for (size_t i = begin; i < end; ++i) argv.push_back(keys[idx[i]]);
+        for (size_t i = begin; i < end; ++i) {
+            argv.insert(argv.end(), args.begin() + idx[i] * per_key, args.begin() + (idx[i] + 1) * per_key);
+        }
+        return argv;
+    };
+
+    auto groups = GroupByShard(keys);
+
+    // Script caches are per node. Load every SHA before the first pipeline is
+    // flushed, so a failure here leaves no replies pending on any connection.
+    std::vector<std::string> shas(groups.size());
+    for (size_t shard = 0; shard < groups.size(); ++shard) {
+        if (groups[shard].empty()) continue;
+        Node& node = *nodes_[shard];
+        {
+            std::lock_guard<std::mutex> lock(node.mtx);
+            shas[shard] = node.*sha_slot;
+        }
+        if (!shas[shard].empty()) continue;
+        RedisConn conn(shard);
+        if (!conn.get()) return {};
+        RedisReplyPtr reply((redisReply*)redisCommand(conn.get(), "SCRIPT LOAD %s", script));
+        if (!reply || reply->type != REDIS_REPLY_STRING) {
+            spdlog::error("EvalBatch: SCRIPT LOAD failed on {}:{}", node.host, node.port);
+            if (!reply) conn.Discard();
+            return {};
+        }
+        shas[shard] = reply->str;
+        std::lock_guard<std::mutex> lock(node.mtx);
+        node.*sha_slot = shas[shard];
+    }
+
+    std::vector<std::unique_ptr<RedisPipeline>> pipes(groups.size());
+    std::vector<size_t> chunks(groups.size(), 0);
+    bool ok = true;
+    for (size_t shard = 0; shard < groups.size(); ++shard) {
+        if (groups[shard].empty()) continue;
+        auto pipe = std::make_unique<RedisPipeline>(shard);
+        // No connection: stop sending, but still drain the pipelines already flushed below
+        if (!pipe->valid()) { ok = false; break; }
+        for (size_t begin = 0; begin < groups[shard].size(); begin += kIncrBatchChunk) {
+            pipe->Append(build("EVALSHA", shas[shard], groups[shard], begin));
+            ++chunks[shard];
+        }
+        pipe->Flush();
+        pipes[shard] = std::move(pipe);
+    }
+
+    res.resize(keys.size());
+    for (size_t shard = 0; shard < groups.size(); ++shard) {
+        if (!pipes[shard]) continue;
+        // Read every pipeline even after a failure: unread replies would poison the pool
+        auto replies = pipes[shard]->Exec();
+        // A failed Flush drops the connection and its queued commands
+        if (replies.size() != chunks[shard]) ok = false;
+        for (size_t c = 0; ok && c < replies.size(); ++c) {
+            RedisReplyPtr& reply = replies[c];
+            size_t begin = c * kIncrBatchChunk;
+            if (reply && reply->type == REDIS_REPLY_ERROR && std::string(reply->str).rfind("NOSCRIPT", 0) == 0) {
+                // Script cache flushed (restart / failover): send the body once, EVAL caches it again
+                RedisPipeline retry(shard);
+                if (!retry.valid()) { ok = false; break; }
+                retry.Append(build("EVAL", script, groups[shard], begin));
+                auto again = retry.Exec();
+                if (again.size() != 1) { ok = false; break; }
+                reply = std::move(again[0]);
+            }
+            if (!reply || reply->type != REDIS_REPLY_ARRAY) {
+                spdlog::error("EvalBatch failed: {}", reply && reply->str ? reply->str : "connection error");
+                ok = false;
+                break;
+            }
+            for (size_t i = 0; i < reply->elements && begin + i < groups[shard].size(); ++i) {
+                res[groups[shard][begin + i]] = reply->element[i]->integer;
+            }
+        }
+    }
+    if (!ok) return {};
+    return res;
+}
+
+void RedisPipeline::Append(const std::vector<std::string>& argv) {
+    if (!conn_.get()) return;
+    std::vector<const char*> args;
+    std::vector<size_t> lens;
+    args.reserve(argv.size());
+    lens.reserve(argv.size());
+    for (const auto& a : argv) {
+        args.push_back(a.data());
+        lens.push_back(a.size());
+    }
+    if (redisAppendCommandArgv(conn_.get(), (int)args.size(), args.data(), lens.data()) == REDIS_OK) {
+        ++pending_;
+    }
+}
+
+bool RedisPipeline::Flush() {
+    if (!conn_.get()) return false;
+    int done = 0;
+    while (!done) {
+        if (redisBufferWrite(conn_.get(), &done) != REDIS_OK) {
+            spdlog::error("Redis pipeline error: {}", conn_.get()->errstr);
+            conn_.Discard();
+            pending_ = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<RedisReplyPtr> RedisPipeline::Exec() {
+    ScopedLatency timer(CommandLatency("PIPELINE"));
+    std::vector<RedisReplyPtr> replies(pending_);
+    // The first redisGetReply flushes the whole output buffer
+    for (size_t i = 0; i < pending_; ++i) {
+        void* r = nullptr;
+        if (redisGetReply(conn_.get(), &r) != REDIS_OK) {
+            spdlog::error("Redis pipeline error: {}", conn_.get()->errstr);
+            // Unread replies would be handed to the next user: drop the context
+            conn_.Discard();
+            break;
+        }
+        replies[i].reset((redisReply*)r);
+    }
+    pending_ = 0;
+    return replies;
+}
+
 bool RedisClient::Publish(const std::string& channel, const std::string& message) {
-    RedisConn conn;
+    ScopedLatency timer(CommandLatency("PUBLISH"));
+    RedisConn conn(channel);
     if (!conn.get()) return false;
     redisReply* reply = (redisReply*)redisCommand(conn.get(), "PUBLISH %s %s", channel.c_str(), message.c_str());
     if (!reply) return false;
@@ -187,9 +550,14 @@ bool RedisClient::Publish(const std::string& channel, const std::string& message
 
 void RedisClient::Subscribe(const std::string& channel, std::function<void(const std::string&)> callback) {
     // Need a raw connection that is NOT returned to the pool because it enters subscribe mode
-    redisContext* ctx = redisConnect(host_.c_str(), port_);
+    if (nodes_.empty()) return;
+    const Node& node = *nodes_[ShardOf(channel)];
+    // Connect timeout only: the subscription waits for messages indefinitely
+    struct timeval connect_timeout = {kConnectTimeoutMs / 1000, (kConnectTimeoutMs % 1000) * 1000};
+    redisContext* ctx = redisConnectWithTimeout(node.host.c_str(), node.port, connect_timeout);
     if (!ctx || ctx->err) {
-        spdlog::error("Subscribe connect failed");
+        spdlog::error("Subscribe connect failed ({}:{})", node.host, node.port);
+        if (ctx) redisFree(ctx);
         return;
     }
     
@@ -2,16 +2,64 @@
 
 #include <hiredis/hiredis.h>
 #include <string>
+#include <string_view>
 #include <mutex>
 #include <memory>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <utility>
+#include <cstdint>
 #include <spdlog/spdlog.h>
 
+// Owned reply, freed with freeReplyObject
+struct RedisReplyDeleter {
+    void operator()(redisReply* r) const { if (r) freeReplyObject(r); }
+};
+using RedisReplyPtr = std::unique_ptr<redisReply, RedisReplyDeleter>;
+
+// Consistent-hash ring over Redis nodes. Each node owns kVirtualNodes points on
+// a 32-bit ring and a key belongs to the node of the first point at or after
+// its hash, so adding or removing one of N nodes moves about 1/N of the keys.
+// As in Redis Cluster, only the part of a key inside the first non-empty {...}
+// is hashed: keys sharing a hash tag always land on the same node.
+class RedisRing {
+public:
+    static constexpr int kVirtualNodes = 160;
+
+    // nodes are "host:port"; the order does not matter
+    explicit RedisRing(const std::vector<std::string>& nodes = {});
+
+    // Index into the nodes passed in; 0 for an empty ring
+    size_t NodeOf(std::string_view key) const;
+    size_t size() const { return nodes_.size(); }
+
+    // Hash of the key's hash tag (or of the whole key without one)
+    static uint32_t Hash(std::string_view key);
+
+private:
+    std::vector<std::string> nodes_;
+    std::vector<std::pair<uint32_t, uint32_t>> points_; // (hash, node), sorted by hash
+};
+
+// Parses "host:port" (port defaults to 6379)
+std::pair<std::string, int> ParseRedisNode(const std::string& node);
+
 class RedisClient {
 public:
     static RedisClient& GetInstance();
 
     void Init(const std::string& host, int port);
-    
+    // Sharded: keys are spread over the nodes ("host:port") by a RedisRing.
+    // Every process must list the same nodes. Multi-key operations are split
+    // per node; keys one Lua script or EVAL touches together must share a hash tag.
+    // Call once per process, before any other thread uses the client: later
+    // calls are logged and ignored.
+    void Init(const std::vector<std::string>& nodes);
+
+    const std::vector<std::string>& nodes() const { return node_addrs_; }
+    size_t ShardOf(const std::string& key) const { return ring_.NodeOf(key); }
+
     // Basic operations
     bool Set(const std::string& key, const std::string& value);
     std::string Get(const std::string& key);
@@ -19,15 +67,34 @@ public:
     bool Exists(const std::string& key);
     bool Expire(const std::string& key, int seconds);
     bool SetEx(const std::string& key, const std::string& value, int seconds);
+    // Runs on every node
     std::vector<std::string> Keys(const std::string& pattern);
+    // Arbitrary command, binary-safe arguments, sent to the node of its first key
+    // (argv[1], or the first key of EVAL/EVALSHA). nullptr on connection error.
+    RedisReplyPtr Command(const std::vector<std::string>& argv);
 
     // Hash operations
     bool HSet(const std::string& key, const std::string& field, const std::string& value);
     std::string HGet(const std::string& key, const std::string& field);
     bool HDel(const std::string& key, const std::string& field);
     std::unordered_map<std::string, std::string> HGetAll(const std::string& key);
+    // HGETALL for many keys: one pipeline per node, all in flight at once;
+    // result[i] belongs to keys[i]
+    std::vector<std::unordered_map<std::string, std::string>> HGetAllBatch(const std::vector<std::string>& keys);
 
-    // Pub/Sub
+    // Sequence allocation: INCR every key server-side in a Lua script, one round trip
+    // per kIncrBatchChunk keys of a node (chunks are pipelined, nodes run concurrently).
+    // result[i] is the new value of keys[i]; empty on failure.
+    std::vector<long long> IncrBatch(const std::vector<std::string>& keys);
+
+    // Atomic per-key compare-and-set, batched like IncrBatch: keys[i] is set to
+    // desired[i] only if it currently holds expected[i] (a missing key holds 0).
+    // result[i] is true where the swap happened; empty on failure.
+    std::vector<bool> CompareAndSetBatch(const std::vector<std::string>& keys,
+                                         const std::vector<long long>& expected,
+                                         const std::vector<long long>& desired);
+
+    // Pub/Sub: a channel lives on the node its name hashes to
     bool Publish(const std::string& channel, const std::string& message);
     // Note: Subscribe blocks the thread. Callback will be called on message.
     void Subscribe(const std::string& channel, std::function<void(const std::string& msg)> callback);
@@ -35,31 +102,88 @@ public:
     // List operations (for offline msgs queue if needed, though we use DB for persistence)
     // Using Redis for Online Status mainly. Key: "user_status:<uid>" -> "server_id" or "online"
 
-    redisContext* GetContext(); // For advanced raw usage
-    void ReleaseContext(redisContext* ctx); // If we implemented a pool, but for now single or thread-local?
-    // Hiredis context is not thread-safe. We need a pool or thread-local.
-    // Simplifying: Simple pool logic similar to DB, or just short-lived connections for low concurrency dev, 
-    // OR one connection per thread. Using a mutex-protected single connection is SLOW but safe.
-    // Let's implement a simple pool of contexts.
+    // Pooled connection to one node (see RedisConn)
+    redisContext* GetContext(size_t shard);
+    void ReleaseContext(size_t shard, redisContext* ctx);
+
+    // Redis blocks while a script runs: cap the keys per call so a large group
+    // cannot stall other clients
+    static constexpr size_t kIncrBatchChunk = 256;
+
+    // Pooled connections give up connecting after kConnectTimeoutMs and waiting for
+    // a reply after kCommandTimeoutMs: an unreachable node fails the call like a lost
+    // connection instead of stalling the caller (e.g. the registry heartbeat)
+    static constexpr int kConnectTimeoutMs = 1000;
+    static constexpr int kCommandTimeoutMs = 2000;
 
 private:
     RedisClient() = default;
     ~RedisClient();
-    
-    std::string host_;
-    int port_;
-    
-    // Simple pool
-    std::mutex mtx_;
-    std::vector<redisContext*> pool_;
+
+    struct Node {
+        std::string host;
+        int port;
+        // Simple pool
+        std::mutex mtx;
+        std::vector<redisContext*> pool;
+        // SHA1s of the batch scripts, loaded lazily: script caches are per node (guarded by mtx)
+        std::string incr_script_sha;
+        std::string cas_script_sha;
+    };
+
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::vector<std::string> node_addrs_;
+    RedisRing ring_;
+
+    // keys[i] grouped by node: result[n] lists the indexes of node n's keys
+    std::vector<std::vector<size_t>> GroupByShard(const std::vector<std::string>& keys) const;
+
+    // Runs script once per kIncrBatchChunk keys of a node, all chunks of a node
+    // pipelined and all nodes in flight together (EVALSHA, EVAL on NOSCRIPT). Each
+    // call gets its keys and the matching slice of args as ARGV; the integer each
+    // key gets back is returned at that key's index. Empty on failure.
+    std::vector<long long> EvalBatch(const char* script, std::string Node::*sha,
+                                     const std::vector<std::string>& keys,
+                                     const std::vector<std::string>& args);
 };
 
 // RAII
 class RedisConn {
 public:
-    RedisConn() { ctx_ = RedisClient::GetInstance().GetContext(); }
-    ~RedisConn() { if (ctx_) RedisClient::GetInstance().ReleaseContext(ctx_); }
+    // Node 0: commands without a key
+    RedisConn() : RedisConn(size_t{0}) {}
+    // The node that owns key
+    explicit RedisConn(const std::string& key) : RedisConn(RedisClient::GetInstance().ShardOf(key)) {}
+    explicit RedisConn(size_t shard) : shard_(shard) { ctx_ = RedisClient::GetInstance().GetContext(shard_); }
+    ~RedisConn() { if (ctx_) RedisClient::GetInstance().ReleaseContext(shard_, ctx_); }
+    RedisConn(const RedisConn&) = delete;
+    RedisConn& operator=(const RedisConn&) = delete;
     redisContext* get() { return ctx_; }
+    // Drop a broken context instead of returning it to the pool
+    void Discard() { if (ctx_) { redisFree(ctx_); ctx_ = nullptr; } }
 private:
+    size_t shard_;
     redisContext* ctx_;
 };
+
+// Pipelining: queue commands in the context's output buffer with Append, then
+// Exec flushes them in one write and reads all replies back in order.
+// Usage:
+//   RedisPipeline p(RedisClient::GetInstance().ShardOf("a"));
+//   p.Append({"INCR", "a"}); p.Append({"INCR", "b"});
+//   auto replies = p.Exec(); // replies[i] answers the i-th Append, nullptr on I/O error
+// All commands go to one node. To overlap several nodes, Flush each pipeline
+// before Exec-ing any of them.
+class RedisPipeline {
+public:
+    explicit RedisPipeline(size_t shard = 0) : conn_(shard) {}
+    bool valid() { return conn_.get() != nullptr; }
+    void Append(const std::vector<std::string>& argv);
+    // Writes the queued commands without waiting for replies
+    bool Flush();
+    std::vector<RedisReplyPtr> Exec();
+    size_t size() const { return pending_; }
+private:
+    RedisConn conn_;
+    size_t pending_ = 0;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/support/server_interceptor.h>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "metrics.h"
+
+// Server interceptor recording every RPC's latency per method
+// (tinyim_rpc_server_seconds{method="/tinyim.chat.ChatService/SendMessage"}),
+// from its initial metadata arriving to its status being sent, plus failures.
+// Install with AddRpcMetrics(builder) before BuildAndStart.
+class RpcMetricsInterceptor : public grpc::experimental::Interceptor {
+public:
+    explicit RpcMetricsInterceptor(grpc::experimental::ServerRpcInfo* info) : method_(info->method()) {}
+
+    void Intercept(grpc::experimental::InterceptorBatchMethods* methods) override {
+        using grpc::experimental::InterceptionHookPoints;
+        if (methods->QueryInterceptionHookPoint(InterceptionHookPoints::POST_RECV_INITIAL_METADATA)) {
+            start_ = std::chrono::steady_clock::now();
+        }
+        if (methods->QueryInterceptionHookPoint(InterceptionHookPoints::PRE_SEND_STATUS)) {
+            static HistogramFamily latency("tinyim_rpc_server_seconds", "Server RPC latency by method", "method");
+            latency.With(method_).Record(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start_).count());
+            if (!methods->GetSendStatus().ok()) {
+                static CounterFamily errors("tinyim_rpc_server_errors_total",
+                                            "Server RPCs that returned a non-OK status", "method");
+                errors.With(method_).Inc();
+            }
+        }
+        methods->Proceed();
+    }
+
+private:
+    const char* method_; // Owned by the server, lives as long as it
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+};
+
+class RpcMetricsInterceptorFactory : public grpc::experimental::ServerInterceptorFactoryInterface {
+public:
+    grpc::experimental::Interceptor* CreateServerInterceptor(grpc::experimental::ServerRpcInfo* info) override {
+        return new RpcMetricsInterceptor(info);
+    }
+};
+
+inline void AddRpcMetrics(grpc::ServerBuilder& builder) {
+    std::vector<std::unique_ptr<grpc::experimental::ServerInterceptorFactoryInterface>> creators;
+    creators.push_back(std::make_unique<RpcMetricsInterceptorFactory>());
+    builder.experimental().SetInterceptorCreators(std::move(creators));
+}
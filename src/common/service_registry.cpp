@@ -1,7 +1,27 @@
 #include "service_registry.h"
 #include "redis_client.h"
 #include <spdlog/spdlog.h>
+#include <algorithm>
 #include <chrono>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+
+// Node id lease TTL; renewed every heartbeat (3s)
+static constexpr int kNodeLeaseTtlSec = 30;
+// A lease is trusted for TTL minus this, counted from before the command that set
+// it was sent: covers clock rate differences between this host and Redis
+static constexpr int kNodeLeaseMarginSec = 5;
+
+static std::chrono::steady_clock::time_point LeaseDeadline(std::chrono::steady_clock::time_point sent) {
+    return sent + std::chrono::seconds(kNodeLeaseTtlSec - kNodeLeaseMarginSec);
+}
+
+// Registry scores are wall-clock expiries, comparable across hosts
+static int64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
 
 ServiceRegistry& ServiceRegistry::GetInstance() {
     static ServiceRegistry instance;
@@ -16,8 +36,99 @@ ServiceRegistry::ServiceRegistry() {
 
 ServiceRegistry::~ServiceRegistry() {
     running_ = false;
+    {
+        std::lock_guard<std::mutex> lock(obs_mtx_);
+        obs_cv_.notify_all();
+    }
     if (heartbeat_thread_.joinable()) heartbeat_thread_.join();
     if (polling_thread_.joinable()) polling_thread_.join();
+
+    // Clean shutdown: leave now rather than when the entry expires
+    if (is_registered_) {
+        std::string addr = current_ip_ + ":" + std::to_string(current_port_);
+        RedisClient::GetInstance().Command({"ZREM", RegistryKey(current_service_name_), addr});
+        RedisClient::GetInstance().Command({"HDEL", LoadKey(current_service_name_), addr});
+        RedisClient::GetInstance().Publish(kChangeChannel, current_service_name_);
+    }
+}
+
+double ServiceLoad::Cost() const {
+    double backlog = sessions + write_queue_bytes / 65536.0 + 1;
+    return backlog / std::max(0.05, 1.0 - cpu);
+}
+
+std::string ServiceRegistry::RegistryKey(const std::string& service_name) {
+    return "im:service:{" + service_name + "}";
+}
+
+std::string ServiceRegistry::LoadKey(const std::string& service_name) {
+    return "im:service:{" + service_name + "}:load";
+}
+
+// Load hash value: "<sessions> <write_queue_bytes> <cpu>"
+static std::string FormatLoad(const ServiceLoad& load) {
+    return std::to_string(load.sessions) + " " + std::to_string(load.write_queue_bytes) + " " +
+           std::to_string(load.cpu);
+}
+
+static bool ParseLoad(const std::string& value, ServiceLoad& load) {
+    std::istringstream in(value);
+    return static_cast<bool>(in >> load.sessions >> load.write_queue_bytes >> load.cpu);
+}
+
+bool ServiceRegistry::Lookup(const std::string& service_name, std::vector<ServiceInstance>& instances) {
+    std::string key = RegistryKey(service_name);
+    RedisPipeline pipe(RedisClient::GetInstance().ShardOf(key));
+    if (!pipe.valid()) return false;
+    pipe.Append({"ZRANGEBYSCORE", key, std::to_string(NowMs()), "+inf"});
+    pipe.Append({"HGETALL", LoadKey(service_name)});
+    auto replies = pipe.Exec();
+    if (replies.size() != 2 || !replies[0] || replies[0]->type != REDIS_REPLY_ARRAY) return false;
+
+    std::unordered_map<std::string, std::string> loads;
+    redisReply* load_reply = replies[1].get();
+    if (load_reply && load_reply->type == REDIS_REPLY_ARRAY) {
+        for (size_t i = 0; i + 1 < load_reply->elements; i += 2) {
+            if (load_reply->element[i]->str && load_reply->element[i+1]->str) {
+                loads[load_reply->element[i]->str] = load_reply->element[i+1]->str;
+            }
+        }
+    }
+
+    instances.clear();
+    redisReply* members = replies[0].get();
+    for (size_t i = 0; i < members->elements; ++i) {
+        if (!members->element[i]->str) continue;
+        ServiceInstance inst;
+        inst.addr.assign(members->element[i]->str, members->element[i]->len);
+        auto it = loads.find(inst.addr);
+        if (it != loads.end()) inst.has_load = ParseLoad(it->second, inst.load);
+        instances.push_back(std::move(inst));
+    }
+    return true;
+}
+
+int ServiceRegistry::PickInstance(const std::vector<ServiceInstance>& instances) {
+    if (instances.empty()) return -1;
+    if (instances.size() == 1) return 0;
+    thread_local std::mt19937 gen(std::random_device{}());
+    std::uniform_int_distribution<size_t> dis(0, instances.size() - 1);
+    size_t a = dis(gen);
+    size_t b = dis(gen);
+    if (a == b) b = (b + 1) % instances.size();
+    const auto& x = instances[a];
+    const auto& y = instances[b];
+    if (!x.has_load || !y.has_load) return static_cast<int>(a);
+    return static_cast<int>(x.load.Cost() <= y.load.Cost() ? a : b);
+}
+
+void ServiceRegistry::WatchChanges(std::function<void(const std::string&)> on_change) {
+    while (true) {
+        RedisClient::GetInstance().Subscribe(kChangeChannel, on_change);
+        // Events sent while we were away are lost: callers' periodic refresh covers them
+        spdlog::warn("ServiceRegistry: change listener lost its connection, resubscribing");
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
 }
 
 void ServiceRegistry::Observe(const std::string& service_name) {
@@ -25,7 +136,22 @@ void ServiceRegistry::Observe(const std::string& service_name) {
     // Check duplicate
     for(const auto& s : observed_services_) if(s == service_name) return;
     observed_services_.push_back(service_name);
+    changed_.insert(service_name); // First refresh right away
+    obs_cv_.notify_one();
     spdlog::info("ServiceRegistry: Observing service type '{}'", service_name);
+
+    if (!watching_) {
+        watching_ = true;
+        // Blocks in SUBSCRIBE for the life of the process, like the gateway's kick listener
+        std::thread([this]() {
+            WatchChanges([this](const std::string& name) {
+                std::lock_guard<std::mutex> lock(obs_mtx_);
+                if (std::find(observed_services_.begin(), observed_services_.end(), name) == observed_services_.end()) return;
+                changed_.insert(name);
+                obs_cv_.notify_one();
+            });
+        }).detach();
+    }
 }
 
 void ServiceRegistry::Register(const std::string& service_name, const std::string& ip, int port) {
@@ -35,106 +161,198 @@ void ServiceRegistry::Register(const std::string& service_name, const std::strin
     is_registered_ = true;
     
     // Immediate register
-    std::string key = "im:service:" + service_name + ":" + ip + ":" + std::to_string(port);
-    std::string value = ip + ":" + std::to_string(port);
-    RedisClient::GetInstance().SetEx(key, value, 10); // 10s TTL
+    Announce();
     
-    spdlog::info("Registered service: {} -> {}", key, value);
+    spdlog::info("Registered service: {} -> {}:{}", RegistryKey(service_name), ip, port);
+}
+
+void ServiceRegistry::SetLoadReporter(std::function<ServiceLoad()> reporter) {
+    std::lock_guard<std::mutex> lock(load_mtx_);
+    load_reporter_ = std::move(reporter);
+}
+
+// Registers or renews ARGV[1] until ARGV[2], drops members (and their load) that
+// expired by ARGV[3], stores load ARGV[4] unless empty, keeps both keys for ARGV[5]
+// seconds. Returns how many members joined or left.
+static const char* kAnnounceScript =
+    "local changed = redis.call('ZADD', KEYS[1], ARGV[2], ARGV[1]) "
+    "local expired = redis.call('ZRANGEBYSCORE', KEYS[1], '-inf', ARGV[3]) "
+    "for _, m in ipairs(expired) do "
+    "  redis.call('ZREM', KEYS[1], m) redis.call('HDEL', KEYS[2], m) "
+    "end "
+    "if ARGV[4] ~= '' then redis.call('HSET', KEYS[2], ARGV[1], ARGV[4]) end "
+    "redis.call('EXPIRE', KEYS[1], ARGV[5]) redis.call('EXPIRE', KEYS[2], ARGV[5]) "
+    "return changed + #expired";
+
+void ServiceRegistry::Announce() {
+    std::string addr = current_ip_ + ":" + std::to_string(current_port_);
+    int64_t now = NowMs();
+
+    std::string load;
+    {
+        std::lock_guard<std::mutex> lock(load_mtx_);
+        if (load_reporter_) load = FormatLoad(load_reporter_());
+    }
+
+    // One script, so trimming and load updates stay consistent; the keys share a hash tag
+    auto reply = RedisClient::GetInstance().Command({"EVAL", kAnnounceScript, "2",
+        RegistryKey(current_service_name_), LoadKey(current_service_name_),
+        addr, std::to_string(now + kServiceTtlSec * 1000), std::to_string(now), load,
+        std::to_string(kServiceTtlSec * 6)});
+    if (!reply || reply->type != REDIS_REPLY_INTEGER) {
+        spdlog::error("ServiceRegistry: heartbeat for {} failed", current_service_name_);
+        return;
+    }
+    if (reply->integer > 0) RedisClient::GetInstance().Publish(kChangeChannel, current_service_name_);
 }
 
 void ServiceRegistry::HeartbeatLoop() {
     while (running_) {
         if (is_registered_) {
-            std::string key = "im:service:" + current_service_name_ + ":" + 
-                              current_ip_ + ":" + std::to_string(current_port_);
-            std::string value = current_ip_ + ":" + std::to_string(current_port_);
-            
             // Renew TTL
-            RedisClient::GetInstance().SetEx(key, value, 10);
+            Announce();
         }
+        RenewNodeLease();
         std::this_thread::sleep_for(std::chrono::seconds(3));
     }
 }
 
-void ServiceRegistry::PollingLoop() {
-    while (running_) {
-        RefreshCache();
-        std::this_thread::sleep_for(std::chrono::seconds(3));
+void ServiceRegistry::AcquireNodeId(const std::string& pool, int max_id, LeaseCallback on_lease) {
+    std::lock_guard<std::mutex> lock(lease_mtx_);
+    lease_pool_ = pool;
+    lease_max_id_ = max_id;
+    lease_on_change_ = std::move(on_lease);
+    if (lease_owner_.empty()) {
+        std::random_device rd;
+        lease_owner_ = current_ip_ + ":" + std::to_string(current_port_) + ":" +
+                       std::to_string(getpid()) + ":" + std::to_string(rd());
     }
+    auto sent = std::chrono::steady_clock::now();
+    lease_id_ = TryLeaseNodeId();
+    lease_valid_until_ = LeaseDeadline(sent);
+    if (lease_id_ < 0) spdlog::error("No free node id in pool '{}' (0..{})", pool, max_id);
+    else spdlog::info("Leased node id {} in pool '{}'", lease_id_, pool);
+    if (lease_on_change_) lease_on_change_(lease_id_, lease_valid_until_);
 }
 
-void ServiceRegistry::RefreshCache() {
-    std::vector<std::string> targets;
-    {
-        std::lock_guard<std::mutex> lock(obs_mtx_);
-        targets = observed_services_;
+void ServiceRegistry::ReleaseNodeId() {
+    std::lock_guard<std::mutex> lock(lease_mtx_);
+    if (lease_pool_.empty()) return;
+    if (lease_id_ >= 0) {
+        // Free the id for others at once, unless it is no longer ours
+        std::string key = "im:node:" + lease_pool_ + ":" + std::to_string(lease_id_);
+        RedisClient::GetInstance().Command({"EVAL",
+            "if redis.call('GET', KEYS[1]) == ARGV[1] then return redis.call('DEL', KEYS[1]) end return 0",
+            "1", key, lease_owner_});
+        spdlog::info("Released node id {} in pool '{}'", lease_id_, lease_pool_);
     }
+    lease_pool_.clear();
+    lease_id_ = -1;
+    lease_on_change_ = nullptr;
+}
 
-    if (targets.empty()) return;
+int ServiceRegistry::TryLeaseNodeId() {
+    // Start at a random id so restarting processes rarely collide on the same probe sequence
+    std::random_device rd;
+    int start = static_cast<int>(rd() % (lease_max_id_ + 1));
+    for (int i = 0; i <= lease_max_id_; ++i) {
+        int id = (start + i) % (lease_max_id_ + 1);
+        std::string key = "im:node:" + lease_pool_ + ":" + std::to_string(id);
+        auto reply = RedisClient::GetInstance().Command(
+            {"SET", key, lease_owner_, "NX", "EX", std::to_string(kNodeLeaseTtlSec)});
+        if (!reply) return -1; // Redis down: retry on next heartbeat
+        if (reply->type == REDIS_REPLY_STATUS) return id;
+    }
+    return -1;
+}
 
-    for (const auto& service_name : targets) {
-        std::string pattern = "im:service:" + service_name + ":*";
-        auto keys = RedisClient::GetInstance().Keys(pattern);
-        
-        std::vector<std::string> addresses;
-        for (const auto& key : keys) {
-            std::string val = RedisClient::GetInstance().Get(key);
-            if (!val.empty()) {
-                addresses.push_back(val);
-            }
+void ServiceRegistry::RenewNodeLease() {
+    std::lock_guard<std::mutex> lock(lease_mtx_);
+    if (lease_pool_.empty()) return;
+    int old_id = lease_id_;
+    // Before sending: the key's new TTL starts no earlier than this
+    auto sent = std::chrono::steady_clock::now();
+    bool renewed = false;
+    if (old_id >= 0) {
+        // Extend only while we still own the key
+        std::string key = "im:node:" + lease_pool_ + ":" + std::to_string(old_id);
+        auto reply = RedisClient::GetInstance().Command({"EVAL",
+            "if redis.call('GET', KEYS[1]) == ARGV[1] then return redis.call('EXPIRE', KEYS[1], ARGV[2]) end return 0",
+            "1", key, lease_owner_, std::to_string(kNodeLeaseTtlSec)});
+        if (reply && reply->type == REDIS_REPLY_INTEGER && reply->integer == 1) {
+            renewed = true;
+        } else if (!reply && std::chrono::steady_clock::now() < lease_valid_until_) {
+            // Redis unreachable, but the key cannot have expired yet: keep the id
+            // until its deadline, which the IdGenerator enforces on every use
+            return;
+        } else {
+            spdlog::error("Lost node id lease {} in pool '{}'", old_id, lease_pool_);
         }
+    }
+    if (!renewed) lease_id_ = TryLeaseNodeId();
+    if (lease_id_ >= 0) lease_valid_until_ = LeaseDeadline(sent);
+    if (lease_id_ != old_id) spdlog::warn("Node id in pool '{}' changed: {} -> {}", lease_pool_, old_id, lease_id_);
+    // Every renewal moves the deadline
+    if (lease_on_change_) lease_on_change_(lease_id_, lease_valid_until_);
+}
 
-        // Update Cache
+void ServiceRegistry::PollingLoop() {
+    auto next_poll = std::chrono::steady_clock::now();
+    while (running_) {
+        std::vector<std::string> targets;
         {
-            std::lock_guard<std::mutex> lock(cache_mtx_);
-            cache_[service_name] = addresses;
+            std::unique_lock<std::mutex> lock(obs_mtx_);
+            obs_cv_.wait_until(lock, next_poll, [this] { return !running_ || !changed_.empty(); });
+            if (!running_) break;
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next_poll) {
+                // Periodic pass: catches expiries, which nobody announces
+                targets = observed_services_;
+                next_poll = now + std::chrono::seconds(3);
+            } else {
+                targets.assign(changed_.begin(), changed_.end());
+            }
+            changed_.clear();
+        }
+        for (const auto& service_name : targets) {
+            RefreshCache(service_name);
         }
-        // spdlog::debug("Refreshed cache for {}, count: {}", service_name, addresses.size());
     }
 }
 
+void ServiceRegistry::RefreshCache(const std::string& service_name) {
+    std::vector<ServiceInstance> instances;
+    if (!Lookup(service_name, instances)) return; // Redis unreachable: keep the last known list
+    UpdateCache(service_name, std::move(instances));
+}
+
+void ServiceRegistry::UpdateCache(const std::string& service_name, std::vector<ServiceInstance> instances) {
+    std::lock_guard<std::mutex> lock(cache_mtx_);
+    auto next = std::make_shared<ServiceMap>(*cache_.Load());
+    (*next)[service_name] = std::move(instances);
+    cache_.Publish(std::move(next));
+}
+
 std::string ServiceRegistry::Discover(const std::string& service_name) {
-    std::vector<std::string> addresses;
-    {
-        std::lock_guard<std::mutex> lock(cache_mtx_);
-        if (cache_.count(service_name)) {
-            addresses = cache_[service_name];
-        }
+    // No lock and no copy of the map: this thread's view of the latest snapshot
+    auto cache = cache_.Get();
+    auto it = cache->find(service_name);
+    if (it != cache->end()) {
+        int idx = PickInstance(it->second);
+        if (idx >= 0) return it->second[idx].addr;
+        spdlog::warn("No service found for: {}", service_name);
+        return "";
     }
 
-    // Fallback: Direct Query if cache empty? 
-    // Or maybe we haven't Observed it yet.
-    // Ideally we should rely on cache if observed.
-    // If empty, let's try direct query once (for immediate effect) or just return empty.
-    
-    if (addresses.empty()) {
-        // Fallback for unobserved services
-        // ... (Old Logic) ...
-        std::string pattern = "im:service:" + service_name + ":*";
-        auto keys = RedisClient::GetInstance().Keys(pattern);
-        for(const auto& k : keys) {
-            std::string v = RedisClient::GetInstance().Get(k);
-            if(!v.empty()) addresses.push_back(v);
-        }
-    }
+    // First use: one lookup inline, then the polling thread keeps it fresh
+    std::vector<ServiceInstance> instances;
+    if (Lookup(service_name, instances)) UpdateCache(service_name, instances);
+    Observe(service_name);
     
-    if (addresses.empty()) {
+    int idx = PickInstance(instances);
+    if (idx < 0) {
         spdlog::warn("No service found for: {}", service_name);
         return "";
     }
-    
-    // Round Robin
-    std::lock_guard<std::mutex> lock(cache_mtx_);
-    int& idx = rr_index_[service_name];
-    if (idx >= addresses.size()) idx = 0;
-    
-    // Random or RR? User said "Lazy/Random". 
-    // Let's stick to RR for stability, or Random if preferred.
-    // User: "Login request picks mainly from local cache... Random select".
-    // Let's use Random for "Dispatch" style?
-    // Actually RR is fine. Let's keep RR logic.
-    std::string selected = addresses[idx];
-    idx = (idx + 1) % addresses.size();
-    
-    return selected;
+    return instances[idx].addr;
 }
@@ -5,37 +5,112 @@
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
 #include <unordered_map>
+#include <unordered_set>
+#include "snapshot.h"
 
+// Load an instance reports with its heartbeat (see SetLoadReporter)
+struct ServiceLoad {
+    int64_t sessions = 0;          // Open client connections
+    int64_t write_queue_bytes = 0; // Bytes waiting to be written to clients
+    double cpu = 0;                // Share of all cores busy, 0..1
+
+    // Lower is better: sessions, plus one per 64 KiB of backlog, scaled up as the CPU saturates
+    double Cost() const;
+};
+
+struct ServiceInstance {
+    std::string addr; // "ip:port"
+    ServiceLoad load;
+    bool has_load = false; // The instance reports no load
+};
+
+// Instances of a service live in one sorted set per service, im:service:{<name>},
+// member "ip:port" scored with its expiry (unix ms), and their last reported load
+// in the hash next to it. Heartbeats push the expiry forward and trim expired
+// members; instances joining or leaving are announced on kChangeChannel so
+// observers refresh at once instead of on their next poll.
 class ServiceRegistry {
 public:
     static ServiceRegistry& GetInstance();
 
+    static constexpr const char* kChangeChannel = "im:service:changed";
+    static constexpr int kServiceTtlSec = 10;
+
+    // Sorted set holding the instances of service_name, and the hash of their loads
+    // (same hash tag: one node, one script)
+    static std::string RegistryKey(const std::string& service_name);
+    static std::string LoadKey(const std::string& service_name);
+
+    // Live instances of a service and their loads in one round trip
+    // (ZRANGEBYSCORE + HGETALL), without starting the registry's threads.
+    // False if Redis could not be reached.
+    static bool Lookup(const std::string& service_name, std::vector<ServiceInstance>& instances);
+
+    // Power of two choices: the less loaded of two random instances. Close to
+    // least-connections, but stale loads cannot send every pick to the same
+    // instance. Random if either reports no load. Index into instances, -1 if empty.
+    static int PickInstance(const std::vector<ServiceInstance>& instances);
+
+    // Blocks the calling thread for good, calling on_change with the name of every
+    // service an instance joined or left; resubscribes after connection loss.
+    static void WatchChanges(std::function<void(const std::string& service_name)> on_change);
+
     // Register a service (Server Side)
     // service_name: e.g. "chat"
     // ip, port: e.g. "127.0.0.1", 50052
     void Register(const std::string& service_name, const std::string& ip, int port);
 
+    // Called by every heartbeat; its result is published with the registration
+    void SetLoadReporter(std::function<ServiceLoad()> reporter);
+
     // Discover a service (Client Side)
-    // Returns "ip:port" string. Empty if not found.
+    // Returns "ip:port" string (see PickInstance). Empty if not found.
+    // A service not observed yet is looked up once and observed from then on.
     std::string Discover(const std::string& service_name);
 
     // Start observing a service type for caching.
     // e.g. Observe("gateway")
     void Observe(const std::string& service_name);
 
+    // Lease a node id in [0, max_id] unique among the processes sharing `pool`
+    // (e.g. the IdGenerator node id of every chat server). The lease is a Redis key
+    // im:node:<pool>:<id> with a TTL, renewed by the heartbeat; if it is ever lost the
+    // heartbeat leases a new id. on_lease is called with the id now held (-1 while
+    // none is available) and the steady-clock time until which it is certainly still
+    // ours, first from inside this call and again after every renewal. Past that time
+    // the id must not be used. on_lease runs under the lease lock: it must not call
+    // back into AcquireNodeId/ReleaseNodeId.
+    using LeaseCallback = std::function<void(int id, std::chrono::steady_clock::time_point valid_until)>;
+    void AcquireNodeId(const std::string& pool, int max_id, LeaseCallback on_lease);
+
+    // Gives the id back and stops renewing it; on_lease is never called again once
+    // this returns
+    void ReleaseNodeId();
+
 private:
     ServiceRegistry();
     ~ServiceRegistry();
 
     void HeartbeatLoop();
-    void PollingLoop(); // Refreshes observers
-    void RefreshCache();
+    // Adds or renews this instance and its load, trims expired ones, announces
+    // membership changes
+    void Announce();
+    int TryLeaseNodeId(); // lease_mtx_ held
+    void RenewNodeLease();
+    void PollingLoop(); // Refreshes observers: on change events, else every 3s
+    void RefreshCache(const std::string& service_name);
 
     std::string current_service_name_;
     std::string current_ip_;
     int current_port_ = 0;
     bool is_registered_ = false;
+    std::function<ServiceLoad()> load_reporter_; // Guarded by load_mtx_
+    std::mutex load_mtx_;
 
     std::atomic<bool> running_{false};
     std::thread heartbeat_thread_;
@@ -43,12 +118,24 @@ private:
 
     // Observed services
     std::vector<std::string> observed_services_;
+    std::unordered_set<std::string> changed_; // Observed services with a pending change event
+    bool watching_ = false; // Change listener started
     std::mutex obs_mtx_;
+    std::condition_variable obs_cv_;
+
+    // Cache: service_name -> instances with their loads. Discover reads it without
+    // a lock; writers copy it, change one service and publish the copy.
+    using ServiceMap = std::unordered_map<std::string, std::vector<ServiceInstance>>;
+    Snapshot<ServiceMap> cache_;
+    std::mutex cache_mtx_; // Serializes writers
+    void UpdateCache(const std::string& service_name, std::vector<ServiceInstance> instances);
 
-    // Cache: service_name -> vector<address>
-    std::unordered_map<std::string, std::vector<std::string>> cache_;
-    std::mutex cache_mtx_;
-    
-    // Round-robin index: service_name -> index
-    std::unordered_map<std::string, int> rr_index_;
+    // Node id lease
+    std::mutex lease_mtx_;
+    std::string lease_pool_;
+    std::string lease_owner_; // Unique per process: value of the lease key
+    int lease_max_id_ = 0;
+    int lease_id_ = -1;
+    std::chrono::steady_clock::time_point lease_valid_until_;
+    LeaseCallback lease_on_change_;
 };
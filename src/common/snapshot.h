@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Read-mostly value published as immutable snapshots (RCU style).
+//
+// A writer builds a new T and Publish()es it; readers never block it and it
+// never blocks them. Get() is lock-free in the common case: each thread keeps
+// the snapshot it read last and only compares a version number before copying
+// its pointer. Only after a Publish does a thread fetch the new snapshot, under
+// the lock, once.
+//
+// Usage:
+//   Snapshot<std::vector<std::string>> list;
+//   list.Publish(std::make_shared<const std::vector<std::string>>(fresh));
+//   auto current = list.Get(); // Pinned for as long as current lives
+template<class T>
+class Snapshot {
+public:
+    Snapshot() : current_(std::make_shared<const T>()), version_(NextVersion()) {}
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    // The latest published value. The caller holds its own reference: later
+    // Gets and Publishes, on this thread or any other, cannot free it.
+    std::shared_ptr<const T> Get() const {
+        thread_local Cached cached;
+        uint64_t version = version_.load(std::memory_order_acquire);
+        if (cached.owner != this || cached.version != version) {
+            std::shared_ptr<const T> fresh;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                fresh = current_;
+            }
+            cached.owner = this;
+            cached.version = version;
+            cached.value = std::move(fresh);
+        }
+        return cached.value;
+    }
+
+    // The current snapshot itself, for publishers that copy and modify it
+    std::shared_ptr<const T> Load() const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return current_;
+    }
+
+    void Publish(std::shared_ptr<const T> value) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        current_ = std::move(value);
+        // Under the lock: concurrent publishers cannot leave an older version last
+        version_.store(NextVersion(), std::memory_order_release);
+    }
+
+private:
+    // Unique across all Snapshot<T>: a new one at a freed one's address cannot
+    // be mistaken for it by a thread's cache
+    static uint64_t NextVersion() {
+        static std::atomic<uint64_t> next{1};
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    struct Cached {
+        const Snapshot* owner = nullptr;
+        uint64_t version = 0;
+        std::shared_ptr<const T> value;
+    };
+
+    // Taken only by writers and by a reader's first Get after a Publish
+    mutable std::mutex mtx_;
+    std::shared_ptr<const T> current_;
+    std::atomic<uint64_t> version_;
+};
@@ -0,0 +1,80 @@
+#include "trace.h"
+#include <charconv>
+#include <chrono>
+#include "config.h"
+
+bool Trace::Enabled() {
+    static const bool enabled = Config::GetInstance().GetInt("trace.enabled", 1) != 0;
+    return enabled;
+}
+
+int64_t Trace::NowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static const char* const kStageNames[] = {
+    "gateway_recv", "chat_recv", "seq_alloc", "body_write", "index_write",
+    "commit", "push_issued", "push_recv", "push_delivered",
+};
+static_assert(sizeof(kStageNames) / sizeof(kStageNames[0]) == static_cast<size_t>(TraceStage::kCount));
+
+const char* Trace::StageName(TraceStage stage) {
+    return kStageNames[static_cast<int>(stage)];
+}
+
+std::string Trace::Encode() const {
+    std::string out;
+    for (int i = 0; i < static_cast<int>(TraceStage::kCount); ++i) {
+        if (at_[i] == 0) continue;
+        if (!out.empty()) out += ',';
+        out += kStageNames[i];
+        out += '=';
+        out += std::to_string(at_[i]);
+    }
+    return out;
+}
+
+Trace Trace::Decode(std::string_view value) {
+    Trace trace;
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view field = value.substr(0, comma);
+        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+
+        size_t eq = field.find('=');
+        if (eq == std::string_view::npos) return Trace();
+        std::string_view name = field.substr(0, eq);
+        int64_t us = 0;
+        auto [end, ec] = std::from_chars(field.data() + eq + 1, field.data() + field.size(), us);
+        if (ec != std::errc() || end != field.data() + field.size()) return Trace();
+
+        for (int i = 0; i < static_cast<int>(TraceStage::kCount); ++i) {
+            if (name == kStageNames[i]) {
+                trace.at_[i] = us;
+                break;
+            }
+        }
+    }
+    return trace;
+}
+
+TraceStats& TraceStats::GetInstance() {
+    static TraceStats instance;
+    return instance;
+}
+
+void TraceStats::Record(const Trace& trace, TraceStage first, TraceStage last) {
+    if (trace.empty()) return;
+    // Each stage is measured from the closest earlier stage that was reached
+    int64_t prev = trace.At(TraceStage::kGatewayRecv);
+    for (int i = 1; i <= static_cast<int>(last); ++i) {
+        int64_t at = trace.At(static_cast<TraceStage>(i));
+        if (at == 0) continue;
+        if (i >= static_cast<int>(first)) stages_[i].Record(at - prev);
+        prev = at;
+    }
+    if (last == TraceStage::kPushDelivered && trace.At(TraceStage::kPushDelivered) != 0) {
+        end_to_end_.Record(trace.At(TraceStage::kPushDelivered) - trace.At(TraceStage::kGatewayRecv));
+    }
+}
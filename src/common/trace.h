@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "latency_histogram.h"
+
+// Stages of one message on its way from sender to receiver, in order.
+// Each is a wall-clock timestamp taken in the process that reaches it.
+enum class TraceStage : int {
+    kGatewayRecv,    // Sender's gateway read the send request
+    kChatRecv,       // Chat server started SendMessage
+    kSeqAlloc,       // Recipients resolved and inbox seqs allocated
+    kBodyWrite,      // Message body row inserted (includes the group-commit window)
+    kIndexWrite,     // Inbox index / timeline rows inserted
+    kCommit,         // Transaction committed
+    kPushIssued,     // BatchPushNotify sent to the receivers' gateways
+    kPushRecv,       // Receiver's gateway got the push
+    kPushDelivered,  // Notify frame written to the receiver's socket
+    kCount
+};
+
+// Stage timestamps of one message, carried between services in the
+// "x-im-trace" gRPC metadata entry as "stage=us,stage=us,...".
+// The sender's gateway starts a trace, every hop marks its stages and forwards
+// it, and the receiver's gateway records the whole chain into TraceStats.
+class Trace {
+public:
+    static constexpr const char* kMetadataKey = "x-im-trace";
+
+    // trace.enabled (default on): whether gateways start traces
+    static bool Enabled();
+    // Wall clock, so stamps from different hosts compare (to clock skew)
+    static int64_t NowUs();
+    static const char* StageName(TraceStage stage);
+
+    void Mark(TraceStage stage) { Mark(stage, NowUs()); }
+    void Mark(TraceStage stage, int64_t us) { at_[static_cast<int>(stage)] = us; }
+    // 0 if the stage was not reached
+    int64_t At(TraceStage stage) const { return at_[static_cast<int>(stage)]; }
+    bool empty() const { return At(TraceStage::kGatewayRecv) == 0; }
+
+    std::string Encode() const;
+    // Unknown stages are skipped; an unparsable value yields an empty trace
+    static Trace Decode(std::string_view value);
+
+    // Reads the trace a caller attached; works with any gRPC server context
+    template <class ServerContext>
+    static Trace FromMetadata(const ServerContext& ctx) {
+        const auto& md = ctx.client_metadata();
+        auto it = md.find(kMetadataKey);
+        if (it == md.end()) return Trace();
+        return Decode(std::string_view(it->second.data(), it->second.size()));
+    }
+
+private:
+    std::array<int64_t, static_cast<size_t>(TraceStage::kCount)> at_{};
+};
+
+// Per-stage latency histograms, process-wide.
+// stage(s) holds the time from the previous reached stage to s, so when
+// end-to-end delivery regresses the stage that grew shows it directly.
+class TraceStats {
+public:
+    static TraceStats& GetInstance();
+
+    // Records the reached stages in [first, last]; reaching kPushDelivered
+    // also records end_to_end
+    void Record(const Trace& trace, TraceStage first, TraceStage last);
+
+    const LatencyHistogram& stage(TraceStage s) const { return stages_[static_cast<int>(s)]; }
+    // Gateway receive of the send -> push delivered to the receiver
+    const LatencyHistogram& end_to_end() const { return end_to_end_; }
+
+    // Round trips of the gateway's Send/Sync RPCs as seen by the client's gateway
+    LatencyHistogram& send_rpc() { return send_rpc_; }
+    LatencyHistogram& sync_rpc() { return sync_rpc_; }
+    const LatencyHistogram& send_rpc() const { return send_rpc_; }
+    const LatencyHistogram& sync_rpc() const { return sync_rpc_; }
+
+private:
+    TraceStats() = default;
+
+    std::array<LatencyHistogram, static_cast<size_t>(TraceStage::kCount)> stages_;
+    LatencyHistogram end_to_end_;
+    LatencyHistogram send_rpc_;
+    LatencyHistogram sync_rpc_;
+};
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
 #include <thread>
 #include "service_discovery.h"
 #include "config.h"
@@ -14,6 +15,7 @@
 #include <grpcpp/grpcpp.h>
 #include <nlohmann/json.hpp>
 #include "grpc_channel_pool.h"
+#include "metrics.h"
 #include <fstream>
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
@@ -28,7 +30,6 @@ std::string Auth(const std::string& username, const std::string& password, const
     // For MVP config.json
     // Use GRPCChannelPool!
     std::string auth_addr = Config::GetInstance().GetString("auth_service.addr", "127.0.0.1:50051");
-    auto start = std::chrono::high_resolution_clock::now();
     
     auto channel = GRPCChannelPool::GetInstance().GetChannel(auth_addr); // Uses Pool
     auto stub = AuthService::NewStub(channel);
@@ -137,7 +138,11 @@ private:
 
         std::string target = std::string(req_.target());
         
-        if (req_.method() == http::verb::post && target == "/api/login") {
+        if (req_.method() == http::verb::get && target == "/metrics") {
+            res_.set(http::field::content_type, "text/plain; version=0.0.4");
+            res_.body() = Metrics::GetInstance().Expose();
+        }
+        else if (req_.method() == http::verb::post && target == "/api/login") {
             try {
                 auto json = nlohmann::json::parse(req_.body());
                 std::string u = json.value("username", "");
@@ -149,7 +154,7 @@ private:
                 std::string token = Auth(u, p, d, uid, nick);
                 
                 if (!token.empty()) {
-                    std::string gw = ServiceDiscovery::GetInstance().GetRandomGateway();
+                    std::string gw = ServiceDiscovery::GetInstance().PickGateway();
                     if (gw.empty()) {
                         res_.result(http::status::service_unavailable);
                         res_.body() = R"({"error": "No gateways available"})";
@@ -200,7 +205,7 @@ private:
         }
         else if (req_.method() == http::verb::get && target == "/api/discover/chat") {
              try {
-                 std::string gw = ServiceDiscovery::GetInstance().GetRandomGateway();
+                 std::string gw = ServiceDiscovery::GetInstance().PickGateway();
                  if (gw.empty()) {
                       res_.result(http::status::service_unavailable);
                       res_.body() = R"({"error": "No gateways available"})";
@@ -285,22 +290,39 @@ int main(int argc, char* argv[]) {
     }
     
     // Init Redis for ServiceDiscovery
-    std::string redis_host = Config::GetInstance().GetString("redis.host", "127.0.0.1");
-    int redis_port = Config::GetInstance().GetInt("redis.port", 6379);
-    RedisClient::GetInstance().Init(redis_host, redis_port);
+    std::vector<std::string> redis_nodes = Config::GetInstance().GetStringList("redis.nodes");
+    if (!redis_nodes.empty()) {
+        RedisClient::GetInstance().Init(redis_nodes);
+    } else {
+        std::string redis_host = Config::GetInstance().GetString("redis.host", "127.0.0.1");
+        int redis_port = Config::GetInstance().GetInt("redis.port", 6379);
+        RedisClient::GetInstance().Init(redis_host, redis_port);
+    }
     
     // Start Service Discovery
     ServiceDiscovery::GetInstance().Start();
     
     int port = Config::GetInstance().GetInt("server.dispatch_port", 8000);
-    net::io_context ioc{1};
+    // Logins block on the Auth RPC: run one io thread per core by default.
+    // Each session has its own strand, so its handlers never run concurrently.
+    int threads = Config::GetInstance().GetInt("dispatch.io_threads", 0);
+    if (threads <= 0) {
+        int cores = static_cast<int>(std::thread::hardware_concurrency());
+        threads = cores > 0 ? cores : 4;
+    }
+    net::io_context ioc{threads};
     tcp::acceptor acceptor{ioc, {tcp::v4(), (unsigned short)port}};
     
-    spdlog::info("Dispatch Server listening on port {}", port);
+    spdlog::info("Dispatch Server listening on port {} ({} threads)", port, threads);
     
     DoAccept(acceptor, ioc);
     
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+        workers.emplace_back([&ioc]() { ioc.run(); });
+    }
     ioc.run();
+    for (auto& t : workers) t.join();
     
     return 0;
 }
@@ -8,10 +8,11 @@
 #include <random>
 #include <chrono>
 #include <algorithm>
+#include <condition_variable>
 #include "redis_client.h"
+#include "service_registry.h"
 #include "config.h"
-#include <shared_mutex>
-#include <mutex>
+#include "snapshot.h"
 #include <spdlog/spdlog.h>
 #include <ctime>
 
@@ -29,41 +30,57 @@ public:
         // Initial fetch
         UpdateGateways();
         
-        // Start background thread
+        // Start background thread: refresh on gateway join/leave events, and every
+        // interval to catch gateways whose registration expired
         refresh_thread_ = std::thread([this]() {
             int interval = Config::GetInstance().GetInt("service_discovery.refresh_interval_ms", 3000);
             while (running_) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+                {
+                    std::unique_lock<std::mutex> lock(wake_mtx_);
+                    wake_cv_.wait_for(lock, std::chrono::milliseconds(interval),
+                                      [this] { return !running_ || changed_; });
+                    changed_ = false;
+                }
+                if (!running_) break;
                 UpdateGateways();
             }
         });
-        spdlog::info("ServiceDiscovery started. Polling every {}ms", Config::GetInstance().GetInt("service_discovery.refresh_interval_ms", 3000));
+
+        // Blocks in SUBSCRIBE for the life of the process
+        std::thread([this]() {
+            ServiceRegistry::WatchChanges([this](const std::string& service_name) {
+                if (service_name != "gateway") return;
+                std::lock_guard<std::mutex> lock(wake_mtx_);
+                changed_ = true;
+                wake_cv_.notify_one();
+            });
+        }).detach();
+        spdlog::info("ServiceDiscovery started. Refreshing gateways and their load every {}ms", Config::GetInstance().GetInt("service_discovery.refresh_interval_ms", 3000));
     }
 
     void Stop() {
-        running_ = false;
+        {
+            std::lock_guard<std::mutex> lock(wake_mtx_);
+            running_ = false;
+            wake_cv_.notify_all();
+        }
         if (refresh_thread_.joinable()) refresh_thread_.join();
     }
 
-    std::string GetRandomGateway() {
-        // Zero IO Read from Local Cache
-        std::lock_guard<std::shared_mutex> lock(rw_mtx_); // Read Lock
-        if (gateway_list_.empty()) return "";
-        
-        // Fix: static mt19937 is not thread-safe! Use thread_local.
-        static thread_local std::mt19937 gen(static_cast<unsigned int>(std::time(nullptr) ^ std::hash<std::thread::id>{}(std::this_thread::get_id())));
-        std::uniform_int_distribution<> dis(0, (int)gateway_list_.size() - 1);
-        
-        // Debug
-        // std::cerr << "[DEBUG] GetRandomGateway: Count=" << gateway_list_.size() << std::endl;
-
-        return gateway_list_[dis(gen)];
+    // Power of two choices over the gateways' reported load (see
+    // ServiceRegistry::PickInstance): new logins go to the less loaded of two
+    // random gateways, so a freshly restarted one fills up instead of idling
+    std::string PickGateway() {
+        // Zero IO, no lock: read this thread's copy of the latest snapshot
+        auto gateways = gateways_.Get();
+        int idx = ServiceRegistry::PickInstance(*gateways);
+        if (idx < 0) return "";
+        return (*gateways)[idx].addr;
     }
     
     // For debugging
     size_t GetGatewayCount() {
-        std::shared_lock<std::shared_mutex> lock(rw_mtx_);
-        return gateway_list_.size();
+        return gateways_.Get()->size();
     }
 
 private:
@@ -71,50 +88,25 @@ private:
     ~ServiceDiscovery() { Stop(); }
 
     void UpdateGateways() {
-        std::vector<std::string> keys;
-        
-        // Use SCAN to avoid blocking Redis if keys are many (though gateways won't be millions)
-        // But RedisClient::Keys uses "KEYS" command which is O(N).
-        // Best practice is SCAN. Let's stick with Keys for MVP as per RedisClient impl, 
-        // OR implement Scan in RedisClient.
-        // Given RedisClient only has Keys(), we use it for now.
-        // Optimization: In real prod, modify RedisClient to support Scan.
-        
-        try {
-            // Find all registered gateways: im:service:gateway:{ip:port} -> "ip:port"
-            auto result = RedisClient::GetInstance().Keys("im:service:gateway:*");
-            
-            std::vector<std::string> new_list;
-            for (const auto& key : result) {
-                // Key format: im:gateway:127.0.0.1:8081
-                // We want the value? Value might be the load or just "1".
-                // Actually, if we just need the address, we can parse the key OR get the value if value is the public address.
-                // Let's assume Value is the Public Address (User-facing).
-                std::string addr = RedisClient::GetInstance().Get(key);
-                if (!addr.empty()) {
-                    new_list.push_back(addr);
-                }
-            }
-            
-            if (!new_list.empty()) {
-                std::unique_lock<std::shared_mutex> lock(rw_mtx_); // Write Lock
-                gateway_list_ = new_list;
-                // spdlog::debug("Refreshed Gateways: {}", gateway_list_.size());
-            } else {
-                // Don't clear if fetch failed? Or should we?
-                // If redis returns empty, it means no gateways are online.
-                // We should reflect that.
-                 std::unique_lock<std::shared_mutex> lock(rw_mtx_);
-                 gateway_list_.clear();
-            }
-            
-        } catch (const std::exception& e) {
-            spdlog::error("UpdateGateways failed: {}", e.what());
+        // One ZRANGEBYSCORE on the gateway registry set (plus its load hash): the
+        // cost does not depend on how many other keys Redis holds
+        std::vector<ServiceInstance> new_list;
+        if (!ServiceRegistry::Lookup("gateway", new_list)) {
+            spdlog::error("UpdateGateways failed: Redis unreachable, keeping {} gateways", GetGatewayCount());
+            return;
         }
+
+        // Empty means no gateway is online: reflect that
+        gateways_.Publish(std::make_shared<const std::vector<ServiceInstance>>(std::move(new_list)));
     }
 
-    std::shared_mutex rw_mtx_;
-    std::vector<std::string> gateway_list_;
+    // Replaced whole by the refresh thread, never modified in place
+    Snapshot<std::vector<ServiceInstance>> gateways_;
     std::atomic<bool> running_;
     std::thread refresh_thread_;
+
+    // Wakes the refresh thread early
+    std::mutex wake_mtx_;
+    std::condition_variable wake_cv_;
+    bool changed_ = false;
 };
@@ -10,44 +10,39 @@
 #endif
 
 void ConnectionManager::Join(int64_t user_id, std::shared_ptr<WebsocketSession> session) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    users_[user_id].insert(session);
-    spdlog::info("User {} joined. Total sessions: {}", user_id, users_[user_id].size());
+    size_t total = users_.Join(user_id, std::move(session));
+    spdlog::info("User {} joined. Total sessions: {}", user_id, total);
 }
 
-void ConnectionManager::Leave(int64_t user_id, std::shared_ptr<WebsocketSession> session) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    if (users_.count(user_id)) {
-        users_[user_id].erase(session);
-        if (users_[user_id].empty()) {
-            users_.erase(user_id);
-        }
-    }
+bool ConnectionManager::Leave(int64_t user_id, std::shared_ptr<WebsocketSession> session) {
+    if (!users_.Leave(user_id, session)) return false;
     spdlog::info("User {} left.", user_id);
+    return true;
 }
 
-void ConnectionManager::SendToUser(int64_t user_id, const std::string& msg) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    if (users_.count(user_id)) {
-        for (auto& session : users_[user_id]) {
-            session->Send(msg);
-        }
-    }
+bool ConnectionManager::HasDevice(int64_t user_id, const std::string& device) {
+    bool found = false;
+    users_.ForEach(user_id, [&](const std::shared_ptr<WebsocketSession>& session) {
+        if (session->GetDevice() == device) found = true;
+    });
+    return found;
+}
+
+size_t ConnectionManager::SendToUser(int64_t user_id, const Frame& frame) {
+    return users_.ForEach(user_id, [&frame](const std::shared_ptr<WebsocketSession>& session) {
+        session->Send(frame);
+    });
 }
 
 void ConnectionManager::KickUser(int64_t user_id, const std::string& device) {
     // Need to identify session by device.
-    // Assuming session has GetDevice()
-    std::lock_guard<std::mutex> lock(mtx_);
-    if (users_.count(user_id)) {
-        for (auto& session : users_[user_id]) {
-            if (device.empty() || session->GetDevice() == device) {
-                // Send Kick Notify (CMD_LOGOUT_RESP with reason 1=Kicked)
-                // Use session->Kick() for graceful close
-                session->Kick();
-                
-                spdlog::info("Kicked user {} device {}", user_id, session->GetDevice());
-            }
+    users_.ForEach(user_id, [&](const std::shared_ptr<WebsocketSession>& session) {
+        if (device.empty() || session->GetDevice() == device) {
+            // Send Kick Notify (CMD_LOGOUT_RESP with reason 1=Kicked)
+            // Use session->Kick() for graceful close
+            session->Kick();
+            
+            spdlog::info("Kicked user {} device {}", user_id, session->GetDevice());
         }
-    }
+    });
 }
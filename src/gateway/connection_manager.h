@@ -1,9 +1,8 @@
 #pragma once
 #include <memory>
-#include <mutex>
-#include <unordered_map>
-#include <set>
 #include <string>
+#include "session_registry.h"
+#include "frame.h"
 
 class WebsocketSession;
 
@@ -15,16 +14,21 @@ public:
     }
 
     void Join(int64_t user_id, std::shared_ptr<WebsocketSession> session);
-    void Leave(int64_t user_id, std::shared_ptr<WebsocketSession> session);
-    
-    // Send to specific user (all devices)
-    void SendToUser(int64_t user_id, const std::string& msg);
-    
+    // Returns true if the session was registered (false on a repeated Leave)
+    bool Leave(int64_t user_id, std::shared_ptr<WebsocketSession> session);
+    // Whether user_id still has a session for device on this gateway
+    bool HasDevice(int64_t user_id, const std::string& device);
+
+    // Send to specific user (all devices), sharing one encoded frame.
+    // Returns the number of sessions reached.
+    size_t SendToUser(int64_t user_id, const Frame& frame);
+
     // Kick specific device or all
     void KickUser(int64_t user_id, const std::string& device = "");
 
+    size_t GetUserCount() const { return users_.UserCount(); }
+
 private:
-    std::mutex mtx_;
-    // map: user_id -> set of sessions
-    std::unordered_map<int64_t, std::set<std::shared_ptr<WebsocketSession>>> users_;
+    // user_id -> sessions, sharded by user_id with a lock per shard
+    ShardedSessionRegistry<WebsocketSession> users_;
 };
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <boost/asio/buffer.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "packet.h"
+#include "trace.h"
+
+// An encoded outbound packet (header + body in one buffer), immutable and refcounted.
+// It is encoded once and then shared: pushing the same notify to N sessions (or N
+// devices of one user) queues N references to one buffer, and the write hands that
+// buffer to the socket directly. Copying a Frame only bumps the refcount.
+class Frame {
+public:
+    Frame() = default;
+    Frame(uint16_t cmd_id, const std::string& body,
+          uint8_t version = PACKET_VERSION_1, uint32_t seq = 0)
+        : cmd_id_(cmd_id),
+          bytes_(std::make_shared<const std::string>(EncodePacket(cmd_id, body, version, seq))) {}
+
+    // Tags a push notify so queued notifies can be coalesced. Only notifies of one kind
+    // stand in for each other: the inbox (group_id 0, ordered by max_seq) or one
+    // read-diffusion group (ordered by group_seq). bare is the same notify without its
+    // inlined message, sent instead when this one stands in for others.
+    Frame WithNotify(int64_t group_id, int64_t seq) const {
+        Frame f = *this;
+        f.notify_group_ = group_id;
+        f.notify_seq_ = seq;
+        return f;
+    }
+    Frame WithNotify(int64_t group_id, int64_t seq, const Frame& bare) const {
+        Frame f = WithNotify(group_id, seq);
+        f.bare_ = bare.bytes_;
+        return f;
+    }
+
+    // The notify without its inlined message: the client has to sync
+    Frame WithoutInline() const {
+        Frame f = *this;
+        if (f.bare_) f.bytes_ = std::move(f.bare_);
+        return f;
+    }
+
+    // Attaches the message's trace; the push_delivered stage is recorded when the frame is written
+    Frame WithTrace(std::shared_ptr<const Trace> trace) const {
+        Frame f = *this;
+        f.trace_ = std::move(trace);
+        return f;
+    }
+
+    uint16_t cmd_id() const { return cmd_id_; }
+    int64_t notify_group() const { return notify_group_; }
+    int64_t notify_seq() const { return notify_seq_; }
+    bool SameNotifyKind(const Frame& other) const { return notify_group_ == other.notify_group_; }
+    const Trace* trace() const { return trace_.get(); }
+    size_t size() const { return bytes_ ? bytes_->size() : 0; }
+    boost::asio::const_buffer buffer() const {
+        return bytes_ ? boost::asio::buffer(*bytes_) : boost::asio::const_buffer();
+    }
+
+    explicit operator bool() const { return bytes_ != nullptr; }
+
+private:
+    uint16_t cmd_id_ = 0;
+    int64_t notify_group_ = 0;
+    int64_t notify_seq_ = 0;
+    std::shared_ptr<const std::string> bytes_;
+    std::shared_ptr<const std::string> bare_;
+    std::shared_ptr<const Trace> trace_;
+};
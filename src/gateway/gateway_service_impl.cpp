@@ -2,6 +2,7 @@
 #include <vector>
 #include "connection_manager.h"
 #include "chat.pb.h" // For MsgPushNotify
+#include "trace.h"
 #include <spdlog/spdlog.h>
 #ifdef _WIN32
 #include <winsock2.h>
@@ -9,38 +10,74 @@
 #include <arpa/inet.h>
 #endif
 
-Status GatewayServiceImpl::PushNotify(ServerContext* context, const tinyim::gateway::PushNotifyReq* request,
-                                      tinyim::gateway::PushNotifyResp* reply) {
-    int64_t user_id = request->user_id();
-    int64_t max_seq = request->max_seq();
-    
+// Build the CMD_MSG_PUSH_NOTIFY packet for one push item
+static Frame BuildNotifyPacket(const tinyim::gateway::PushNotifyReq& item) {
     // Construct MsgPushNotify Proto
     tinyim::chat::MsgPushNotify notify;
-    notify.set_max_seq(max_seq);
-    notify.set_type(request->msg_type()); // Need to cast or match
+    notify.set_max_seq(item.max_seq());
+    notify.set_type(item.msg_type());
+    notify.set_group_id(item.group_id());
+    notify.set_group_seq(item.group_seq());
+    // Read-diffusion group notifies carry no inbox max_seq, only the group's timeline seq
+    bool group = item.max_seq() == 0 && item.group_id() > 0;
+    int64_t kind = group ? item.group_id() : 0;
+    int64_t seq = group ? item.group_seq() : item.max_seq();
+
+    // Inlined message (small, receiver caught up): the client can skip the sync.
+    // The bare notify goes out instead if this one is coalesced with others.
+    Frame bare;
+    if (!item.payload().empty() && notify.mutable_msg()->ParseFromString(item.payload())) {
+        tinyim::chat::MsgPushNotify plain = notify;
+        plain.clear_msg();
+        std::string plain_body;
+        plain.SerializeToString(&plain_body);
+        bare = Frame(CMD_MSG_PUSH_NOTIFY, plain_body);
+    } else {
+        notify.clear_msg();
+    }
     
     std::string body;
     notify.SerializeToString(&body);
-    
-    // Construct Packet
-    PacketHeader header;
-    header.magic[0] = 'I'; header.magic[1] = 'M';
-    header.version = 1;
-    header.cmd_id = htons(CMD_MSG_PUSH_NOTIFY); // Network Byte Order
-    header.body_len = htonl(body.size());
-    
-    std::vector<char> packet(sizeof(PacketHeader) + body.size());
-    memcpy(packet.data(), &header, sizeof(PacketHeader));
-    memcpy(packet.data() + sizeof(PacketHeader), body.data(), body.size());
-    
-    std::string data(packet.begin(), packet.end());
+    return Frame(CMD_MSG_PUSH_NOTIFY, body).WithNotify(kind, seq, bare);
+}
+
+Status GatewayServiceImpl::PushNotify(ServerContext* context, const tinyim::gateway::PushNotifyReq* request,
+                                      tinyim::gateway::PushNotifyResp* reply) {
+    int64_t user_id = request->user_id();
+    int64_t max_seq = request->max_seq();
     
     spdlog::info("PushNotify: user={} seq={}", user_id, max_seq);
     
     // Send to User
-    ConnectionManager::GetInstance().SendToUser(user_id, data);
+    ConnectionManager::GetInstance().SendToUser(user_id, BuildNotifyPacket(*request));
+    
+    reply->set_success(true);
+    return Status::OK;
+}
+
+Status GatewayServiceImpl::BatchPushNotify(ServerContext* context, const tinyim::gateway::BatchPushNotifyReq* request,
+                                           tinyim::gateway::BatchPushNotifyResp* reply) {
+    // Traced message: record its upstream stages once, then each delivery as its frame is written
+    std::shared_ptr<const Trace> trace;
+    Trace t = Trace::FromMetadata(*context);
+    if (!t.empty()) {
+        t.Mark(TraceStage::kPushRecv);
+        TraceStats::GetInstance().Record(t, TraceStage::kChatRecv, TraceStage::kPushRecv);
+        trace = std::make_shared<const Trace>(t);
+    }
+
+    int delivered = 0;
+    for (const auto& item : request->items()) {
+        Frame frame = BuildNotifyPacket(item);
+        if (trace) frame = frame.WithTrace(trace);
+        if (ConnectionManager::GetInstance().SendToUser(item.user_id(), frame) > 0) {
+            delivered++;
+        }
+    }
+    spdlog::info("BatchPushNotify: items={} delivered={}", request->items_size(), delivered);
     
     reply->set_success(true);
+    reply->set_delivered(delivered);
     return Status::OK;
 }
 
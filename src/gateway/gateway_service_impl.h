@@ -12,6 +12,10 @@ public:
     Status PushNotify(ServerContext* context, const tinyim::gateway::PushNotifyReq* request,
                       tinyim::gateway::PushNotifyResp* reply) override;
 
+    // One call per gateway per message: fan each item out to the local sessions
+    Status BatchPushNotify(ServerContext* context, const tinyim::gateway::BatchPushNotifyReq* request,
+                           tinyim::gateway::BatchPushNotifyResp* reply) override;
+
     Status KickUser(ServerContext* context, const tinyim::gateway::KickUserReq* request,
                     tinyim::gateway::KickUserResp* reply) override;
 };
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Process-wide counters for outbound flow control, served by GET /api/stats
+struct GatewayStats {
+    std::atomic<uint64_t> notifies_coalesced{0}; // Push notifies merged within the coalescing window
+    std::atomic<uint64_t> notifies_collapsed{0}; // Queued push notifies superseded by a newer one
+    std::atomic<uint64_t> frames_dropped{0};     // Frames discarded with an evicted session's queue
+    std::atomic<uint64_t> congestions{0};        // Sessions crossing the high watermark
+    std::atomic<uint64_t> evictions{0};          // Sessions disconnected at the hard limit
+    std::atomic<uint64_t> write_errors{0};       // Sessions closed after a failed write
+
+    static GatewayStats& GetInstance() {
+        static GatewayStats instance;
+        return instance;
+    }
+};
@@ -2,10 +2,15 @@
 #include "websocket_session.h"
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
-#include "redis_client.h"
+#include "async_redis_client.h"
 #include <grpcpp/grpcpp.h>
 #include "auth.grpc.pb.h"
 #include "service_registry.h"
+#include "connection_manager.h"
+#include "gateway_stats.h"
+#include "trace.h"
+#include "metrics.h"
+#include "config.h"
 
 using json = nlohmann::json;
 
@@ -28,8 +33,30 @@ static AuthClient& GetAuthClient() {
     return client;
 }
 
-HttpSession::HttpSession(tcp::socket&& socket)
-    : stream_(std::move(socket)) {}
+// State of one outstanding Auth RPC. Kept alive by the completion callback.
+template<class Req, class Resp>
+struct AuthCall {
+    grpc::ClientContext ctx;
+    Req req;
+    Resp resp;
+};
+
+template<class Resp, class Req, class Start, class Done>
+void HttpSession::CallAuth(Req&& req, Start start, Done done) {
+    static const int timeout_ms = Config::GetInstance().GetInt("gateway.rpc_timeout_ms", 5000);
+
+    auto call = std::make_shared<AuthCall<std::decay_t<Req>, Resp>>();
+    call->req = std::move(req);
+    call->ctx.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(timeout_ms));
+    start(&call->ctx, &call->req, &call->resp,
+        [self = shared_from_this(), call, done = std::move(done)](grpc::Status status) {
+            // Runs on a gRPC callback thread: answer from the session's reactor
+            self->reactor_.Post([call, done, status]() { done(status, call->resp); });
+        });
+}
+
+HttpSession::HttpSession(tcp::socket&& socket, Reactor& reactor)
+    : stream_(std::move(socket)), reactor_(reactor) {}
 
 void HttpSession::Run() {
     DoRead();
@@ -73,33 +100,34 @@ void HttpSession::OnRead(beast::error_code ec, std::size_t bytes_transferred) {
              }
         }
         
-        // Auth Check
-        bool auth_ok = false;
+        // Auth Check, on this reactor's Redis connection: the upgrade resumes with the reply
         if (user_id > 0 && !token.empty()) {
              std::string session_key = "im:session:" + std::to_string(user_id);
-             std::string stored_token = RedisClient::GetInstance().HGet(session_key, device);
-             if (stored_token == token) {
-                 auth_ok = true;
-             } else {
-                 spdlog::warn("WS Auth Failed for user {}: Check token/device mismatch.", user_id);
-             }
+             reactor_.redis().HGet(session_key, device,
+                 [self = shared_from_this(), user_id, token, device](std::optional<std::string> stored_token) {
+                     if (stored_token == token) return self->Upgrade(user_id, device);
+                     spdlog::warn("WS Auth Failed for user {}: Check token/device mismatch.", user_id);
+                     self->Upgrade(0, device);
+                 });
+             return;
         }
-        
-        if (!auth_ok) {
-             // Allow Anonymous Upgrade (Packet-based Auth will follow)
-             spdlog::info("WS Handshake: No valid token found, upgrading as Anonymous (user_id=0)");
-             user_id = 0;
-        }
-
-        auto ws = std::make_shared<WebsocketSession>(stream_.release_socket());
-        ws->SetUserInfo(user_id, device); // user_id might be 0
-        ws->DoAccept(std::move(req_));
+        Upgrade(0, device);
         return;
     }
 
     HandleRequest();
 }
 
+void HttpSession::Upgrade(int64_t user_id, const std::string& device) {
+    if (user_id == 0) {
+        // Allow Anonymous Upgrade (Packet-based Auth will follow)
+        spdlog::info("WS Handshake: No valid token found, upgrading as Anonymous (user_id=0)");
+    }
+    auto ws = std::make_shared<WebsocketSession>(stream_.release_socket(), reactor_);
+    ws->SetUserInfo(user_id, device); // user_id might be 0
+    ws->DoAccept(std::move(req_));
+}
+
 void HttpSession::HandleRequest() {
     http::response<http::string_body> res{http::status::ok, req_.version()};
     res.set(http::field::server, "TinyIM Gateway");
@@ -116,6 +144,44 @@ void HttpSession::HandleRequest() {
         return DoWrite(std::move(res));
     }
 
+    // --- Prometheus scrape ---
+    if (req_.method() == http::verb::get && req_.target() == "/metrics") {
+        res.set(http::field::content_type, "text/plain; version=0.0.4");
+        res.body() = Metrics::GetInstance().Expose();
+        res.prepare_payload();
+        return DoWrite(std::move(res));
+    }
+
+    // --- Stats (outbound flow control counters) ---
+    if (req_.method() == http::verb::get && req_.target() == "/api/stats") {
+        auto& stats = GatewayStats::GetInstance();
+        json j;
+        j["online_users"] = ConnectionManager::GetInstance().GetUserCount();
+        j["notifies_coalesced"] = stats.notifies_coalesced.load();
+        j["notifies_collapsed"] = stats.notifies_collapsed.load();
+        j["frames_dropped"] = stats.frames_dropped.load();
+        j["congestions"] = stats.congestions.load();
+        j["evictions"] = stats.evictions.load();
+        j["write_errors"] = stats.write_errors.load();
+
+        // Message latency by stage (us): each stage is the time since the previous one
+        auto& trace = TraceStats::GetInstance();
+        auto summary = [](const LatencyHistogram& h) {
+            return json{{"count", h.count()}, {"p50", h.Percentile(0.50)},
+                        {"p99", h.Percentile(0.99)}, {"p999", h.Percentile(0.999)}};
+        };
+        json& latency = j["latency_us"];
+        for (int s = static_cast<int>(TraceStage::kChatRecv); s < static_cast<int>(TraceStage::kCount); ++s) {
+            latency[Trace::StageName(static_cast<TraceStage>(s))] = summary(trace.stage(static_cast<TraceStage>(s)));
+        }
+        latency["end_to_end"] = summary(trace.end_to_end());
+        latency["send_rpc"] = summary(trace.send_rpc());
+        latency["sync_rpc"] = summary(trace.sync_rpc());
+        res.body() = j.dump();
+        res.prepare_payload();
+        return DoWrite(std::move(res));
+    }
+
     if (req_.method() != http::verb::post) {
         res.result(http::status::bad_request);
         res.body() = "Only POST allowed";
@@ -124,6 +190,9 @@ void HttpSession::HandleRequest() {
 
     std::string target = std::string(req_.target());
     
+    // Auth RPCs complete asynchronously: the response is written from their callback
+    auto reply = std::make_shared<http::response<http::string_body>>(std::move(res));
+
     // --- Register ---
     if (target == "/api/register") {
         try {
@@ -133,24 +202,26 @@ void HttpSession::HandleRequest() {
             rpc_req.set_password(body.value("password", ""));
             rpc_req.set_nickname(body.value("nickname", ""));
 
-            tinyim::auth::RegisterResp rpc_resp;
-            grpc::ClientContext context;
-            
-            grpc::Status status = GetAuthClient().stub_->Register(&context, rpc_req, &rpc_resp);
-            
-            json resp_json;
-            if (status.ok() && rpc_resp.success()) {
-                resp_json["code"] = 0;
-                resp_json["msg"] = "Register Success";
-                resp_json["data"] = {{"user_id", rpc_resp.user_id()}};
-            } else {
-                resp_json["code"] = 1;
-                resp_json["msg"] = !status.ok() ? ("RPC Error: " + status.error_message()) : rpc_resp.error_message();
-            }
-            res.body() = resp_json.dump();
+            CallAuth<tinyim::auth::RegisterResp>(std::move(rpc_req),
+                [](auto* ctx, auto* rq, auto* rs, auto done) { GetAuthClient().stub_->async()->Register(ctx, rq, rs, std::move(done)); },
+                [self = shared_from_this(), reply](const grpc::Status& status, tinyim::auth::RegisterResp& rpc_resp) {
+                    json resp_json;
+                    if (status.ok() && rpc_resp.success()) {
+                        resp_json["code"] = 0;
+                        resp_json["msg"] = "Register Success";
+                        resp_json["data"] = {{"user_id", rpc_resp.user_id()}};
+                    } else {
+                        resp_json["code"] = 1;
+                        resp_json["msg"] = !status.ok() ? ("RPC Error: " + status.error_message()) : rpc_resp.error_message();
+                    }
+                    reply->body() = resp_json.dump();
+                    reply->prepare_payload();
+                    self->DoWrite(std::move(*reply));
+                });
+            return;
         } catch (...) {
-            res.result(http::status::bad_request);
-            res.body() = "Invalid JSON";
+            reply->result(http::status::bad_request);
+            reply->body() = "Invalid JSON";
         }
     } 
     // --- Login ---
@@ -161,44 +232,50 @@ void HttpSession::HandleRequest() {
             rpc_req.set_username(body.value("username", ""));
             rpc_req.set_password(body.value("password", ""));
             rpc_req.set_device(body.value("device", "PC"));
+            std::string device = rpc_req.device();
+
+            CallAuth<tinyim::auth::LoginResp>(std::move(rpc_req),
+                [](auto* ctx, auto* rq, auto* rs, auto done) { GetAuthClient().stub_->async()->Login(ctx, rq, rs, std::move(done)); },
+                [self = shared_from_this(), reply, device](const grpc::Status& status, tinyim::auth::LoginResp& rpc_resp) {
+                    json resp_json;
+                    if (!status.ok() || !rpc_resp.success()) {
+                        resp_json["code"] = 1;
+                        resp_json["msg"] = !status.ok() ? ("RPC Error: " + status.error_message()) : rpc_resp.error_message();
+                        reply->body() = resp_json.dump();
+                        reply->prepare_payload();
+                        return self->DoWrite(std::move(*reply));
+                    }
+
+                    // LB Logic
+                    std::string gateway_url = "ws://127.0.0.1:8080/ws"; // fallback
+                    try {
+                        // Uses Local Cache + Round Robin
+                        std::string addr = ServiceRegistry::GetInstance().Discover("gateway");
+                        if(!addr.empty()) gateway_url = "ws://" + addr + "/ws";
+                    } catch(...) {
+                        spdlog::error("LB Selection failed");
+                    }
+
+                    resp_json["code"] = 0;
+                    resp_json["msg"] = "Login Success";
+                    resp_json["data"] = {
+                        {"user_id", rpc_resp.user_id()},
+                        {"token", rpc_resp.token()},
+                        {"gateway_url", gateway_url} 
+                    };
 
-            tinyim::auth::LoginResp rpc_resp;
-            grpc::ClientContext context;
-
-            grpc::Status status = GetAuthClient().stub_->Login(&context, rpc_req, &rpc_resp);
-
-            json resp_json;
-            if (status.ok() && rpc_resp.success()) {
-                // Store token in Redis for WebSocket authentication
-                std::string session_key = "im:session:" + std::to_string(rpc_resp.user_id());
-                std::string device = body.value("device", "PC");
-                RedisClient::GetInstance().HSet(session_key, device, rpc_resp.token());
-                
-                // LB Logic
-                std::string gateway_url = "ws://127.0.0.1:8080/ws"; // fallback
-                try {
-                    // Uses Local Cache + Round Robin
-                    std::string addr = ServiceRegistry::GetInstance().Discover("gateway");
-                    if(!addr.empty()) gateway_url = "ws://" + addr + "/ws";
-                } catch(...) {
-                    spdlog::error("LB Selection failed");
-                }
-
-                resp_json["code"] = 0;
-                resp_json["msg"] = "Login Success";
-                resp_json["data"] = {
-                    {"user_id", rpc_resp.user_id()},
-                    {"token", rpc_resp.token()},
-                    {"gateway_url", gateway_url} 
-                };
-            } else {
-                resp_json["code"] = 1;
-                resp_json["msg"] = !status.ok() ? ("RPC Error: " + status.error_message()) : rpc_resp.error_message();
-            }
-            res.body() = resp_json.dump();
+                    // Store token in Redis for WebSocket authentication; answer once it
+                    // is stored, so the client's upgrade finds it
+                    std::string session_key = "im:session:" + std::to_string(rpc_resp.user_id());
+                    reply->body() = resp_json.dump();
+                    reply->prepare_payload();
+                    self->reactor_.redis().HSet(session_key, device, rpc_resp.token(),
+                        [self, reply](bool) { self->DoWrite(std::move(*reply)); });
+                });
+            return;
         } catch (...) {
-            res.result(http::status::bad_request);
-            res.body() = "Invalid JSON";
+            reply->result(http::status::bad_request);
+            reply->body() = "Invalid JSON";
         }
     } 
     // --- Logout ---
@@ -210,32 +287,35 @@ void HttpSession::HandleRequest() {
             rpc_req.set_token(body.value("token", ""));
             rpc_req.set_device(body.value("device", "PC"));
 
-            tinyim::auth::LogoutResp rpc_resp;
-            grpc::ClientContext context;
-            grpc::Status status = GetAuthClient().stub_->Logout(&context, rpc_req, &rpc_resp);
-
-            json resp_json;
-            if (status.ok() && rpc_resp.success()) {
-                resp_json["code"] = 0;
-                resp_json["msg"] = "Logout Success";
-            } else {
-                resp_json["code"] = 1;
-                resp_json["msg"] = !status.ok() ? ("RPC Error: " + status.error_message()) : "Logout Failed";
-            }
-            res.body() = resp_json.dump();
+            CallAuth<tinyim::auth::LogoutResp>(std::move(rpc_req),
+                [](auto* ctx, auto* rq, auto* rs, auto done) { GetAuthClient().stub_->async()->Logout(ctx, rq, rs, std::move(done)); },
+                [self = shared_from_this(), reply](const grpc::Status& status, tinyim::auth::LogoutResp& rpc_resp) {
+                    json resp_json;
+                    if (status.ok() && rpc_resp.success()) {
+                        resp_json["code"] = 0;
+                        resp_json["msg"] = "Logout Success";
+                    } else {
+                        resp_json["code"] = 1;
+                        resp_json["msg"] = !status.ok() ? ("RPC Error: " + status.error_message()) : "Logout Failed";
+                    }
+                    reply->body() = resp_json.dump();
+                    reply->prepare_payload();
+                    self->DoWrite(std::move(*reply));
+                });
+            return;
         } catch (...) {
-            res.result(http::status::bad_request);
-             res.body() = "Invalid JSON";
+            reply->result(http::status::bad_request);
+             reply->body() = "Invalid JSON";
         }
     } 
     // --- Not Found ---
     else {
-        res.result(http::status::not_found);
-        res.body() = "Not Found";
+        reply->result(http::status::not_found);
+        reply->body() = "Not Found";
     }
 
-    res.prepare_payload();
-    DoWrite(std::move(res));
+    reply->prepare_payload();
+    DoWrite(std::move(*reply));
 }
 
 void HttpSession::DoWrite(http::response<http::string_body>&& res) {
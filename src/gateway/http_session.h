@@ -12,19 +12,27 @@ namespace http = beast::http;
 namespace net = boost::asio;
 using tcp = boost::asio::ip::tcp;
 
+class Reactor;
+
 class HttpSession : public std::enable_shared_from_this<HttpSession> {
     beast::tcp_stream stream_;
     beast::flat_buffer buffer_;
     http::request<http::string_body> req_;
+    Reactor& reactor_; // Owns the socket; an upgraded WebSocket stays on it
 
 public:
-    explicit HttpSession(tcp::socket&& socket);
+    HttpSession(tcp::socket&& socket, Reactor& reactor);
     void Run();
 
 private:
     void DoRead();
     void OnRead(beast::error_code ec, std::size_t bytes_transferred);
+    // Hands the socket to a WebsocketSession; user_id 0 is anonymous
+    void Upgrade(int64_t user_id, const std::string& device);
     void HandleRequest();
+    // Async Auth RPC; done(status, resp) runs on this session's reactor
+    template<class Resp, class Req, class Start, class Done>
+    void CallAuth(Req&& req, Start start, Done done);
     void DoWrite(http::response<http::string_body>&& res);
 };
 
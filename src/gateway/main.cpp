@@ -1,6 +1,11 @@
 #include <boost/asio.hpp>
+#include <boost/asio/signal_set.hpp>
 #include <spdlog/spdlog.h>
 #include <thread>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
 #include <vector>
 #include "server.h"
 #include "db_pool.h"
@@ -9,6 +14,10 @@
 #include "connection_manager.h" // Added
 #include "gateway_service_impl.h" // Added
 #include "service_registry.h" // Added
+#include "reactor.h"
+#include "websocket_session.h"
+#include "metrics.h"
+#include "rpc_metrics.h"
 
 // Note: In real Microservices, Gateway shouldn't touch DB directly.
 // But for "Dispatch Service" part (Login/Register), it might need gRPC to AuthServer.
@@ -28,14 +37,22 @@ int main(int argc, char* argv[]) {
         }
         
         std::string gateway_id = "gw-" + std::to_string(port);
-        int threads = 4;
 
-        boost::asio::io_context ioc{threads};
+        // One reactor (io_context + thread + acceptor) per core by default
+        int threads = Config::GetInstance().GetInt("gateway.io_threads", 0);
+        int cores = static_cast<int>(std::thread::hardware_concurrency());
+        if (threads <= 0) threads = cores > 0 ? cores : 4;
+        bool pin = Config::GetInstance().GetInt("gateway.pin_threads", 0) != 0;
 
         // Initialize Redis for Pub/Sub (Kick logic)
-        std::string redis_host = Config::GetInstance().GetString("redis.host", "127.0.0.1");
-        int redis_port = Config::GetInstance().GetInt("redis.port", 6379);
-        RedisClient::GetInstance().Init(redis_host, redis_port);
+        std::vector<std::string> redis_nodes = Config::GetInstance().GetStringList("redis.nodes");
+        if (!redis_nodes.empty()) {
+            RedisClient::GetInstance().Init(redis_nodes);
+        } else {
+            std::string redis_host = Config::GetInstance().GetString("redis.host", "127.0.0.1");
+            int redis_port = Config::GetInstance().GetInt("redis.port", 6379);
+            RedisClient::GetInstance().Init(redis_host, redis_port);
+        }
         
         // Start Kick Listener Thread
         std::thread subscribe_thread([gateway_id]() {
@@ -60,6 +77,7 @@ int main(int argc, char* argv[]) {
         grpc::ServerBuilder builder;
         builder.AddListeningPort(grpc_address, grpc::InsecureServerCredentials());
         builder.RegisterService(&gateway_service);
+        AddRpcMetrics(builder);
         std::unique_ptr<grpc::Server> grpc_server(builder.BuildAndStart());
         
         spdlog::info("[{}] Gateway RPC Server running on {}", gateway_id, grpc_address);
@@ -67,23 +85,60 @@ int main(int argc, char* argv[]) {
         // --- Service Registry ---
         // Register myself
         // Use 127.0.0.1 for local discovery
+        // Load published with every heartbeat: dispatch and login pick the less loaded gateway
+        ServiceRegistry::GetInstance().SetLoadReporter([cores]() {
+            // CPU: process CPU time over wall time since the last report, over all cores
+            static std::clock_t last_cpu = std::clock();
+            static auto last_wall = std::chrono::steady_clock::now();
+            std::clock_t cpu = std::clock();
+            auto wall = std::chrono::steady_clock::now();
+            double wall_sec = std::chrono::duration<double>(wall - last_wall).count();
+            double cpu_sec = static_cast<double>(cpu - last_cpu) / CLOCKS_PER_SEC;
+            last_cpu = cpu;
+            last_wall = wall;
+
+            ServiceLoad load;
+            load.sessions = WebsocketSession::OpenSessions();
+            load.write_queue_bytes = WebsocketSession::QueuedBytes();
+            if (wall_sec > 0) load.cpu = std::min(1.0, cpu_sec / wall_sec / std::max(1, cores));
+            return load;
+        });
         ServiceRegistry::GetInstance().Register("gateway", "127.0.0.1", port);
         
         // Start Observing Gateways (for Load Balancing)
         ServiceRegistry::GetInstance().Observe("gateway");
 
-        // Start the server
-        std::make_shared<Server>(ioc, tcp::endpoint{address, port})->Run();
+        // Served on GET /metrics by HttpSession, next to /api/stats
+        Metrics::GetInstance().AddGaugeCallback("tinyim_gateway_online_users", "Users with at least one session", {},
+            []() { return static_cast<double>(ConnectionManager::GetInstance().GetUserCount()); });
+
+        // Start the reactors. With SO_REUSEPORT each one listens on the port itself,
+        // otherwise reactor 0 accepts for all of them.
+        std::vector<std::unique_ptr<Reactor>> reactors;
+        std::vector<Reactor*> all;
+        for (int i = 0; i < threads; ++i) {
+            reactors.push_back(std::make_unique<Reactor>(i, pin && cores > 0 ? i % cores : -1));
+            all.push_back(reactors.back().get());
+        }
+        tcp::endpoint endpoint{address, port};
+        if (Server::kReusePort) {
+            for (Reactor* r : all) std::make_shared<Server>(*r, endpoint, std::vector<Reactor*>{r})->Run();
+        } else {
+            std::make_shared<Server>(*all[0], endpoint, all)->Run();
+        }
+        for (Reactor* r : all) r->Start();
 
-        spdlog::info("[{}] Gateway Server running on port {}", gateway_id, port);
+        spdlog::info("[{}] Gateway Server running on port {} ({} reactors{})",
+                     gateway_id, port, threads, pin ? ", pinned" : "");
 
-        // Run io_context on multiple threads
-        std::vector<std::thread> v;
-        v.reserve(threads - 1);
-        for(auto i = threads - 1; i > 0; --i)
-            v.emplace_back([&ioc]{ ioc.run(); });
-        
-        ioc.run();
+        // Main thread waits for shutdown
+        boost::asio::io_context signals_ioc;
+        boost::asio::signal_set signals(signals_ioc, SIGINT, SIGTERM);
+        signals.async_wait([&](const boost::system::error_code&, int) {
+            for (Reactor* r : all) r->Stop();
+        });
+        signals_ioc.run();
+        for (Reactor* r : all) r->Join();
     } catch (const std::exception& e) {
         spdlog::error("Fatal Error: {}", e.what());
         return -1;
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+#include "frame.h"
+#include "packet.h"
+
+// Push notify coalescing for one session (reactor thread only).
+// A notify tells the client to sync its inbox up to max_seq, or one read-diffusion
+// group up to group_seq, and any sync fetches everything pending: the latest notify
+// of a kind makes the earlier ones redundant. Kinds never stand in for each other.
+// A notify that stands in for dropped ones loses its inlined message, so the client
+// syncs instead of applying one message and skipping the rest.
+class NotifyCoalescer {
+public:
+    bool empty() const { return held_.empty(); }
+
+    // Holds a notify until Take; returns true if it was coalesced with a held one
+    bool Hold(Frame frame) {
+        for (Frame& held : held_) {
+            if (!held.SameNotifyKind(frame)) continue;
+            // Latest wins; an out-of-order push is already covered by the held one
+            if (frame.notify_seq() >= held.notify_seq()) held = std::move(frame);
+            held = held.WithoutInline();
+            return true;
+        }
+        held_.push_back(std::move(frame));
+        return false;
+    }
+
+    // The held notifies, one per kind, in arrival order of their kind
+    std::vector<Frame> Take() {
+        std::vector<Frame> frames;
+        frames.swap(held_);
+        return frames;
+    }
+
+    void Clear() { held_.clear(); }
+
+    // Keeps only the latest queued notify of each kind (latest queued on ties), in its
+    // place; the other frames are untouched. Returns the number of notifies dropped and
+    // updates bytes, the queue's total size.
+    static size_t Collapse(std::deque<Frame>& queue, size_t& bytes) {
+        struct Kind {
+            int64_t group;
+            size_t keep;         // Index of the latest notify of this kind
+            bool covers_others;
+        };
+        std::vector<Kind> kinds;
+        auto find = [&kinds](const Frame& f) -> Kind* {
+            for (Kind& k : kinds) {
+                if (k.group == f.notify_group()) return &k;
+            }
+            return nullptr;
+        };
+        for (size_t i = 0; i < queue.size(); ++i) {
+            const Frame& f = queue[i];
+            if (f.cmd_id() != CMD_MSG_PUSH_NOTIFY) continue;
+            Kind* kind = find(f);
+            if (!kind) {
+                kinds.push_back({f.notify_group(), i, false});
+                continue;
+            }
+            kind->covers_others = true;
+            if (f.notify_seq() >= queue[kind->keep].notify_seq()) kind->keep = i;
+        }
+
+        size_t dropped = 0;
+        std::deque<Frame> kept;
+        for (size_t i = 0; i < queue.size(); ++i) {
+            Frame& f = queue[i];
+            if (f.cmd_id() == CMD_MSG_PUSH_NOTIFY) {
+                const Kind* kind = find(f);
+                if (kind->keep != i) {
+                    bytes -= f.size();
+                    dropped++;
+                    continue;
+                }
+                if (kind->covers_others) {
+                    bytes -= f.size();
+                    f = f.WithoutInline();
+                    bytes += f.size();
+                }
+            }
+            kept.push_back(std::move(f));
+        }
+        queue.swap(kept);
+        return dropped;
+    }
+
+private:
+    std::vector<Frame> held_;
+};
@@ -0,0 +1,75 @@
+#include "reactor.h"
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/post.hpp>
+#include <spdlog/spdlog.h>
+#include "async_redis_client.h"
+#include "redis_client.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static thread_local Reactor* current_reactor = nullptr;
+
+Reactor::Reactor(int index, int cpu) : index_(index), cpu_(cpu) {}
+
+Reactor::~Reactor() {
+    Stop();
+    Join();
+}
+
+Reactor* Reactor::Current() {
+    return current_reactor;
+}
+
+AsyncRedisClient& Reactor::redis() {
+    if (!redis_) {
+        redis_ = std::make_unique<AsyncRedisClient>(ioc_, RedisClient::GetInstance().nodes());
+    }
+    return *redis_;
+}
+
+void Reactor::Post(std::function<void()> task) {
+    tasks_.Push(std::move(task));
+    // One io_context handler per burst: only the producer that finds no drain
+    // pending schedules one
+    if (!drain_scheduled_.exchange(true, std::memory_order_acq_rel)) {
+        net::post(ioc_, [this] { Drain(); });
+    }
+}
+
+void Reactor::Drain() {
+    // Reset before popping: a Push that lands after this point schedules another
+    // drain. The exchange also makes every Push that saw the flag set visible here.
+    drain_scheduled_.exchange(false, std::memory_order_acq_rel);
+    std::function<void()> task;
+    while (tasks_.Pop(task)) {
+        task();
+    }
+}
+
+void Reactor::Start() {
+    thread_ = std::thread([this] {
+        current_reactor = this;
+#ifdef __linux__
+        if (cpu_ >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu_, &set);
+            if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+                spdlog::warn("Reactor {}: failed to pin to CPU {}", index_, cpu_);
+            }
+        }
+#endif
+        auto guard = net::make_work_guard(ioc_);
+        ioc_.run();
+    });
+}
+
+void Reactor::Stop() {
+    ioc_.stop();
+}
+
+void Reactor::Join() {
+    if (thread_.joinable()) thread_.join();
+}
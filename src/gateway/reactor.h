@@ -0,0 +1,55 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include "mpsc_queue.h"
+
+class AsyncRedisClient;
+
+namespace net = boost::asio;
+
+// One event loop on one thread.
+// The gateway runs gateway.io_threads reactors (hardware_concurrency by default).
+// Each owns its io_context, its own SO_REUSEPORT acceptor and the sessions that
+// acceptor produced, so session handlers never need a strand. Work from other
+// threads (gRPC pushes, RPC completions, kicks) arrives through Post: a lock-free
+// MPSC queue drained in one io_context handler per burst.
+class Reactor {
+public:
+    // cpu >= 0 pins the reactor thread to that CPU (Linux only)
+    Reactor(int index, int cpu = -1);
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    net::io_context& context() { return ioc_; }
+    // This loop's Redis connections (see AsyncRedisClient); reactor thread only
+    AsyncRedisClient& redis();
+    int index() const { return index_; }
+
+    // Runs task on this reactor's thread. Safe from any thread.
+    void Post(std::function<void()> task);
+
+    bool InThisThread() const { return Current() == this; }
+    // The reactor running the calling thread, nullptr outside reactors
+    static Reactor* Current();
+
+    void Start();
+    void Stop();
+    void Join();
+
+private:
+    void Drain();
+
+    int index_;
+    int cpu_;
+    net::io_context ioc_{1};
+    MpscQueue<std::function<void()>> tasks_;
+    std::atomic<bool> drain_scheduled_{false};
+    std::unique_ptr<AsyncRedisClient> redis_; // Opened on first use
+    std::thread thread_;
+};
@@ -1,27 +1,39 @@
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 #include <memory>
+#include <vector>
 #include <spdlog/spdlog.h>
 #include "http_session.h"
+#include "reactor.h"
 
 namespace beast = boost::beast;
 namespace http = beast::http;
 namespace net = boost::asio;
 using tcp = boost::asio::ip::tcp;
 
+// Listening socket of one reactor.
+// With SO_REUSEPORT every reactor binds its own acceptor to the port and the
+// kernel spreads connections across them. Where that is unavailable a single
+// acceptor hands accepted sockets to the reactors in turn.
 class Server : public std::enable_shared_from_this<Server> {
-    net::io_context& ioc_;
+    Reactor& reactor_;
     tcp::acceptor acceptor_;
+    std::vector<Reactor*> targets_; // Reactors that receive the accepted sockets
+    size_t next_ = 0;
 
 public:
-    Server(net::io_context& ioc, tcp::endpoint endpoint)
-        : ioc_(ioc), acceptor_(ioc) {
+    Server(Reactor& reactor, tcp::endpoint endpoint, std::vector<Reactor*> targets)
+        : reactor_(reactor), acceptor_(reactor.context()), targets_(std::move(targets)) {
         
         beast::error_code ec;
         acceptor_.open(endpoint.protocol(), ec);
         if(ec) { spdlog::error("Open failed: {}", ec.message()); return; }
         
         acceptor_.set_option(net::socket_base::reuse_address(true), ec);
+#ifdef SO_REUSEPORT
+        acceptor_.set_option(net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true), ec);
+        if(ec) { spdlog::error("SO_REUSEPORT failed: {}", ec.message()); return; }
+#endif
         acceptor_.bind(endpoint, ec);
         if(ec) { spdlog::error("Bind failed: {}", ec.message()); return; }
         
@@ -29,21 +41,36 @@ public:
         if(ec) { spdlog::error("Listen failed: {}", ec.message()); return; }
     }
 
+    static constexpr bool kReusePort =
+#ifdef SO_REUSEPORT
+        true;
+#else
+        false;
+#endif
+
     void Run() {
         DoAccept();
     }
 
 private:
     void DoAccept() {
-        acceptor_.async_accept(net::make_strand(ioc_),
-            beast::bind_front_handler(&Server::OnAccept, shared_from_this()));
+        // The socket is created on the io_context of the reactor that will own it
+        Reactor* target = targets_[next_++ % targets_.size()];
+        acceptor_.async_accept(target->context(),
+            [self = shared_from_this(), target](beast::error_code ec, tcp::socket socket) {
+                self->OnAccept(ec, std::move(socket), *target);
+            });
     }
 
-    void OnAccept(beast::error_code ec, tcp::socket socket) {
+    void OnAccept(beast::error_code ec, tcp::socket socket, Reactor& target) {
         if(ec) {
             spdlog::error("Accept failed: {}", ec.message());
+        } else if (&target == &reactor_) {
+            std::make_shared<HttpSession>(std::move(socket), target)->Run();
         } else {
-            std::make_shared<HttpSession>(std::move(socket))->Run();
+            net::post(target.context(), [socket = std::move(socket), &target]() mutable {
+                std::make_shared<HttpSession>(std::move(socket), target)->Run();
+            });
         }
         
         // Accept next
@@ -0,0 +1,92 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <mutex>
+#include <unordered_map>
+#include <boost/container/small_vector.hpp>
+
+// Sharded user_id -> sessions registry.
+// user_id hashes to one of kShards shards, each guarded by its own shared_mutex,
+// so login storms and push fan-out only contend when they hit the same shard.
+// Pushes take the shard lock in shared mode; Join/Leave take it exclusively.
+template<class Session>
+class ShardedSessionRegistry {
+public:
+    static constexpr size_t kShards = 64;
+
+    using SessionPtr = std::shared_ptr<Session>;
+    // Most users have 1-2 devices: keep them inline, no per-user node allocations
+    using DeviceList = boost::container::small_vector<SessionPtr, 2>;
+
+    // Returns the number of sessions the user has after joining
+    size_t Join(int64_t user_id, SessionPtr session) {
+        Shard& shard = ShardFor(user_id);
+        std::unique_lock<std::shared_mutex> lock(shard.mtx);
+        DeviceList& devices = shard.users[user_id];
+        for (const auto& s : devices) {
+            if (s == session) return devices.size();
+        }
+        devices.push_back(std::move(session));
+        return devices.size();
+    }
+
+    // Returns true if the session was registered
+    bool Leave(int64_t user_id, const SessionPtr& session) {
+        Shard& shard = ShardFor(user_id);
+        std::unique_lock<std::shared_mutex> lock(shard.mtx);
+        auto it = shard.users.find(user_id);
+        if (it == shard.users.end()) return false;
+
+        DeviceList& devices = it->second;
+        for (size_t i = 0; i < devices.size(); ++i) {
+            if (devices[i] == session) {
+                // Order does not matter: swap with last and pop
+                devices[i] = std::move(devices.back());
+                devices.pop_back();
+                if (devices.empty()) shard.users.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Calls fn(session) for every session of user_id under the shard's shared lock.
+    // fn must be cheap and must not call back into the registry.
+    template<class Fn>
+    size_t ForEach(int64_t user_id, Fn&& fn) {
+        Shard& shard = ShardFor(user_id);
+        std::shared_lock<std::shared_mutex> lock(shard.mtx);
+        auto it = shard.users.find(user_id);
+        if (it == shard.users.end()) return 0;
+        for (const auto& session : it->second) {
+            fn(session);
+        }
+        return it->second.size();
+    }
+
+    size_t UserCount() const {
+        size_t total = 0;
+        for (const auto& shard : shards_) {
+            std::shared_lock<std::shared_mutex> lock(shard.mtx);
+            total += shard.users.size();
+        }
+        return total;
+    }
+
+private:
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mtx;
+        std::unordered_map<int64_t, DeviceList> users;
+    };
+
+    Shard& ShardFor(int64_t user_id) {
+        // Fibonacci hashing: spreads sequential ids across shards
+        uint64_t h = static_cast<uint64_t>(user_id) * 0x9E3779B97F4A7C15ull;
+        return shards_[h >> 58]; // top 6 bits -> 64 shards
+    }
+
+    static_assert(kShards == 64, "ShardFor takes the top 6 bits of the hash");
+    std::array<Shard, kShards> shards_;
+};
@@ -7,7 +7,11 @@
 #include "chat.grpc.pb.h"
 #include "relation.grpc.pb.h"
 #include "auth.grpc.pb.h" // Added for LoginReq
-#include "redis_client.h" // Added header
+#include "async_redis_client.h"
+#include "config.h"
+#include "gateway_stats.h"
+#include "trace.h"
+#include "metrics.h"
 #ifdef _WIN32
 #include <winsock2.h>
 #pragma comment(lib, "ws2_32.lib")
@@ -17,9 +21,30 @@
 namespace http = boost::beast::http;
 using grpc::Status; // Added using
 
-WebsocketSession::WebsocketSession(tcp::socket&& socket)
+// Open sessions and bytes waiting in their write queues, summed over all reactors
+static Gauge& SessionsGauge() {
+    static Gauge& g = Metrics::GetInstance().GetGauge("tinyim_gateway_sessions", "Open WebSocket sessions");
+    return g;
+}
+
+static Gauge& QueuedBytesGauge() {
+    static Gauge& g = Metrics::GetInstance().GetGauge("tinyim_gateway_write_queue_bytes",
+                                                      "Bytes queued for writing, all sessions");
+    return g;
+}
+
+int64_t WebsocketSession::OpenSessions() {
+    return SessionsGauge().Value();
+}
+
+int64_t WebsocketSession::QueuedBytes() {
+    return QueuedBytesGauge().Value();
+}
+
+WebsocketSession::WebsocketSession(tcp::socket&& socket, Reactor& reactor)
     : ws_(std::move(socket))
-    , strand_(boost::asio::make_strand(static_cast<boost::asio::io_context&>(ws_.get_executor().context()))) {
+    , reactor_(reactor)
+    , notify_timer_(ws_.get_executor()) {
     
     // Enable built-in heartbeat and timeout logic here to ensure it's active early
     websocket::stream_base::timeout opt{
@@ -29,12 +54,25 @@ WebsocketSession::WebsocketSession(tcp::socket&& socket)
     };
     ws_.set_option(opt);
     ws_.binary(true);
+
+    max_inflight_ = Config::GetInstance().GetInt("gateway.max_inflight_per_session", 32);
+    write_batch_bytes_ = Config::GetInstance().GetInt("gateway.write_batch_bytes", 64 * 1024);
+    high_watermark_ = Config::GetInstance().GetInt("gateway.write_high_watermark", 1024 * 1024);
+    low_watermark_ = Config::GetInstance().GetInt("gateway.write_low_watermark", 256 * 1024);
+    hard_limit_ = Config::GetInstance().GetInt("gateway.write_hard_limit", 4 * 1024 * 1024);
+    notify_coalesce_ms_ = Config::GetInstance().GetInt("gateway.notify_coalesce_ms", 0);
     
     // Set decorators
     ws_.set_option(websocket::stream_base::decorator(
         [](websocket::response_type& res) {
             res.set(http::field::server, "TinyIM Gateway");
         }));
+    SessionsGauge().Add(1);
+}
+
+WebsocketSession::~WebsocketSession() {
+    SessionsGauge().Sub(1);
+    QueuedBytesGauge().Sub(static_cast<int64_t>(queued_bytes_));
 }
 
 void WebsocketSession::Run() {
@@ -58,7 +96,8 @@ void WebsocketSession::OnAccept(beast::error_code ec) {
             std::string grpc_addr = "127.0.0.1:" + std::to_string(port + 10000);
             
             std::string key = "im:location:" + std::to_string(user_id_);
-            RedisClient::GetInstance().HSet(key, device_, grpc_addr);
+            reactor_.redis().HSet(key, device_, grpc_addr);
+            grpc_addr_ = grpc_addr;
             
             spdlog::info("Registered Location & Session: user={} dev={} addr={}", user_id_, device_, grpc_addr);
         } catch(...) {
@@ -79,46 +118,121 @@ void WebsocketSession::DoRead() {
 
 #include "service_registry.h" // Added
 #include "grpc_channel_pool.h"
-#include "config.h"
 
 // gRPC Client Helper
-// gRPC Client Helper
-static std::unique_ptr<tinyim::chat::ChatService::Stub> GetChatStub() {
+// Stubs are thread-safe and bound to a pooled channel, so one instance is shared
+// by every session instead of building a new stub per request.
+static tinyim::chat::ChatService::Stub* GetChatStub() {
     // Dynamic Discovery via Config or ServiceRegistry
     // For MVP use Config, default to localhost:50052
-    std::string addr = Config::GetInstance().GetString("chat_service.addr", "127.0.0.1:50052");
-    
-    // Use Channel Pool
-    auto channel = GRPCChannelPool::GetInstance().GetChannel(addr);
-    return tinyim::chat::ChatService::NewStub(channel);
+    static auto stub = tinyim::chat::ChatService::NewStub(
+        GRPCChannelPool::GetInstance().GetChannel(
+            Config::GetInstance().GetString("chat_service.addr", "127.0.0.1:50052")));
+    return stub.get();
+}
+
+// Relation Client Helper
+static tinyim::relation::RelationService::Stub* GetRelationStub() {
+    static auto stub = tinyim::relation::RelationService::NewStub(
+        GRPCChannelPool::GetInstance().GetChannel(
+            Config::GetInstance().GetString("relation_service.addr", "127.0.0.1:50053")));
+    return stub.get();
+}
+
+// State of one outstanding async RPC. Kept alive by the completion callback.
+template<class Req, class Resp>
+struct AsyncCall {
+    grpc::ClientContext ctx;
+    Req req;
+    Resp resp;
+};
+
+template<class Resp, class Req, class Start>
+void WebsocketSession::CallAsync(uint16_t resp_cmd, uint8_t version, uint32_t seq, Req&& req, Start start,
+                                 std::function<void(Resp&, const std::string&)> on_error,
+                                 LatencyHistogram* latency, const Trace* trace) {
+    static const int timeout_ms = Config::GetInstance().GetInt("gateway.rpc_timeout_ms", 5000);
+
+    auto call = std::make_shared<AsyncCall<std::decay_t<Req>, Resp>>();
+    call->req = std::move(req);
+    call->ctx.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(timeout_ms));
+    if (trace) call->ctx.AddMetadata(Trace::kMetadataKey, trace->Encode());
+    auto started = std::chrono::steady_clock::now();
+
+    inflight_++;
+    start(&call->ctx, &call->req, &call->resp,
+        [self = shared_from_this(), call, resp_cmd, version, seq, on_error, latency, started](grpc::Status status) {
+            if (latency) {
+                latency->Record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - started).count());
+            }
+            // Runs on a gRPC callback thread: hop back onto the session's reactor.
+            self->reactor_.Post([self, call, resp_cmd, version, seq, on_error, status]() {
+                if (!status.ok()) {
+                    spdlog::warn("RPC for cmd {} failed (user={}): {}", resp_cmd, self->user_id_, status.error_message());
+                    if (on_error) on_error(call->resp, status.error_message());
+                }
+                std::string b;
+                call->resp.SerializeToString(&b);
+                self->SendPacket(resp_cmd, b, version, seq);
+                self->OnRpcDone();
+            });
+        });
 }
 
-// Relation Client Helper - Moved to outer scope or forward declared
-// Relation Client Helper - Moved to outer scope or forward declared
-static std::unique_ptr<tinyim::relation::RelationService::Stub> GetRelationStub() {
-    std::string addr = Config::GetInstance().GetString("relation_service.addr", "127.0.0.1:50053");
-    auto channel = GRPCChannelPool::GetInstance().GetChannel(addr);
-    return tinyim::relation::RelationService::NewStub(channel);
+void WebsocketSession::OnRpcDone() {
+    int left = --inflight_;
+    // Reader stopped at the cap; wake it up on the socket's executor
+    if (left < max_inflight_ && read_paused_.exchange(false)) {
+        boost::asio::post(ws_.get_executor(), [self = shared_from_this()]() { self->ResumeRead(); });
+    }
+}
+
+void WebsocketSession::ResumeRead() {
+    // An RPC can complete after the read loop failed and the session was closed
+    if (closed_) return;
+    if (ProcessPackets()) DoRead();
 }
 
 void WebsocketSession::OnRead(beast::error_code ec, std::size_t bytes_transferred) {
     if(ec == websocket::error::closed || ec == http::error::end_of_stream) {
         spdlog::info("WS Closed (user={})", user_id_);
-        RedisClient::GetInstance().HDel("im:location:" + std::to_string(user_id_), device_);
-        ConnectionManager::GetInstance().Leave(user_id_, shared_from_this());
-        return;
+        return OnClosed();
     }
     if(ec) {
         spdlog::error("WS Read failed: {}", ec.message());
-        RedisClient::GetInstance().HDel("im:location:" + std::to_string(user_id_), device_);
-        ConnectionManager::GetInstance().Leave(user_id_, shared_from_this());
-        return;
+        return OnClosed();
     }
 
     // Append received data to internal buffer is handled by beast buffer
-    
+    if (Trace::Enabled()) read_at_us_ = Trace::NowUs();
+    if (ProcessPackets()) DoRead();
+} // Close OnRead function
+
+void WebsocketSession::OnClosed() {
+    if (closed_) return;
+    closed_ = true;
+
+    // Only the session that registered drops the location, and only if it still
+    // points here: the user may have logged in again on this or another gateway.
+    if (!ConnectionManager::GetInstance().Leave(user_id_, shared_from_this())) return;
+    if (grpc_addr_.empty() || ConnectionManager::GetInstance().HasDevice(user_id_, device_)) return;
+    reactor_.redis().HDelIfEquals("im:location:" + std::to_string(user_id_), device_, grpc_addr_);
+}
+
+bool WebsocketSession::ProcessPackets() {
     // Process loop
     while (buffer_.size() >= sizeof(PacketHeader)) {
+        // Backpressure: leave the rest in buffer_ until an RPC completes
+        if (inflight_.load() >= max_inflight_) {
+            read_paused_ = true;
+            // An RPC may have finished between the check and the flag store;
+            // if it already claimed the resume, it will post ResumeRead for us.
+            if (inflight_.load() >= max_inflight_ || !read_paused_.exchange(false)) {
+                return false;
+            }
+        }
+
         const char* data_ptr = static_cast<const char*>(buffer_.data().data());
         PacketHeader header;
         std::memcpy(&header, data_ptr, sizeof(PacketHeader));
@@ -126,43 +240,56 @@ void WebsocketSession::OnRead(beast::error_code ec, std::size_t bytes_transferre
         if (header.magic[0] != 'I' || header.magic[1] != 'M') {
             spdlog::error("Invalid Magic, Closing");
             Close();
-            return;
+            return false;
+        }
+
+        // v1 and v2 share the first 9 bytes; v2 appends the client seq
+        uint8_t version = header.version;
+        if (version != PACKET_VERSION_1 && version != PACKET_VERSION_2) {
+            spdlog::error("Unsupported packet version {}, Closing", version);
+            Close();
+            return false;
+        }
+        size_t header_size = PacketHeaderSize(version);
+        if (buffer_.size() < header_size) {
+            break;
+        }
+        uint32_t seq = 0;
+        if (version == PACKET_VERSION_2) {
+            PacketHeaderV2 header_v2;
+            std::memcpy(&header_v2, data_ptr, sizeof(PacketHeaderV2));
+            seq = ntohl(header_v2.seq);
         }
 
         uint32_t body_len = ntohl(header.body_len);
-        if (buffer_.size() < sizeof(PacketHeader) + body_len) {
+        if (buffer_.size() < header_size + body_len) {
             // Wait for more data
             break; 
         }
 
         // Extract Body
-        std::string body(data_ptr + sizeof(PacketHeader), body_len);
+        std::string body(data_ptr + header_size, body_len);
         uint16_t cmd_id = ntohs(header.cmd_id);
         
-        spdlog::info("Recv Packet: User={} Cmd={} Len={}", user_id_, cmd_id, body_len);
+        spdlog::info("Recv Packet: User={} Cmd={} Len={} Seq={}", user_id_, cmd_id, body_len, seq);
 
         // Handle Commands
+        // RPC-backed commands are dispatched asynchronously; replies are written from the reactor thread.
         if (cmd_id == CMD_MSG_SEND_REQ) {
             tinyim::chat::SendMessageReq req;
             if (req.ParseFromString(body)) {
                 // Override sender_id with session user_id (Security)
                 req.set_sender_id(user_id_);
-                
-                grpc::ClientContext context;
-                tinyim::chat::SendMessageResp resp;
-                Status status = GetChatStub()->SendMessage(&context, req, &resp);
-                
-                // Reply to Client
-                tinyim::chat::SendMessageResp client_resp = resp;
-                if (!status.ok()) {
-                    client_resp.set_success(false);
-                    client_resp.set_error_message(status.error_message());
-                }
-                
-                std::string resp_body;
-                client_resp.SerializeToString(&resp_body);
-                SendPacket(CMD_MSG_SEND_RESP, resp_body);
-                
+                // The message's trace starts when its bytes came off the socket
+                Trace trace;
+                if (Trace::Enabled()) trace.Mark(TraceStage::kGatewayRecv, read_at_us_);
+                CallAsync<tinyim::chat::SendMessageResp>(CMD_MSG_SEND_RESP, version, seq, std::move(req),
+                    [](auto* ctx, auto* rq, auto* rs, auto done) { GetChatStub()->async()->SendMessage(ctx, rq, rs, std::move(done)); },
+                    [](tinyim::chat::SendMessageResp& resp, const std::string& err) {
+                        resp.set_success(false);
+                        resp.set_error_message(err);
+                    },
+                    &TraceStats::GetInstance().send_rpc(), trace.empty() ? nullptr : &trace);
             } else {
                 spdlog::warn("Parse SendMsgReq failed");
             }
@@ -171,108 +298,84 @@ void WebsocketSession::OnRead(beast::error_code ec, std::size_t bytes_transferre
             tinyim::relation::ApplyFriendReq req;
             if(req.ParseFromString(body)) {
                 req.set_user_id(user_id_);
-                grpc::ClientContext ctx; tinyim::relation::ApplyFriendResp resp;
-                GetRelationStub()->ApplyFriend(&ctx, req, &resp);
-                std::string b; resp.SerializeToString(&b);
-                SendPacket(CMD_FRIEND_APPLY_RESP, b);
+                CallAsync<tinyim::relation::ApplyFriendResp>(CMD_FRIEND_APPLY_RESP, version, seq, std::move(req),
+                    [](auto* ctx, auto* rq, auto* rs, auto done) { GetRelationStub()->async()->ApplyFriend(ctx, rq, rs, std::move(done)); });
             }
         }
         else if (cmd_id == CMD_FRIEND_ACCEPT_REQ) {
             tinyim::relation::AcceptFriendReq req;
             if(req.ParseFromString(body)) {
                 req.set_user_id(user_id_); // Acceptor
-                grpc::ClientContext ctx; tinyim::relation::AcceptFriendResp resp;
-                GetRelationStub()->AcceptFriend(&ctx, req, &resp);
-                std::string b; resp.SerializeToString(&b);
-                SendPacket(CMD_FRIEND_ACCEPT_RESP, b);
+                CallAsync<tinyim::relation::AcceptFriendResp>(CMD_FRIEND_ACCEPT_RESP, version, seq, std::move(req),
+                    [](auto* ctx, auto* rq, auto* rs, auto done) { GetRelationStub()->async()->AcceptFriend(ctx, rq, rs, std::move(done)); });
             }
         }
         else if (cmd_id == CMD_FRIEND_LIST_REQ) {
             tinyim::relation::GetFriendListReq req;
             req.set_user_id(user_id_);
-            grpc::ClientContext ctx; tinyim::relation::GetFriendListResp resp;
-            GetRelationStub()->GetFriendList(&ctx, req, &resp);
-            std::string b; resp.SerializeToString(&b);
-            SendPacket(CMD_FRIEND_LIST_RESP, b);
+            CallAsync<tinyim::relation::GetFriendListResp>(CMD_FRIEND_LIST_RESP, version, seq, std::move(req),
+                [](auto* ctx, auto* rq, auto* rs, auto done) { GetRelationStub()->async()->GetFriendList(ctx, rq, rs, std::move(done)); });
         }
         // --- Group ---
         else if (cmd_id == CMD_GROUP_CREATE_REQ) {
             tinyim::relation::CreateGroupReq req;
             if(req.ParseFromString(body)) {
                 req.set_owner_id(user_id_);
-                grpc::ClientContext ctx; tinyim::relation::CreateGroupResp resp;
-                GetRelationStub()->CreateGroup(&ctx, req, &resp);
-                std::string b; resp.SerializeToString(&b);
-                SendPacket(CMD_GROUP_CREATE_RESP, b);
+                CallAsync<tinyim::relation::CreateGroupResp>(CMD_GROUP_CREATE_RESP, version, seq, std::move(req),
+                    [](auto* ctx, auto* rq, auto* rs, auto done) { GetRelationStub()->async()->CreateGroup(ctx, rq, rs, std::move(done)); });
             }
         }
         else if (cmd_id == CMD_GROUP_JOIN_REQ) {
             tinyim::relation::JoinGroupReq req;
             if(req.ParseFromString(body)) {
                 req.set_user_id(user_id_);
-                grpc::ClientContext ctx; tinyim::relation::JoinGroupResp resp;
-                GetRelationStub()->JoinGroup(&ctx, req, &resp);
-                std::string b; resp.SerializeToString(&b);
-                SendPacket(CMD_GROUP_JOIN_RESP, b);
+                CallAsync<tinyim::relation::JoinGroupResp>(CMD_GROUP_JOIN_RESP, version, seq, std::move(req),
+                    [](auto* ctx, auto* rq, auto* rs, auto done) { GetRelationStub()->async()->JoinGroup(ctx, rq, rs, std::move(done)); });
             }
         }
         else if (cmd_id == CMD_GROUP_LIST_REQ) {
             tinyim::relation::GetGroupListReq req;
             req.set_user_id(user_id_);
-            grpc::ClientContext ctx; tinyim::relation::GetGroupListResp resp;
-            GetRelationStub()->GetGroupList(&ctx, req, &resp);
-            std::string b; resp.SerializeToString(&b);
-            SendPacket(CMD_GROUP_LIST_RESP, b);
+            CallAsync<tinyim::relation::GetGroupListResp>(CMD_GROUP_LIST_RESP, version, seq, std::move(req),
+                [](auto* ctx, auto* rq, auto* rs, auto done) { GetRelationStub()->async()->GetGroupList(ctx, rq, rs, std::move(done)); });
         }
         else if (cmd_id == CMD_GROUP_APPLY_REQ) {
             tinyim::relation::ApplyGroupReq req;
             if(req.ParseFromString(body)) {
                 req.set_user_id(user_id_);
-                grpc::ClientContext ctx; tinyim::relation::ApplyGroupResp resp;
-                GetRelationStub()->ApplyGroup(&ctx, req, &resp);
-                std::string b; resp.SerializeToString(&b);
-                SendPacket(CMD_GROUP_APPLY_RESP, b);
+                CallAsync<tinyim::relation::ApplyGroupResp>(CMD_GROUP_APPLY_RESP, version, seq, std::move(req),
+                    [](auto* ctx, auto* rq, auto* rs, auto done) { GetRelationStub()->async()->ApplyGroup(ctx, rq, rs, std::move(done)); });
             }
         }
         else if (cmd_id == CMD_GROUP_ACCEPT_REQ) {
             tinyim::relation::AcceptGroupReq req;
             if(req.ParseFromString(body)) {
                 req.set_user_id(user_id_);
-                grpc::ClientContext ctx; tinyim::relation::AcceptGroupResp resp;
-                GetRelationStub()->AcceptGroup(&ctx, req, &resp);
-                std::string b; resp.SerializeToString(&b);
-                SendPacket(CMD_GROUP_ACCEPT_RESP, b);
+                CallAsync<tinyim::relation::AcceptGroupResp>(CMD_GROUP_ACCEPT_RESP, version, seq, std::move(req),
+                    [](auto* ctx, auto* rq, auto* rs, auto done) { GetRelationStub()->async()->AcceptGroup(ctx, rq, rs, std::move(done)); });
             }
         }
         else if (cmd_id == CMD_MSG_SYNC_REQ) {
             tinyim::chat::SyncMessagesReq req;
             if (req.ParseFromString(body)) {
                 req.set_user_id(user_id_);
-                
-                grpc::ClientContext context;
-                tinyim::chat::SyncMessagesResp resp;
-                Status status = GetChatStub()->SyncMessages(&context, req, &resp);
-                 
-                // Reply
-                std::string resp_body;
-                if (status.ok()) {
-                     resp.SerializeToString(&resp_body);
-                } else {
-                     // Empty resp with success=false
-                     tinyim::chat::SyncMessagesResp err_resp;
-                     err_resp.set_success(false);
-                     err_resp.SerializeToString(&resp_body);
-                }
-                SendPacket(CMD_MSG_SYNC_RESP, resp_body);
+                CallAsync<tinyim::chat::SyncMessagesResp>(CMD_MSG_SYNC_RESP, version, seq, std::move(req),
+                    [](auto* ctx, auto* rq, auto* rs, auto done) { GetChatStub()->async()->SyncMessages(ctx, rq, rs, std::move(done)); },
+                    [](tinyim::chat::SyncMessagesResp& resp, const std::string&) {
+                        // Empty resp with success=false
+                        resp.Clear();
+                        resp.set_success(false);
+                    },
+                    &TraceStats::GetInstance().sync_rpc());
             }
         } else if (cmd_id == CMD_HEARTBEAT_REQ) {
             // Reply Heartbeat
-            SendPacket(CMD_HEARTBEAT_RESP, "");
+            SendPacket(CMD_HEARTBEAT_RESP, "", version, seq);
         } else if (cmd_id == CMD_LOGIN_REQ) {
             spdlog::info("Processing CMD_LOGIN_REQ");
             // If already authenticated, just success
             if (user_id_ > 0) {
-                 SendPacket(CMD_LOGIN_RESP, "");
+                 SendPacket(CMD_LOGIN_RESP, "", version, seq);
             } else {
                  // Parse LoginReq
                  tinyim::auth::LoginReq req;
@@ -294,7 +397,8 @@ void WebsocketSession::OnRead(beast::error_code ec, std::size_t bytes_transferre
                           int port = ep.port();
                           std::string grpc_addr = "127.0.0.1:" + std::to_string(port + 10000); // 80 -> 180
                           std::string key = "im:location:" + std::to_string(user_id_);
-                          RedisClient::GetInstance().HSet(key, device_, grpc_addr);
+                          reactor_.redis().HSet(key, device_, grpc_addr);
+                          grpc_addr_ = grpc_addr;
                           
                           // Send Success
                           tinyim::auth::LoginResp resp;
@@ -304,7 +408,7 @@ void WebsocketSession::OnRead(beast::error_code ec, std::size_t bytes_transferre
                           
                           std::string resp_data;
                           resp.SerializeToString(&resp_data);
-                          SendPacket(CMD_LOGIN_RESP, resp_data); 
+                          SendPacket(CMD_LOGIN_RESP, resp_data, version, seq);
                           
                       } catch (...) {
                           spdlog::error("Invalid UserID format in LoginReq");
@@ -318,51 +422,74 @@ void WebsocketSession::OnRead(beast::error_code ec, std::size_t bytes_transferre
         } 
         
         // Consume processed data
-        buffer_.consume(sizeof(PacketHeader) + body_len);
+        buffer_.consume(header_size + body_len);
     }
     
-    DoRead();
-} // Close OnRead function
+    return true;
+}
 
-void WebsocketSession::SendPacket(uint16_t cmd_id, const std::string& body) {
-    PacketHeader header;
-    header.magic[0] = 'I'; header.magic[1] = 'M';
-    header.version = 1;
-    header.cmd_id = htons(cmd_id);
-    header.body_len = htonl(body.size());
-    
-    std::string packet;
-    packet.resize(sizeof(PacketHeader) + body.size());
-    memcpy(&packet[0], &header, sizeof(PacketHeader));
-    if (!body.empty()) {
-        memcpy(&packet[sizeof(PacketHeader)], body.data(), body.size());
-    }
-    Send(packet);
+void WebsocketSession::SendPacket(uint16_t cmd_id, const std::string& body, uint8_t version, uint32_t seq) {
+    Send(Frame(cmd_id, body, version, seq));
 }
 
 void WebsocketSession::DoWrite() {
-    // Must be called inside strand
-    if (is_writing_ || write_queue_.empty()) return;
+    // Must be called on the reactor thread
+    if (is_writing_ || evicted_ || write_queue_.empty()) return;
     
     is_writing_ = true;
-    auto& msg = write_queue_.front();
-    
-    ws_.async_write(boost::asio::buffer(msg),
-        boost::asio::bind_executor(strand_,
-            beast::bind_front_handler(&WebsocketSession::OnWrite, shared_from_this())));
+
+    // Drain the queue into one gathered write: a burst of N packets costs one WS
+    // message and one syscall. At least one frame, then up to write_batch_bytes_.
+    // writing_ keeps the frames alive until OnWrite.
+    size_t bytes = 0;
+    while (!write_queue_.empty() &&
+           (writing_.empty() || bytes + write_queue_.front().size() <= write_batch_bytes_)) {
+        bytes += write_queue_.front().size();
+        writing_.push_back(std::move(write_queue_.front()));
+        write_queue_.pop_front();
+        write_buffers_.push_back(writing_.back().buffer());
+    }
+    queued_bytes_ -= bytes;
+    QueuedBytesGauge().Sub(static_cast<int64_t>(bytes));
+
+    ws_.async_write(write_buffers_,
+        beast::bind_front_handler(&WebsocketSession::OnWrite, shared_from_this()));
 }
 
 void WebsocketSession::OnWrite(beast::error_code ec, std::size_t bytes_transferred) {
-    if (ec) {
-        spdlog::error("WS Write failed: {}", ec.message());
-        // Should we close? Ideally yes.
-        // Close();
-        // Clear queue?
+    // Traced push notifies reached the client's socket
+    if (!ec) {
+        int64_t now_us = 0;
+        for (const Frame& f : writing_) {
+            if (!f.trace()) continue;
+            if (now_us == 0) now_us = Trace::NowUs();
+            Trace delivered = *f.trace();
+            delivered.Mark(TraceStage::kPushDelivered, now_us);
+            TraceStats::GetInstance().Record(delivered, TraceStage::kPushDelivered, TraceStage::kPushDelivered);
+        }
     }
-    
-    // Remove sent message
-    if (!write_queue_.empty()) write_queue_.pop();
+
+    // Release the sent frames
+    writing_.clear();
+    write_buffers_.clear();
     is_writing_ = false;
+
+    if (ec) {
+        if (evicted_) return;
+        spdlog::error("WS Write failed (user={}): {}", user_id_, ec.message());
+        // The stream is unusable: drop what is queued and let the read side clean up
+        GatewayStats::GetInstance().write_errors++;
+        Evict("write failed");
+        return;
+    }
+
+    if (congested_ && queued_bytes_ <= low_watermark_) {
+        congested_ = false;
+        spdlog::info("Write queue of user {} drained to {} bytes", user_id_, queued_bytes_);
+    }
+
+    // A notify held back while this write was in flight goes out with the next one
+    if (!close_after_write_) FlushNotify();
     
     // Continue
     if (!write_queue_.empty() && !ec) {
@@ -375,35 +502,104 @@ void WebsocketSession::OnWrite(beast::error_code ec, std::size_t bytes_transferr
 }
 
 void WebsocketSession::Kick() {
-    boost::asio::post(strand_, [self = shared_from_this()]() {
+    reactor_.Post([self = shared_from_this()]() {
         // Construct Kick Packet
-        PacketHeader header;
-        header.magic[0] = 'I'; header.magic[1] = 'M';
-        header.version = 1;
-        header.cmd_id = htons(CMD_LOGOUT_RESP);
-        
-        std::string body = "Kicked by new login";
-        header.body_len = htonl(body.size());
-        
-        std::string packet;
-        packet.resize(sizeof(header) + body.size());
-        memcpy(&packet[0], &header, sizeof(header));
-        memcpy(&packet[sizeof(header)], body.data(), body.size());
-        
-        self->write_queue_.push(packet);
         self->close_after_write_ = true;
-        
-        self->DoWrite();
+        self->Enqueue(Frame(CMD_LOGOUT_RESP, "Kicked by new login"));
+    });
+}
+
+void WebsocketSession::Send(Frame frame) {
+    if (reactor_.InThisThread()) {
+        Enqueue(std::move(frame));
+        return;
+    }
+    reactor_.Post([self = shared_from_this(), frame = std::move(frame)]() mutable {
+        self->Enqueue(std::move(frame));
     });
 }
 
-void WebsocketSession::Send(const std::string& msg) {
-    boost::asio::post(strand_, [self = shared_from_this(), msg]() {
-        self->write_queue_.push(msg);
-        self->DoWrite();
+void WebsocketSession::Enqueue(Frame frame) {
+    if (evicted_) return;
+
+    if (frame.cmd_id() == CMD_MSG_PUSH_NOTIFY && (is_writing_ || notify_coalesce_ms_ > 0)) {
+        HoldNotify(std::move(frame));
+        return;
+    }
+    PushFrame(std::move(frame));
+}
+
+void WebsocketSession::HoldNotify(Frame frame) {
+    if (held_notifies_.Hold(std::move(frame))) GatewayStats::GetInstance().notifies_coalesced++;
+
+    // Released by OnWrite if a write is in flight, otherwise when the window closes
+    if (is_writing_ || notify_timer_armed_) return;
+    notify_timer_armed_ = true;
+    notify_timer_.expires_after(std::chrono::milliseconds(notify_coalesce_ms_));
+    notify_timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+        self->notify_timer_armed_ = false;
+        if (!ec) self->FlushNotify();
     });
 }
 
+void WebsocketSession::FlushNotify() {
+    if (held_notifies_.empty() || evicted_) return;
+    for (Frame& frame : held_notifies_.Take()) {
+        if (evicted_) break; // Over the hard limit while flushing
+        PushFrame(std::move(frame));
+    }
+}
+
+void WebsocketSession::PushFrame(Frame frame) {
+    bool is_notify = frame.cmd_id() == CMD_MSG_PUSH_NOTIFY;
+    queued_bytes_ += frame.size();
+    QueuedBytesGauge().Add(static_cast<int64_t>(frame.size()));
+    write_queue_.push_back(std::move(frame));
+
+    if (!congested_ && queued_bytes_ >= high_watermark_) {
+        congested_ = true;
+        GatewayStats::GetInstance().congestions++;
+        spdlog::warn("Write queue of user {} over high watermark ({} bytes)", user_id_, queued_bytes_);
+        CollapseNotifies();
+    } else if (congested_ && is_notify) {
+        CollapseNotifies();
+    }
+
+    if (queued_bytes_ > hard_limit_) {
+        GatewayStats::GetInstance().evictions++;
+        Evict("write queue over hard limit");
+        return;
+    }
+    DoWrite();
+}
+
+void WebsocketSession::CollapseNotifies() {
+    size_t before = queued_bytes_;
+    size_t dropped = NotifyCoalescer::Collapse(write_queue_, queued_bytes_);
+    QueuedBytesGauge().Sub(static_cast<int64_t>(before) - static_cast<int64_t>(queued_bytes_));
+    if (dropped > 0) GatewayStats::GetInstance().notifies_collapsed += dropped;
+}
+
+void WebsocketSession::Evict(const char* reason) {
+    if (evicted_) return;
+    evicted_ = true;
+
+    GatewayStats::GetInstance().frames_dropped += write_queue_.size();
+    spdlog::warn("Disconnecting user {} dev {} ({}), {} bytes queued", user_id_, device_, reason, queued_bytes_);
+
+    write_queue_.clear();
+    QueuedBytesGauge().Sub(static_cast<int64_t>(queued_bytes_));
+    queued_bytes_ = 0;
+    held_notifies_.Clear();
+    notify_timer_.cancel();
+
+    // No close handshake: the peer is not reading. Closing the socket fails the
+    // pending read, whose handler unregisters the session.
+    beast::error_code ec;
+    beast::get_lowest_layer(ws_).socket().shutdown(tcp::socket::shutdown_both, ec);
+    beast::get_lowest_layer(ws_).socket().close(ec);
+}
+
 void WebsocketSession::Close() {
     ws_.async_close(websocket::close_code::normal,
         [self = shared_from_this()](beast::error_code ec) {});
@@ -2,10 +2,17 @@
 
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
-#include <boost/asio/strand.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <memory>
 #include <string>
-#include <queue> // Added
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include "frame.h"
+#include "notify_coalescer.h"
+#include "latency_histogram.h"
+#include "reactor.h"
 
 namespace beast = boost::beast;
 namespace websocket = beast::websocket;
@@ -18,14 +25,44 @@ class WebsocketSession : public std::enable_shared_from_this<WebsocketSession> {
     std::string device_; // Device info from Token/Param
     int64_t user_id_;
     
-    // Thread Safety
-    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
-    std::queue<std::string> write_queue_;
+    // Thread Safety: the session lives on one reactor (single-threaded io_context);
+    // calls from other threads are posted to it
+    Reactor& reactor_;
+    std::deque<Frame> write_queue_; // Shared encoded frames, written without copying
+    size_t queued_bytes_ = 0;
+    // Frames of the write in progress: everything queued when it started, gathered
+    // into one WS message (clients parse consecutive packets out of a message)
+    std::vector<Frame> writing_;
+    std::vector<net::const_buffer> write_buffers_;
+    size_t write_batch_bytes_;  // Max bytes gathered into one write
+    // Slow consumers: above the high watermark queued push notifies are collapsed
+    // until the queue drains below the low one; past the hard limit the client is dropped
+    size_t high_watermark_;
+    size_t low_watermark_;
+    size_t hard_limit_;
+    bool congested_ = false;
+    bool evicted_ = false;
+
+    // Push notify coalescing: a notify waits here for gateway.notify_coalesce_ms, or
+    // until the write in progress completes, and later ones of its kind replace it, so
+    // a burst of messages costs the client one notify (and one sync) per inbox or group
+    NotifyCoalescer held_notifies_;
+    net::steady_timer notify_timer_;
+    bool notify_timer_armed_ = false;
+    int notify_coalesce_ms_;
     bool is_writing_ = false;
     bool close_after_write_ = false; // Graceful close after queue drain
 
+    // Async RPC pipeline: reads keep flowing while RPCs are outstanding,
+    // but stop once max_inflight_ requests are pending for this session.
+    std::atomic<int> inflight_{0};
+    std::atomic<bool> read_paused_{false};
+    int max_inflight_;
+    int64_t read_at_us_ = 0; // Wall clock of the last socket read: where a message trace starts
+
 public:
-    explicit WebsocketSession(tcp::socket&& socket);
+    WebsocketSession(tcp::socket&& socket, Reactor& reactor);
+    ~WebsocketSession();
     
     void Kick(); // New method for graceful kick
     
@@ -37,8 +74,9 @@ public:
     }
 
     void Run();
-    void Send(const std::string& msg);
-    void SendPacket(uint16_t cmd_id, const std::string& body); // Helper
+    void Send(Frame frame);
+    // Helper. version/seq echo the request header (v2 clients pipeline by seq)
+    void SendPacket(uint16_t cmd_id, const std::string& body, uint8_t version = 1, uint32_t seq = 0);
     void Close();
     void SetUserInfo(int64_t uid, std::string dev) { user_id_ = uid; device_ = dev; }
     void SetGrpcAddress(const std::string& addr) { grpc_addr_ = addr; }
@@ -46,12 +84,37 @@ public:
     int64_t GetUserId() const { return user_id_; }
     std::string GetDevice() const { return device_; }
 
+    // Summed over all sessions of the process (also exported as metrics)
+    static int64_t OpenSessions();
+    static int64_t QueuedBytes();
+
 private:
-    std::string grpc_addr_; // Added
+    std::string grpc_addr_; // Location registered in im:location (this gateway's push address)
+    bool closed_ = false;   // OnClosed ran: no more reads
     void OnAccept(beast::error_code ec);
     void DoRead();
     void OnRead(beast::error_code ec, std::size_t bytes_transferred);
+    // Read loop ended: unregister once, however many paths get here
+    void OnClosed();
+    bool ProcessPackets(); // Returns false if reading is paused (in-flight cap hit)
+    void ResumeRead();
+
+    // Issue an async gRPC call; the response is sent back as resp_cmd from the reactor thread,
+    // echoing the request's header version and seq.
+    // on_error may patch the response when the RPC itself fails.
+    // latency, if set, records the round trip; trace, if set, is sent along in the call metadata.
+    template<class Resp, class Req, class Start>
+    void CallAsync(uint16_t resp_cmd, uint8_t version, uint32_t seq, Req&& req, Start start,
+                   std::function<void(Resp&, const std::string&)> on_error = nullptr,
+                   LatencyHistogram* latency = nullptr, const Trace* trace = nullptr);
+    void OnRpcDone();
     
-    void DoWrite(); // Logic to pop queue and write
+    void Enqueue(Frame frame); // Reactor thread only
+    void HoldNotify(Frame frame);
+    void FlushNotify();
+    void PushFrame(Frame frame);
+    void CollapseNotifies();
+    void Evict(const char* reason);
+    void DoWrite(); // Gather queued frames into one write
     void OnWrite(beast::error_code ec, std::size_t bytes_transferred);
 };
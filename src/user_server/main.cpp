@@ -6,6 +6,8 @@
 #include "service_registry.h"
 
 #include "config.h"
+#include "metrics.h"
+#include "rpc_metrics.h"
 
 int main(int argc, char** argv) {
     if (argc > 1) {
@@ -28,9 +30,14 @@ int main(int argc, char** argv) {
     DBPool::GetInstance().Init(db_host, slaves, db_port, db_user, db_pass, db_name, 10);
     
     // Init Redis for Service Registry
-    std::string redis_host = Config::GetInstance().GetString("redis.host", "127.0.0.1");
-    int redis_port = Config::GetInstance().GetInt("redis.port", 6379);
-    RedisClient::GetInstance().Init(redis_host, redis_port);
+    std::vector<std::string> redis_nodes = Config::GetInstance().GetStringList("redis.nodes");
+    if (!redis_nodes.empty()) {
+        RedisClient::GetInstance().Init(redis_nodes);
+    } else {
+        std::string redis_host = Config::GetInstance().GetString("redis.host", "127.0.0.1");
+        int redis_port = Config::GetInstance().GetInt("redis.port", 6379);
+        RedisClient::GetInstance().Init(redis_host, redis_port);
+    }
     
     // Register Self to Service Registry
     int port = Config::GetInstance().GetInt("user_service.port", 50053);
@@ -44,9 +51,11 @@ int main(int argc, char** argv) {
     grpc::ServerBuilder builder;
     builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
     builder.RegisterService(&service);
+    AddRpcMetrics(builder);
     
     std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
     spdlog::info("Relation/User Server listening on {}", server_address);
+    MetricsServer::Start(Config::GetInstance().GetInt("metrics.user_port", 9103));
     server->Wait();
     
     return 0;
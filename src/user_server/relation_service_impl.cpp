@@ -1,8 +1,15 @@
 #include "relation_service_impl.h"
 #include "db_pool.h"
+#include "redis_client.h"
 #include <spdlog/spdlog.h>
 #include <sstream>
 
+// The chat server's per-user "in a read-diffusion group" flag (see SyncMessages):
+// dropped on every join so the next sync recomputes it
+static void ClearReadDiffusionFlag(int64_t user_id) {
+    RedisClient::GetInstance().Del("im:rdgroup:" + std::to_string(user_id));
+}
+
 // Helper to get ChatStub
 static std::unique_ptr<tinyim::chat::ChatService::Stub> GetChatStub() {
     static std::shared_ptr<grpc::Channel> channel = grpc::CreateChannel("localhost:50052", grpc::InsecureChannelCredentials());
@@ -193,6 +200,7 @@ Status RelationServiceImpl::JoinGroup(ServerContext* context, const tinyim::rela
          }
     } else {
          reply->set_success(true);
+         ClearReadDiffusionFlag(user_id);
          
          // Notify Group Members (System Message)
          tinyim::chat::SendMessageReq msg_req;
@@ -309,7 +317,7 @@ Status RelationServiceImpl::AcceptGroup(ServerContext* context, const tinyim::re
         // Insert Member
         std::string sql = "INSERT INTO im_group_member (group_id, user_id, role) VALUES (" + 
                           std::to_string(group_id) + ", " + std::to_string(requester_id) + ", 1)";
-        mysql_query(conn.get(), sql.c_str());
+        if (mysql_query(conn.get(), sql.c_str()) == 0) ClearReadDiffusionFlag(requester_id);
         
         // Notify Requester
         tinyim::chat::SendMessageReq msg_req;
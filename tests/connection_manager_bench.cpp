@@ -0,0 +1,114 @@
+// Microbenchmark: SendToUser throughput vs thread count.
+// Compares the old single-mutex registry (unordered_map<uid, set<shared_ptr>>)
+// against ShardedSessionRegistry. Sessions are fakes that only count sends,
+// so the numbers isolate registry lookup/locking cost.
+//
+// Usage: connection_manager_bench [users=100000] [seconds_per_run=2] [max_threads=hw]
+#include "session_registry.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct FakeSession {
+    std::atomic<uint64_t> sent{0};
+    void Send(const std::string& /*msg*/) { sent.fetch_add(1, std::memory_order_relaxed); }
+};
+
+// The pre-sharding layout, kept here as the baseline
+class SingleLockRegistry {
+public:
+    void Join(int64_t uid, std::shared_ptr<FakeSession> s) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        users_[uid].insert(std::move(s));
+    }
+    void SendToUser(int64_t uid, const std::string& msg) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (users_.count(uid)) {
+            for (auto& s : users_[uid]) s->Send(msg);
+        }
+    }
+private:
+    std::mutex mtx_;
+    std::unordered_map<int64_t, std::set<std::shared_ptr<FakeSession>>> users_;
+};
+
+class ShardedRegistry {
+public:
+    void Join(int64_t uid, std::shared_ptr<FakeSession> s) { reg_.Join(uid, std::move(s)); }
+    void SendToUser(int64_t uid, const std::string& msg) {
+        reg_.ForEach(uid, [&msg](const std::shared_ptr<FakeSession>& s) { s->Send(msg); });
+    }
+private:
+    ShardedSessionRegistry<FakeSession> reg_;
+};
+
+template<class Registry>
+double Run(Registry& reg, int64_t users, int threads, int seconds) {
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> total{0};
+    const std::string msg(32, 'x'); // Typical notify packet size
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            std::mt19937_64 gen(t + 1);
+            std::uniform_int_distribution<int64_t> dis(1, users);
+            uint64_t ops = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                // Batch to keep the stop check off the hot path
+                for (int i = 0; i < 256; ++i) {
+                    reg.SendToUser(dis(gen), msg);
+                }
+                ops += 256;
+            }
+            total.fetch_add(ops);
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto& w : workers) w.join();
+    return static_cast<double>(total.load()) / seconds;
+}
+
+template<class Registry>
+void Populate(Registry& reg, int64_t users) {
+    for (int64_t uid = 1; uid <= users; ++uid) {
+        reg.Join(uid, std::make_shared<FakeSession>());
+        if (uid % 4 == 0) reg.Join(uid, std::make_shared<FakeSession>()); // Second device
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int64_t users = argc > 1 ? std::atoll(argv[1]) : 100000;
+    int seconds = argc > 2 ? std::atoi(argv[2]) : 2;
+    int max_threads = argc > 3 ? std::atoi(argv[3]) : static_cast<int>(std::thread::hardware_concurrency());
+    if (max_threads <= 0) max_threads = 1;
+    if (users <= 0 || seconds <= 0) {
+        std::fprintf(stderr, "usage: %s [users>0] [seconds_per_run>0] [max_threads]\n", argv[0]);
+        return 1;
+    }
+
+    SingleLockRegistry single;
+    ShardedRegistry sharded;
+    Populate(single, users);
+    Populate(sharded, users);
+
+    std::printf("SendToUser throughput, %lld users, %ds per run\n", static_cast<long long>(users), seconds);
+    std::printf("%8s %18s %18s %8s\n", "threads", "single-lock ops/s", "sharded ops/s", "speedup");
+    // Powers of two, then max_threads itself if it is not one
+    for (int threads = 1; threads <= max_threads;
+         threads = (threads * 2 > max_threads && threads != max_threads) ? max_threads : threads * 2) {
+        double a = Run(single, users, threads, seconds);
+        double b = Run(sharded, users, threads, seconds);
+        std::printf("%8d %18.0f %18.0f %7.2fx\n", threads, a, b, b / a);
+    }
+    return 0;
+}
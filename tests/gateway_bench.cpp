@@ -0,0 +1,570 @@
+// Load generator for the gateway: C100K-scale connection counts from a few threads.
+//
+// Opens `connections` WebSocket connections on `threads` io_contexts (no thread
+// per client), logs each one in with a packet LoginReq (user ids from first_uid),
+// counting a client that is not logged in within login_timeout_ms as failed and
+// giving up on stragglers after connect_deadline seconds, then drives a closed loop of heartbeat / send / sync / friend-list requests:
+// one outstanding request per connection, think_ms (randomized) between them,
+// picked by the weights heartbeat= send= sync= friends=. Requests carry v2
+// headers, so responses are matched to requests by seq for latency.
+//
+// The gateway's downstream services are in-process fakes that answer at once
+// (ChatService on fake_chat, RelationService on fake_relation), so the numbers
+// measure the gateway itself. Start the gateway with chat_service.addr /
+// relation_service.addr pointing at them (the config.json defaults match); it
+// still needs Redis for session locations. With push=1 the fake chat service
+// also pushes every sent message to its receiver through the gateway's
+// BatchPushNotify, exercising the push fan-out path.
+//
+// Reports connects/sec, requests/sec, pushes/sec, p50/p99/p999 latency per
+// command, and RSS per connection for the gateway (gateway_pid=<pid>) and for
+// the bench itself.
+//
+// Usage: gateway_bench [key=value ...]
+//   gateway=127.0.0.1:8080 connections=10000 threads=4 duration=30 connect_rate=5000
+//   think_ms=1000 heartbeat=60 send=30 sync=10 friends=0 push=0
+//   login_timeout_ms=10000 connect_deadline=<ramp time + login timeout + 10s>
+//   local_ips=127.0.0.1[,127.0.0.2,...]  (each source IP has ~28k ephemeral ports)
+//   fake_chat=0.0.0.0:50052 fake_relation=0.0.0.0:50053  (empty = don't start)
+//   gateway_pid=<pid> first_uid=10000000
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <grpcpp/grpcpp.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "packet.h"
+#include "auth.pb.h"
+#include "chat.grpc.pb.h"
+#include "relation.grpc.pb.h"
+#include "gateway.grpc.pb.h"
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+// --- Options ---
+
+struct Options {
+    std::map<std::string, std::string> kv;
+
+    std::string Get(const std::string& key, const std::string& def) const {
+        auto it = kv.find(key);
+        return it == kv.end() ? def : it->second;
+    }
+    long long GetInt(const std::string& key, long long def) const {
+        auto it = kv.find(key);
+        return it == kv.end() ? def : std::atoll(it->second.c_str());
+    }
+};
+
+static std::vector<std::string> Split(const std::string& s, char sep) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, sep)) {
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+// VmRSS of a process in KiB, 0 if unavailable
+static long ReadRssKb(const std::string& pid) {
+    std::ifstream f("/proc/" + pid + "/status");
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) return std::atol(line.c_str() + 6);
+    }
+    return 0;
+}
+
+// --- Fake downstream services ---
+
+class FakeChatService final : public tinyim::chat::ChatService::Service {
+public:
+    explicit FakeChatService(std::shared_ptr<grpc::Channel> push_channel)
+        : push_stub_(push_channel ? tinyim::gateway::GatewayService::NewStub(push_channel) : nullptr) {}
+
+    grpc::Status SendMessage(grpc::ServerContext*, const tinyim::chat::SendMessageReq* request,
+                             tinyim::chat::SendMessageResp* reply) override {
+        int64_t id = next_id_.fetch_add(1, std::memory_order_relaxed);
+        reply->set_msg_id(id);
+        reply->set_seq_id(id);
+        reply->set_success(true);
+
+        if (push_stub_) {
+            struct Call {
+                grpc::ClientContext ctx;
+                tinyim::gateway::BatchPushNotifyReq req;
+                tinyim::gateway::BatchPushNotifyResp resp;
+            };
+            auto call = std::make_shared<Call>();
+            auto* item = call->req.add_items();
+            item->set_user_id(request->receiver_id());
+            item->set_max_seq(id);
+            item->set_msg_type(request->type());
+            push_stub_->async()->BatchPushNotify(&call->ctx, &call->req, &call->resp,
+                                                 [call](grpc::Status) {});
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status SyncMessages(grpc::ServerContext*, const tinyim::chat::SyncMessagesReq* request,
+                              tinyim::chat::SyncMessagesResp* reply) override {
+        reply->set_max_seq(request->local_seq());
+        reply->set_success(true);
+        return grpc::Status::OK;
+    }
+
+private:
+    std::atomic<int64_t> next_id_{1};
+    std::unique_ptr<tinyim::gateway::GatewayService::Stub> push_stub_;
+};
+
+class FakeRelationService final : public tinyim::relation::RelationService::Service {
+public:
+    grpc::Status GetFriendList(grpc::ServerContext*, const tinyim::relation::GetFriendListReq*,
+                               tinyim::relation::GetFriendListResp* reply) override {
+        reply->set_success(true);
+        return grpc::Status::OK;
+    }
+};
+
+// --- Load generator ---
+
+enum Op { OP_HEARTBEAT, OP_SEND, OP_SYNC, OP_FRIENDS, OP_LOGIN, OP_COUNT };
+static const char* kOpNames[OP_COUNT] = {"heartbeat", "send", "sync", "friends", "login"};
+
+static std::atomic<bool> g_measuring{false};
+static std::atomic<bool> g_stopping{false};
+
+// Per-thread results, only touched by the owning thread except the atomics
+struct WorkerStats {
+    std::atomic<uint64_t> connected{0};
+    std::atomic<uint64_t> logged_in{0};
+    std::atomic<uint64_t> failed{0};
+    uint64_t requests[OP_COUNT] = {};
+    uint64_t pushes = 0;
+    std::vector<uint32_t> latency_us[OP_COUNT]; // Measured phase only (login: connect phase)
+};
+
+struct Worker {
+    net::io_context ioc{1};
+    WorkerStats stats;
+    std::mt19937_64 rng{std::random_device{}()};
+};
+
+struct Mix {
+    int weights[OP_FRIENDS + 1];
+    int total;
+
+    Op Pick(std::mt19937_64& rng) const {
+        int r = static_cast<int>(rng() % total);
+        for (int op = 0; op <= OP_FRIENDS; ++op) {
+            if (r < weights[op]) return static_cast<Op>(op);
+            r -= weights[op];
+        }
+        return OP_HEARTBEAT;
+    }
+};
+
+struct Shared {
+    tcp::endpoint target;
+    std::string host;
+    int think_ms;
+    int login_timeout_ms; // From connect to login response
+    Mix mix;
+    int64_t first_uid;
+    int64_t connections;
+};
+
+class BenchConn : public std::enable_shared_from_this<BenchConn> {
+public:
+    BenchConn(Worker& worker, const Shared& shared, int64_t uid, net::ip::address local)
+        : worker_(worker), shared_(shared), uid_(uid), local_(local),
+          ws_(worker.ioc), timer_(worker.ioc) {}
+
+    void Start() {
+        auto& sock = beast::get_lowest_layer(ws_).socket();
+        beast::error_code ec;
+        sock.open(shared_.target.protocol(), ec);
+        if (!ec) sock.bind(tcp::endpoint(local_, 0), ec);
+        if (ec) return Fail("bind", ec);
+        // A gateway that never answers (dropped, evicted) must not leave the client pending forever
+        timer_.expires_after(std::chrono::milliseconds(shared_.login_timeout_ms));
+        timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+            if (!ec && !self->logged_in_) self->Fail("login", net::error::timed_out);
+        });
+        sock.async_connect(shared_.target, [self = shared_from_this()](beast::error_code ec) {
+            if (ec) return self->Fail("connect", ec);
+            self->ws_.binary(true);
+            self->ws_.async_handshake(self->shared_.host, "/ws", [self](beast::error_code ec) {
+                if (ec) return self->Fail("handshake", ec);
+                self->worker_.stats.connected.fetch_add(1, std::memory_order_relaxed);
+                self->DoRead();
+                tinyim::auth::LoginReq req;
+                req.set_username(std::to_string(self->uid_));
+                req.set_device("Bench");
+                self->Request(OP_LOGIN, CMD_LOGIN_REQ, req.SerializeAsString());
+            });
+        });
+    }
+
+private:
+    void Fail(const char* stage, beast::error_code ec) {
+        if (!g_stopping.load(std::memory_order_relaxed) && !failed_) {
+            failed_ = true;
+            worker_.stats.failed.fetch_add(1, std::memory_order_relaxed);
+            if (worker_.stats.failed.load(std::memory_order_relaxed) <= 5) {
+                std::fprintf(stderr, "conn %lld %s failed: %s\n", static_cast<long long>(uid_), stage,
+                             ec.message().c_str());
+            }
+        }
+        beast::error_code ignored;
+        timer_.cancel();
+        beast::get_lowest_layer(ws_).socket().close(ignored);
+    }
+
+    void Request(Op op, uint16_t cmd, const std::string& body) {
+        pending_op_ = op;
+        pending_seq_ = ++seq_;
+        out_ = EncodePacket(cmd, body, PACKET_VERSION_2, pending_seq_);
+        sent_at_ = Clock::now();
+        ws_.async_write(net::buffer(out_), [self = shared_from_this()](beast::error_code ec, size_t) {
+            if (ec) self->Fail("write", ec);
+        });
+    }
+
+    void DoRead() {
+        ws_.async_read(in_, [self = shared_from_this()](beast::error_code ec, size_t) {
+            if (ec) return self->Fail("read", ec);
+            self->OnMessage();
+            self->DoRead();
+        });
+    }
+
+    // One WS message may carry several packets (the gateway gathers writes)
+    void OnMessage() {
+        while (in_.size() >= sizeof(PacketHeader)) {
+            const char* p = static_cast<const char*>(in_.data().data());
+            PacketHeader header;
+            std::memcpy(&header, p, sizeof(header));
+            size_t header_size = PacketHeaderSize(header.version);
+            size_t len = ntohl(header.body_len);
+            if (in_.size() < header_size + len) break;
+
+            uint16_t cmd = ntohs(header.cmd_id);
+            uint32_t seq = 0;
+            if (header.version >= PACKET_VERSION_2) {
+                PacketHeaderV2 v2;
+                std::memcpy(&v2, p, sizeof(v2));
+                seq = ntohl(v2.seq);
+            }
+            in_.consume(header_size + len);
+
+            if (cmd == CMD_MSG_PUSH_NOTIFY) {
+                if (g_measuring.load(std::memory_order_relaxed)) worker_.stats.pushes++;
+            } else if (seq != 0 && seq == pending_seq_) {
+                OnResponse();
+            }
+        }
+    }
+
+    void OnResponse() {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sent_at_).count();
+        WorkerStats& stats = worker_.stats;
+        pending_seq_ = 0;
+        if (pending_op_ == OP_LOGIN) {
+            logged_in_ = true; // ScheduleNext below re-arms timer_, cancelling the login timeout
+            stats.logged_in.fetch_add(1, std::memory_order_relaxed);
+            stats.latency_us[OP_LOGIN].push_back(static_cast<uint32_t>(us));
+        } else if (g_measuring.load(std::memory_order_relaxed)) {
+            stats.requests[pending_op_]++;
+            stats.latency_us[pending_op_].push_back(static_cast<uint32_t>(us));
+        }
+        ScheduleNext();
+    }
+
+    void ScheduleNext() {
+        // Think time uniformly in [0.5, 1.5] * think_ms so clients do not move in lockstep
+        int think = shared_.think_ms;
+        int delay = think > 0 ? think / 2 + static_cast<int>(worker_.rng() % (think + 1)) : 0;
+        timer_.expires_after(std::chrono::milliseconds(delay));
+        timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+            if (ec || g_stopping.load(std::memory_order_relaxed)) return;
+            self->Next();
+        });
+    }
+
+    void Next() {
+        Op op = shared_.mix.Pick(worker_.rng);
+        switch (op) {
+            case OP_SEND: {
+                tinyim::chat::SendMessageReq req;
+                req.set_receiver_id(shared_.first_uid + static_cast<int64_t>(worker_.rng() % shared_.connections));
+                req.set_type(tinyim::chat::TEXT);
+                req.set_content(std::string(32, 'x'));
+                Request(op, CMD_MSG_SEND_REQ, req.SerializeAsString());
+                break;
+            }
+            case OP_SYNC: {
+                tinyim::chat::SyncMessagesReq req;
+                req.set_limit(20);
+                Request(op, CMD_MSG_SYNC_REQ, req.SerializeAsString());
+                break;
+            }
+            case OP_FRIENDS:
+                Request(op, CMD_FRIEND_LIST_REQ, "");
+                break;
+            default:
+                Request(OP_HEARTBEAT, CMD_HEARTBEAT_REQ, "");
+                break;
+        }
+    }
+
+    Worker& worker_;
+    const Shared& shared_;
+    int64_t uid_;
+    net::ip::address local_;
+    websocket::stream<beast::tcp_stream> ws_;
+    net::steady_timer timer_;
+    beast::flat_buffer in_;
+    std::string out_;
+    uint32_t seq_ = 0;
+    uint32_t pending_seq_ = 0;
+    Op pending_op_ = OP_HEARTBEAT;
+    Clock::time_point sent_at_;
+    bool logged_in_ = false;
+    bool failed_ = false;
+};
+
+// Opens this worker's share of connections at its share of connect_rate
+static void Ramp(Worker& worker, const Shared& shared, std::vector<std::shared_ptr<BenchConn>>& conns,
+                 const std::vector<int64_t>& uids, const std::vector<net::ip::address>& locals,
+                 double per_tick, std::shared_ptr<net::steady_timer> tick, size_t next, double budget) {
+    budget += per_tick;
+    while (budget >= 1.0 && next < uids.size()) {
+        // Spread source IPs so each stays within its ephemeral port range
+        auto conn = std::make_shared<BenchConn>(worker, shared, uids[next], locals[uids[next] % locals.size()]);
+        conn->Start();
+        conns.push_back(conn);
+        ++next;
+        budget -= 1.0;
+    }
+    if (next >= uids.size()) return;
+    tick->expires_after(std::chrono::milliseconds(10));
+    tick->async_wait([&worker, &shared, &conns, &uids, &locals, per_tick, tick, next, budget](beast::error_code ec) {
+        if (ec || g_stopping.load()) return;
+        Ramp(worker, shared, conns, uids, locals, per_tick, tick, next, budget);
+    });
+}
+
+static uint32_t Percentile(const std::vector<uint32_t>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t i = std::min(sorted.size() - 1, static_cast<size_t>(q * sorted.size()));
+    return sorted[i];
+}
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto eq = a.find('=');
+        if (eq == std::string::npos) {
+            std::fprintf(stderr, "Bad argument '%s' (expected key=value)\n", argv[i]);
+            return 1;
+        }
+        opt.kv[a.substr(0, eq)] = a.substr(eq + 1);
+    }
+
+    std::string gateway = opt.Get("gateway", "127.0.0.1:8080");
+    auto colon = gateway.rfind(':');
+    std::string host = gateway.substr(0, colon);
+    int port = std::atoi(gateway.substr(colon + 1).c_str());
+    int64_t connections = opt.GetInt("connections", 10000);
+    int threads = static_cast<int>(opt.GetInt("threads", 4));
+    int duration = static_cast<int>(opt.GetInt("duration", 30));
+    double connect_rate = static_cast<double>(opt.GetInt("connect_rate", 5000));
+    std::string gateway_pid = opt.Get("gateway_pid", "");
+    if (connections <= 0 || threads <= 0 || connect_rate <= 0) {
+        std::fprintf(stderr, "connections, threads and connect_rate must be positive\n");
+        return 1;
+    }
+
+    // Every connection is a file descriptor
+    rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+        if (static_cast<int64_t>(lim.rlim_cur) < connections + 100) {
+            std::fprintf(stderr, "warning: RLIMIT_NOFILE %llu is below connections=%lld\n",
+                         static_cast<unsigned long long>(lim.rlim_cur), static_cast<long long>(connections));
+        }
+    }
+
+    // --- Fakes ---
+    FakeChatService chat(opt.GetInt("push", 0)
+        ? grpc::CreateChannel(host + ":" + std::to_string(port + 10000), grpc::InsecureChannelCredentials())
+        : nullptr);
+    FakeRelationService relation;
+    std::vector<std::unique_ptr<grpc::Server>> fakes;
+    auto start_fake = [&](const std::string& addr, grpc::Service* service, const char* name) {
+        if (addr.empty()) return;
+        grpc::ServerBuilder builder;
+        builder.AddListeningPort(addr, grpc::InsecureServerCredentials());
+        builder.RegisterService(service);
+        auto server = builder.BuildAndStart();
+        if (!server) {
+            std::fprintf(stderr, "Failed to start fake %s on %s\n", name, addr.c_str());
+            std::exit(1);
+        }
+        std::printf("Fake %s listening on %s\n", name, addr.c_str());
+        fakes.push_back(std::move(server));
+    };
+    start_fake(opt.Get("fake_chat", "0.0.0.0:50052"), &chat, "ChatService");
+    start_fake(opt.Get("fake_relation", "0.0.0.0:50053"), &relation, "RelationService");
+
+    // --- Load ---
+    Shared shared;
+    shared.target = tcp::endpoint(net::ip::make_address(host == "localhost" ? "127.0.0.1" : host), port);
+    shared.host = host;
+    shared.think_ms = static_cast<int>(opt.GetInt("think_ms", 1000));
+    shared.login_timeout_ms = static_cast<int>(std::max(1LL, opt.GetInt("login_timeout_ms", 10000)));
+    shared.mix.weights[OP_HEARTBEAT] = static_cast<int>(opt.GetInt("heartbeat", 60));
+    shared.mix.weights[OP_SEND] = static_cast<int>(opt.GetInt("send", 30));
+    shared.mix.weights[OP_SYNC] = static_cast<int>(opt.GetInt("sync", 10));
+    shared.mix.weights[OP_FRIENDS] = static_cast<int>(opt.GetInt("friends", 0));
+    shared.mix.total = 0;
+    for (int op = 0; op <= OP_FRIENDS; ++op) shared.mix.total += shared.mix.weights[op];
+    if (shared.mix.total <= 0) shared.mix.weights[OP_HEARTBEAT] = shared.mix.total = 1;
+    shared.first_uid = opt.GetInt("first_uid", 10000000);
+    shared.connections = connections;
+
+    std::vector<net::ip::address> locals;
+    for (const auto& ip : Split(opt.Get("local_ips", "127.0.0.1"), ',')) {
+        locals.push_back(net::ip::make_address(ip));
+    }
+
+    long gateway_rss_before = gateway_pid.empty() ? 0 : ReadRssKb(gateway_pid);
+    long self_rss_before = ReadRssKb("self");
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::vector<int64_t>> uids(threads);
+    std::vector<std::vector<std::shared_ptr<BenchConn>>> conns(threads);
+    for (int64_t i = 0; i < connections; ++i) uids[i % threads].push_back(shared.first_uid + i);
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::make_unique<Worker>());
+        conns[t].reserve(uids[t].size());
+    }
+
+    std::printf("Connecting %lld clients to %s on %d threads at %.0f/s...\n",
+                static_cast<long long>(connections), gateway.c_str(), threads, connect_rate);
+    auto connect_start = Clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        Worker& w = *workers[t];
+        auto tick = std::make_shared<net::steady_timer>(w.ioc);
+        double per_tick = connect_rate / threads / 100.0; // 10 ms ticks
+        net::post(w.ioc, [&w, &shared, &conns, &uids, &locals, t, per_tick, tick]() {
+            Ramp(w, shared, conns[t], uids[t], locals, per_tick, tick, 0, 0.0);
+        });
+        pool.emplace_back([&w]() {
+            auto guard = net::make_work_guard(w.ioc);
+            w.ioc.run();
+        });
+    }
+
+    // Connect phase: until every client is logged in or has failed, or the deadline
+    long long connect_deadline = opt.GetInt("connect_deadline",
+        static_cast<long long>(connections / connect_rate) + shared.login_timeout_ms / 1000 + 10);
+    auto deadline = connect_start + std::chrono::seconds(connect_deadline);
+    auto totals = [&](auto field) {
+        uint64_t n = 0;
+        for (auto& w : workers) n += (w->stats.*field).load(std::memory_order_relaxed);
+        return n;
+    };
+    uint64_t logged_in = 0, failed = 0;
+    auto last_report = Clock::now();
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        logged_in = totals(&WorkerStats::logged_in);
+        failed = totals(&WorkerStats::failed);
+        if (logged_in + failed >= static_cast<uint64_t>(connections)) break;
+        if (Clock::now() >= deadline) {
+            std::fprintf(stderr, "Connect deadline (%llds) passed with %llu clients neither logged in nor failed\n",
+                         connect_deadline, static_cast<unsigned long long>(connections - logged_in - failed));
+            break;
+        }
+        if (Clock::now() - last_report >= std::chrono::seconds(1)) {
+            last_report = Clock::now();
+            std::printf("  connected=%llu logged_in=%llu failed=%llu\n",
+                        static_cast<unsigned long long>(totals(&WorkerStats::connected)),
+                        static_cast<unsigned long long>(logged_in), static_cast<unsigned long long>(failed));
+        }
+    }
+    double connect_secs = std::chrono::duration<double>(Clock::now() - connect_start).count();
+    long gateway_rss_after = gateway_pid.empty() ? 0 : ReadRssKb(gateway_pid);
+    long self_rss_after = ReadRssKb("self");
+
+    // Measured phase
+    std::printf("Measuring for %ds...\n", duration);
+    g_measuring = true;
+    std::this_thread::sleep_for(std::chrono::seconds(duration));
+    g_measuring = false;
+    g_stopping = true;
+    for (auto& w : workers) w->ioc.stop();
+    for (auto& th : pool) th.join();
+
+    // --- Report ---
+    std::printf("\nConnections: %llu logged in, %llu failed, %llu still pending, %.1fs (%.0f connects/s)\n",
+                static_cast<unsigned long long>(logged_in), static_cast<unsigned long long>(failed),
+                static_cast<unsigned long long>(connections - logged_in - failed),
+                connect_secs, logged_in / connect_secs);
+    if (logged_in > 0) {
+        if (!gateway_pid.empty()) {
+            std::printf("Gateway RSS: %ld -> %ld MiB, %.1f KiB per connection\n",
+                        gateway_rss_before / 1024, gateway_rss_after / 1024,
+                        static_cast<double>(gateway_rss_after - gateway_rss_before) / logged_in);
+        }
+        std::printf("Bench RSS:   %ld -> %ld MiB, %.1f KiB per connection\n",
+                    self_rss_before / 1024, self_rss_after / 1024,
+                    static_cast<double>(self_rss_after - self_rss_before) / logged_in);
+    }
+
+    uint64_t total_requests = 0, pushes = 0;
+    std::printf("\n%-10s %12s %10s %10s %10s %10s\n", "command", "count", "req/s", "p50(us)", "p99(us)", "p999(us)");
+    for (int op = 0; op < OP_COUNT; ++op) {
+        std::vector<uint32_t> all;
+        uint64_t count = 0;
+        for (auto& w : workers) {
+            all.insert(all.end(), w->stats.latency_us[op].begin(), w->stats.latency_us[op].end());
+            count += op == OP_LOGIN ? w->stats.latency_us[op].size() : w->stats.requests[op];
+        }
+        if (count == 0) continue;
+        std::sort(all.begin(), all.end());
+        double secs = op == OP_LOGIN ? connect_secs : duration;
+        if (op != OP_LOGIN) total_requests += count;
+        std::printf("%-10s %12llu %10.0f %10u %10u %10u\n", kOpNames[op], static_cast<unsigned long long>(count),
+                    count / secs, Percentile(all, 0.50), Percentile(all, 0.99), Percentile(all, 0.999));
+    }
+    for (auto& w : workers) pushes += w->stats.pushes;
+    std::printf("\nTotal: %.0f requests/s, %.0f pushes/s\n",
+                static_cast<double>(total_requests) / duration, static_cast<double>(pushes) / duration);
+
+    for (auto& server : fakes) server->Shutdown();
+    return 0;
+}
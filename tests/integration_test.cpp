@@ -4,7 +4,19 @@
 #include "chat.pb.h"
 #include "service_registry.h"
 #include "redis_client.h"
+#include "id_generator.h"
+#include "mpsc_queue.h"
+#include "snapshot.h"
+#include "notify_coalescer.h"
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <future>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <set>
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
 
@@ -20,8 +32,18 @@ protected:
         static bool init = false;
         if(!init) {
             // Init Redis for Registry Test
-            // Use 'redis' hostname in Docker environment
-            RedisClient::GetInstance().Init("redis", 6379);
+            // Use 'redis' hostname in Docker environment, or shard over the nodes in
+            // TINYIM_REDIS_NODES="127.0.0.1:7001,127.0.0.1:7002" (e.g. local redis-server processes)
+            std::vector<std::string> nodes;
+            if (const char* env = std::getenv("TINYIM_REDIS_NODES")) {
+                std::stringstream list(env);
+                std::string node;
+                while (std::getline(list, node, ',')) {
+                    if (!node.empty()) nodes.push_back(node);
+                }
+            }
+            if (!nodes.empty()) RedisClient::GetInstance().Init(nodes);
+            else RedisClient::GetInstance().Init("redis", 6379);
             init = true;
         }
     }
@@ -33,29 +55,34 @@ protected:
 
 // 0. Infrastructure: Registry Local Cache Mechanism
 TEST_F(IntegrationTest, Infrastructure_ServiceRegistry_LocalCache) {
-    // This test verifies that ServiceRegistry correctly polls Redis and updates local cache
+    // This test verifies that ServiceRegistry picks up registrations from Redis (on the
+    // change event, or by polling) and updates local cache
     std::string svc_name = "test_lb_svc_integrated_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
     std::string ip = "1.2.3.4";
     int port = 5555;
     std::string addr = ip + ":" + std::to_string(port);
-    std::string key = "im:service:" + svc_name + ":" + addr;
+    std::string key = ServiceRegistry::RegistryKey(svc_name);
+    auto expiry_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() + 20000;
 
     // 1. Observe (Start Polling)
     ServiceRegistry::GetInstance().Observe(svc_name);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500)); // Change listener subscribed
 
-    // 2. Simulate Service Registration (Direct to Redis)
-    RedisClient::GetInstance().SetEx(key, addr, 20); 
+    // 2. Simulate Service Registration (Direct to Redis), announced like a heartbeat does
+    RedisClient::GetInstance().Command({"ZADD", key, std::to_string(expiry_ms), addr});
+    RedisClient::GetInstance().Publish(ServiceRegistry::kChangeChannel, svc_name);
 
-    // 3. Wait for polling (3s interval + buffer)
-    std::this_thread::sleep_for(std::chrono::seconds(4));
+    // 3. Event-driven refresh: well under the 3s polling interval
+    std::this_thread::sleep_for(std::chrono::seconds(1));
 
     // 4. Discover - Should find it (Cache Hit)
     std::string found = ServiceRegistry::GetInstance().Discover(svc_name);
     EXPECT_EQ(found, addr);
 
     // 5. Verify Local Cache Resilience
-    // Delete from Redis
-    RedisClient::GetInstance().Del(key);
+    // Delete from Redis, without announcing it
+    RedisClient::GetInstance().Command({"ZREM", key, addr});
     
     // Immediate Discover should still return cached value
     std::string cached = ServiceRegistry::GetInstance().Discover(svc_name);
@@ -70,6 +97,387 @@ TEST_F(IntegrationTest, Infrastructure_ServiceRegistry_LocalCache) {
     EXPECT_TRUE(refreshed.empty()) << "Cache should be cleared after refresh";
 }
 
+// 0b. Infrastructure: Snowflake IDs are unique and increasing under concurrency
+TEST_F(IntegrationTest, Infrastructure_IdGenerator_Unique_And_Ordered) {
+    IdGenerator& gen = IdGenerator::GetInstance();
+    int saved_node = gen.node_id();
+    gen.SetNodeId(7);
+
+    const int kThreads = 4;
+    const int kPerThread = 50000; // > 4096/ms: exercises sequence overflow
+    std::vector<std::vector<int64_t>> ids(kThreads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < kThreads; ++t) {
+        workers.emplace_back([&, t]() {
+            ids[t].reserve(kPerThread);
+            for (int i = 0; i < kPerThread; ++i) ids[t].push_back(gen.NextId());
+        });
+    }
+    for (auto& w : workers) w.join();
+
+    // A node id past its lease deadline is refused
+    gen.SetNodeId(7, IdGenerator::Clock::now() - std::chrono::milliseconds(1));
+    EXPECT_EQ(gen.NextId(), 0);
+    gen.SetNodeId(7, IdGenerator::Clock::now() + std::chrono::seconds(10));
+    EXPECT_GT(gen.NextId(), 0);
+    gen.SetNodeId(saved_node);
+
+    std::set<int64_t> all;
+    int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    for (const auto& v : ids) {
+        for (size_t i = 0; i < v.size(); ++i) {
+            ASSERT_GT(v[i], 0);
+            if (i > 0) {
+                ASSERT_GT(v[i], v[i - 1]) << "IDs must increase within a thread";
+            }
+            ASSERT_EQ((v[i] >> IdGenerator::kSeqBits) & IdGenerator::kMaxNodeId, 7);
+            all.insert(v[i]);
+        }
+        EXPECT_NEAR(IdGenerator::TimestampOf(v.back()), now_ms, 5000);
+    }
+    EXPECT_EQ(all.size(), static_cast<size_t>(kThreads * kPerThread)) << "IDs must be unique";
+}
+
+// 0c. Infrastructure: node id lease through the registry
+TEST_F(IntegrationTest, Infrastructure_ServiceRegistry_NodeIdLease) {
+    std::string pool = "test_pool_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+    // The heartbeat keeps calling back until the lease is released: state outlives the test body
+    struct Lease {
+        std::atomic<int> id{-2};
+        std::atomic<std::chrono::steady_clock::time_point> valid_until{};
+    };
+    auto lease = std::make_shared<Lease>();
+    auto before = std::chrono::steady_clock::now();
+    ServiceRegistry::GetInstance().AcquireNodeId(pool, 3,
+        [lease](int id, std::chrono::steady_clock::time_point until) { lease->id = id; lease->valid_until = until; });
+
+    int leased = lease->id;
+    EXPECT_GE(leased, 0);
+    EXPECT_LE(leased, 3);
+    EXPECT_GT(lease->valid_until.load(), before) << "A fresh lease comes with a deadline ahead";
+    EXPECT_LT(lease->valid_until.load(), before + std::chrono::seconds(30)) << "Deadline must fall before the key's TTL";
+    std::string key = "im:node:" + pool + ":" + std::to_string(leased);
+    EXPECT_TRUE(RedisClient::GetInstance().Exists(key));
+
+    ServiceRegistry::GetInstance().ReleaseNodeId();
+    EXPECT_FALSE(RedisClient::GetInstance().Exists(key)) << "Released ids are free at once";
+}
+
+// 0d. Infrastructure: MPSC queue (reactor task queue) loses nothing and keeps per-producer order
+TEST_F(IntegrationTest, Infrastructure_MpscQueue_MultiProducer) {
+    MpscQueue<int64_t> queue;
+    const int kProducers = 4;
+    const int64_t kPerProducer = 100000;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&, p]() {
+            for (int64_t i = 0; i < kPerProducer; ++i) queue.Push(p * kPerProducer + i);
+        });
+    }
+
+    // Single consumer, running concurrently with the producers
+    std::vector<int64_t> last(kProducers, -1);
+    int64_t received = 0;
+    int64_t value;
+    while (received < kProducers * kPerProducer) {
+        if (!queue.Pop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        int p = static_cast<int>(value / kPerProducer);
+        ASSERT_GT(value, last[p]) << "Items of one producer must come out in order";
+        last[p] = value;
+        received++;
+    }
+    for (auto& t : producers) t.join();
+    EXPECT_EQ(received, kProducers * kPerProducer);
+    EXPECT_FALSE(queue.Pop(value));
+}
+
+// 0e. Infrastructure: consistent-hash ring spreads keys evenly and moves few on resize
+TEST_F(IntegrationTest, Infrastructure_RedisRing_Sharding) {
+    RedisRing three({"redis-a:6379", "redis-b:6379", "redis-c:6379"});
+    RedisRing four({"redis-a:6379", "redis-b:6379", "redis-c:6379", "redis-d:6379"});
+    const int kKeys = 30000;
+
+    std::vector<int> load(3, 0);
+    int moved = 0;
+    for (int i = 0; i < kKeys; ++i) {
+        std::string key = "im:seq:" + std::to_string(i);
+        size_t before = three.NodeOf(key);
+        load[before]++;
+        size_t after = four.NodeOf(key);
+        if (after != before) {
+            EXPECT_EQ(after, 3u) << "Keys may only move to the new node";
+            moved++;
+        }
+    }
+    for (int n : load) {
+        EXPECT_GT(n, kKeys / 3 * 8 / 10) << "Nodes must get a fair share of the keys";
+        EXPECT_LT(n, kKeys / 3 * 12 / 10);
+    }
+    EXPECT_GT(moved, kKeys / 4 * 7 / 10);
+    EXPECT_LT(moved, kKeys / 4 * 13 / 10);
+
+    // Hash tags keep related keys together
+    EXPECT_EQ(three.NodeOf("{user:42}:seq"), three.NodeOf("{user:42}:ack"));
+    EXPECT_EQ(RedisRing::Hash("{user:42}:seq"), RedisRing::Hash("user:42"));
+    EXPECT_EQ(RedisRing({"redis-a:6379"}).NodeOf("anything"), 0u);
+}
+
+// 0f. Infrastructure: gateway selection by power of two choices over reported load
+TEST_F(IntegrationTest, Infrastructure_ServiceRegistry_PickLeastLoaded) {
+    auto make = [](const std::string& addr, int64_t sessions) {
+        ServiceInstance inst;
+        inst.addr = addr;
+        inst.load.sessions = sessions;
+        inst.has_load = true;
+        return inst;
+    };
+    std::vector<ServiceInstance> gateways = {make("gw-busy", 5000), make("gw-fresh", 0), make("gw-mid", 2500)};
+
+    std::vector<int> picks(gateways.size(), 0);
+    const int kPicks = 3000;
+    for (int i = 0; i < kPicks; ++i) picks[ServiceRegistry::PickInstance(gateways)]++;
+
+    EXPECT_EQ(picks[0], 0) << "The most loaded gateway loses every comparison";
+    EXPECT_GT(picks[1], kPicks / 2) << "The restarted gateway should take most new sessions";
+    EXPECT_GT(picks[2], 0);
+
+    EXPECT_EQ(ServiceRegistry::PickInstance({}), -1);
+    // Queued bytes and CPU count as load too
+    ServiceLoad idle, backlogged;
+    backlogged.write_queue_bytes = 64 << 20;
+    EXPECT_LT(idle.Cost(), backlogged.Cost());
+    ServiceLoad hot = idle;
+    hot.cpu = 0.9;
+    EXPECT_LT(idle.Cost(), hot.Cost());
+}
+
+// 0g. Infrastructure: readers of a Snapshot always see a whole published value
+TEST_F(IntegrationTest, Infrastructure_Snapshot_ConcurrentPublish) {
+    Snapshot<std::vector<int>> snapshot;
+    std::atomic<bool> stop{false};
+    std::atomic<int> torn{0};
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r) {
+        readers.emplace_back([&]() {
+            while (!stop) {
+                auto v = snapshot.Get();
+                for (int x : *v) {
+                    if (x != v->front()) torn++;
+                }
+            }
+        });
+    }
+    const int kPublishes = 10000;
+    for (int i = 1; i <= kPublishes; ++i) {
+        snapshot.Publish(std::make_shared<const std::vector<int>>(64, i));
+    }
+    stop = true;
+    for (auto& t : readers) t.join();
+
+    EXPECT_EQ(torn.load(), 0) << "A reader saw a snapshot being modified";
+    ASSERT_FALSE(snapshot.Get()->empty());
+    EXPECT_EQ(snapshot.Get()->front(), kPublishes) << "Readers must see the latest publish";
+
+    // A pinned snapshot outlives later Gets and Publishes on the same thread
+    Snapshot<std::vector<int>> other;
+    auto pinned = snapshot.Get();
+    other.Get();
+    snapshot.Publish(std::make_shared<const std::vector<int>>(64, -1));
+    snapshot.Get();
+    EXPECT_EQ(pinned->front(), kPublishes);
+    EXPECT_EQ(snapshot.Get()->front(), -1);
+}
+
+// 0h. Infrastructure: batched and fanned-out Redis operations over several real nodes
+TEST_F(IntegrationTest, Infrastructure_RedisSharding_MultiNode) {
+    RedisClient& redis = RedisClient::GetInstance();
+    if (redis.nodes().size() < 2) {
+        GTEST_SKIP() << "Needs TINYIM_REDIS_NODES with two or more nodes, e.g. redis-server --port 7001 / 7002";
+    }
+    std::string prefix = "test:shard:" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+
+    // More keys per node than one script call takes: chunks and nodes are both exercised
+    const size_t kKeys = RedisClient::kIncrBatchChunk * redis.nodes().size() * 2 + 7;
+    std::vector<std::string> keys;
+    std::vector<size_t> per_node(redis.nodes().size(), 0);
+    for (size_t i = 0; i < kKeys; ++i) {
+        keys.push_back(prefix + ":seq:" + std::to_string(i));
+        per_node[redis.ShardOf(keys.back())]++;
+    }
+    for (size_t n : per_node) ASSERT_GT(n, RedisClient::kIncrBatchChunk) << "Every node must own keys";
+
+    // IncrBatch: every key counted once per call, results at the keys' indexes
+    auto first = redis.IncrBatch(keys);
+    ASSERT_EQ(first.size(), kKeys);
+    for (long long v : first) EXPECT_EQ(v, 1);
+    auto second = redis.IncrBatch(keys);
+    ASSERT_EQ(second.size(), kKeys);
+    for (long long v : second) EXPECT_EQ(v, 2);
+
+    // Each key lives on its own node only
+    for (size_t shard = 0; shard < redis.nodes().size(); ++shard) {
+        RedisPipeline pipe(shard);
+        ASSERT_TRUE(pipe.valid());
+        for (const auto& key : keys) pipe.Append({"GET", key});
+        auto replies = pipe.Exec();
+        ASSERT_EQ(replies.size(), kKeys);
+        for (size_t i = 0; i < kKeys; ++i) {
+            ASSERT_TRUE(replies[i]);
+            bool here = redis.ShardOf(keys[i]) == shard;
+            EXPECT_EQ(replies[i]->type, here ? REDIS_REPLY_STRING : REDIS_REPLY_NIL) << keys[i] << " on node " << shard;
+        }
+    }
+
+    // CompareAndSetBatch: only the keys holding the expected value swap
+    std::vector<long long> expected(kKeys), desired(kKeys, 10);
+    for (size_t i = 0; i < kKeys; ++i) expected[i] = i % 2 == 0 ? 2 : 5;
+    auto swapped = redis.CompareAndSetBatch(keys, expected, desired);
+    ASSERT_EQ(swapped.size(), kKeys);
+    for (size_t i = 0; i < kKeys; ++i) {
+        EXPECT_EQ(static_cast<bool>(swapped[i]), i % 2 == 0) << keys[i];
+        EXPECT_EQ(redis.Get(keys[i]), i % 2 == 0 ? "10" : "2") << keys[i];
+    }
+
+    // HGetAllBatch: one pipeline per node, maps back at the keys' indexes
+    std::vector<std::string> hashes;
+    for (size_t i = 0; i < 64; ++i) {
+        hashes.push_back(prefix + ":hash:" + std::to_string(i));
+        ASSERT_TRUE(redis.HSet(hashes.back(), "i", std::to_string(i)));
+    }
+    auto maps = redis.HGetAllBatch(hashes);
+    ASSERT_EQ(maps.size(), hashes.size());
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        EXPECT_EQ(maps[i]["i"], std::to_string(i)) << hashes[i];
+    }
+
+    // Keys fans out to every node
+    auto found = redis.Keys(prefix + ":*");
+    EXPECT_EQ(found.size(), kKeys + hashes.size());
+
+    // Pub/Sub: subscriber and publisher both find the channel's node
+    std::string channel = prefix + ":channel";
+    auto received = std::make_shared<std::promise<std::string>>();
+    auto once = std::make_shared<std::atomic<bool>>(false);
+    std::thread([channel, received, once]() {
+        RedisClient::GetInstance().Subscribe(channel, [received, once](const std::string& msg) {
+            if (!once->exchange(true)) received->set_value(msg);
+        });
+    }).detach(); // Stays subscribed, like the registry's change listener
+    auto got = received->get_future();
+    for (int i = 0; i < 40 && got.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready; ++i) {
+        redis.Publish(channel, "hello"); // Until the subscriber is in
+    }
+    ASSERT_EQ(got.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+    EXPECT_EQ(got.get(), "hello");
+
+    for (const auto& key : keys) redis.Del(key);
+    for (const auto& key : hashes) redis.Del(key);
+}
+
+// 0i. Infrastructure: push notifies coalesce only with their own kind (inbox or one group)
+namespace {
+Frame InboxNotify(int64_t max_seq, bool inline_msg) {
+    tinyim::chat::MsgPushNotify n;
+    n.set_max_seq(max_seq);
+    std::string bare_body;
+    n.SerializeToString(&bare_body);
+    Frame bare(CMD_MSG_PUSH_NOTIFY, bare_body);
+    if (!inline_msg) return bare.WithNotify(0, max_seq);
+    n.mutable_msg()->set_seq_id(max_seq);
+    n.mutable_msg()->set_content("inline");
+    std::string body;
+    n.SerializeToString(&body);
+    return Frame(CMD_MSG_PUSH_NOTIFY, body).WithNotify(0, max_seq, bare);
+}
+
+Frame GroupNotify(int64_t group_id, int64_t group_seq) {
+    tinyim::chat::MsgPushNotify n; // Read diffusion: no inbox max_seq
+    n.set_group_id(group_id);
+    n.set_group_seq(group_seq);
+    std::string body;
+    n.SerializeToString(&body);
+    return Frame(CMD_MSG_PUSH_NOTIFY, body).WithNotify(group_id, group_seq);
+}
+
+tinyim::chat::MsgPushNotify Decode(const Frame& f) {
+    const char* data = static_cast<const char*>(f.buffer().data());
+    tinyim::chat::MsgPushNotify n;
+    n.ParseFromArray(data + sizeof(PacketHeader), static_cast<int>(f.size() - sizeof(PacketHeader)));
+    return n;
+}
+} // namespace
+
+TEST_F(IntegrationTest, Infrastructure_NotifyCoalescing_KeepsKindsApart) {
+    const int64_t gid = 42;
+
+    // Held: a group notify after an inline inbox notify, then the other way round
+    {
+        NotifyCoalescer held;
+        EXPECT_FALSE(held.Hold(InboxNotify(7, true)));
+        EXPECT_FALSE(held.Hold(GroupNotify(gid, 3)));
+        auto frames = held.Take();
+        ASSERT_EQ(frames.size(), 2u) << "The group notify must not be dropped";
+        EXPECT_TRUE(Decode(frames[0]).has_msg()) << "Nothing coalesced: the inline message stays";
+        EXPECT_EQ(Decode(frames[1]).group_seq(), 3);
+        EXPECT_TRUE(held.empty());
+    }
+    {
+        NotifyCoalescer held;
+        EXPECT_FALSE(held.Hold(GroupNotify(gid, 3)));
+        EXPECT_FALSE(held.Hold(InboxNotify(7, true)));
+        EXPECT_TRUE(held.Hold(InboxNotify(8, true)));
+        EXPECT_TRUE(held.Hold(InboxNotify(6, true))); // Out of order: covered by 8
+        auto frames = held.Take();
+        ASSERT_EQ(frames.size(), 2u) << "The inbox notify must not replace the group one";
+        EXPECT_EQ(Decode(frames[0]).group_id(), gid);
+        auto inbox = Decode(frames[1]);
+        EXPECT_EQ(inbox.max_seq(), 8);
+        EXPECT_FALSE(inbox.has_msg()) << "Stands in for 7: the client must sync, not apply 8 alone";
+    }
+
+    // Congested queue: per kind, the latest survives in place; other frames stay
+    {
+        std::deque<Frame> queue;
+        queue.push_back(InboxNotify(7, true));
+        queue.push_back(GroupNotify(gid, 3));
+        queue.push_back(Frame(CMD_MSG_SYNC_RESP, "sync"));
+        queue.push_back(InboxNotify(8, true));
+        queue.push_back(GroupNotify(gid, 4));
+        queue.push_back(GroupNotify(gid + 1, 1));
+        size_t bytes = 0;
+        for (const Frame& f : queue) bytes += f.size();
+
+        EXPECT_EQ(NotifyCoalescer::Collapse(queue, bytes), 2u);
+        ASSERT_EQ(queue.size(), 4u);
+        size_t left = 0;
+        for (const Frame& f : queue) left += f.size();
+        EXPECT_EQ(bytes, left);
+
+        EXPECT_EQ(queue[0].cmd_id(), CMD_MSG_SYNC_RESP);
+        auto inbox = Decode(queue[1]);
+        EXPECT_EQ(inbox.max_seq(), 8);
+        EXPECT_FALSE(inbox.has_msg());
+        EXPECT_EQ(Decode(queue[2]).group_id(), gid);
+        EXPECT_EQ(Decode(queue[2]).group_seq(), 4);
+        EXPECT_EQ(Decode(queue[3]).group_id(), gid + 1);
+    }
+
+    // A lone inline notify is left as it is
+    {
+        std::deque<Frame> queue{InboxNotify(9, true), GroupNotify(gid, 5)};
+        size_t bytes = queue[0].size() + queue[1].size();
+        EXPECT_EQ(NotifyCoalescer::Collapse(queue, bytes), 0u);
+        ASSERT_EQ(queue.size(), 2u);
+        EXPECT_TRUE(Decode(queue[0]).has_msg());
+    }
+}
+
 // ==========================================
 // Group 1: Basic Functionality & Auth
 // ==========================================
@@ -173,6 +581,31 @@ TEST_F(IntegrationTest, Basic_Login_And_Kick_Mutex) {
     ASSERT_TRUE(kicked) << "Client 1 should be kicked";
 }
 
+// 4b. Pipelined Requests (v2 header echoes client seq)
+TEST_F(IntegrationTest, Basic_Pipelined_Seq_Echo) {
+    std::string u = "pipe_user_" + std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+    TestClient client(host, http_port, ws_port);
+    std::string token = client.Login(u, "123");
+    client.Connect(client.GetUserId(), token, "PC");
+    
+    // Two sends in flight before any ack arrives (stranger -> both fail, but both ack)
+    tinyim::chat::SendMessageReq req;
+    req.set_receiver_id(client.GetUserId() + 1000000);
+    req.set_type(tinyim::chat::TEXT);
+    req.set_content("pipelined");
+    client.SendPacket(CMD_MSG_SEND_REQ, req, 101);
+    client.SendPacket(CMD_MSG_SEND_REQ, req, 102);
+    
+    std::set<uint32_t> seqs;
+    for (int i = 0; i < 2; i++) {
+        std::string body;
+        uint32_t seq = 0;
+        ASSERT_TRUE(client.WaitForPacket(CMD_MSG_SEND_RESP, body, 2000, &seq));
+        seqs.insert(seq);
+    }
+    EXPECT_EQ(seqs, (std::set<uint32_t>{101, 102}));
+}
+
 // ==========================================
 // Group 2: Core Chat Flow Service
 // ==========================================
@@ -270,6 +703,7 @@ TEST_F(IntegrationTest, Flow_Relation_And_SingleChat) {
     }
     
     // E. Sync (PC Mode)
+    int64_t synced_seq = 0;
     {
         tinyim::chat::SyncMessagesReq req;
         req.set_user_id(uidB);
@@ -286,6 +720,7 @@ TEST_F(IntegrationTest, Flow_Relation_And_SingleChat) {
         ASSERT_GE(resp.msgs_size(), 1);
         auto last_msg = resp.msgs(resp.msgs_size()-1);
         EXPECT_EQ(last_msg.content(), "Hello Friend");
+        synced_seq = resp.max_seq();
     }
     
     // F. Sync (Web Reverse Mode)
@@ -310,6 +745,26 @@ TEST_F(IntegrationTest, Flow_Relation_And_SingleChat) {
         }
         EXPECT_TRUE(found);
     }
+
+    // G. B is caught up: a small message arrives inline in the push (chat.inline_push_max_bytes)
+    {
+        tinyim::chat::SendMessageReq req;
+        req.set_receiver_id(uidB);
+        req.set_type(tinyim::chat::TEXT);
+        req.set_content("Inline Hi");
+        clientA.SendPacket(CMD_MSG_SEND_REQ, req);
+
+        std::string body;
+        ASSERT_TRUE(clientA.WaitForPacket(CMD_MSG_SEND_RESP, body));
+        ASSERT_TRUE(clientB.WaitForPacket(CMD_MSG_PUSH_NOTIFY, body));
+        tinyim::chat::MsgPushNotify notify;
+        notify.ParseFromString(body);
+        ASSERT_TRUE(notify.has_msg()) << "Caught-up receiver should get the message inline";
+        EXPECT_EQ(notify.msg().seq_id(), synced_seq + 1);
+        EXPECT_EQ(notify.msg().seq_id(), notify.max_seq());
+        EXPECT_EQ(notify.msg().content(), "Inline Hi");
+        EXPECT_EQ(notify.msg().sender_id(), clientA.GetUserId());
+    }
 }
 
 // 6. Offline Messages
@@ -188,6 +188,14 @@ void TestClient::SendPacket(uint16_t cmd_id, const google::protobuf::Message& ms
     ws_->write(net::buffer(packet));
 }
 
+void TestClient::SendPacket(uint16_t cmd_id, const google::protobuf::Message& msg, uint32_t seq) {
+    std::string body;
+    msg.SerializeToString(&body);
+    
+    std::string packet = EncodePacket(cmd_id, body, PACKET_VERSION_2, seq);
+    ws_->write(net::buffer(packet));
+}
+
 
 void TestClient::ReadLoop() {
     beast::flat_buffer buffer;
@@ -207,12 +215,18 @@ void TestClient::ReadLoop() {
             PacketHeader header;
             memcpy(&header, ptr, sizeof(header));
             
+            size_t header_size = PacketHeaderSize(header.version);
             uint32_t len = ntohl(header.body_len);
-            if (buffer.size() < sizeof(header) + len) break;
+            if (buffer.size() < header_size + len) break;
             
             RecvPacket pkt;
             pkt.cmd_id = ntohs(header.cmd_id);
-            pkt.body = std::string(ptr + sizeof(header), len);
+            pkt.body = std::string(ptr + header_size, len);
+            if (header.version == PACKET_VERSION_2) {
+                PacketHeaderV2 header_v2;
+                memcpy(&header_v2, ptr, sizeof(header_v2));
+                pkt.seq = ntohl(header_v2.seq);
+            }
             
             {
                 std::lock_guard<std::mutex> lk(mtx_);
@@ -220,12 +234,12 @@ void TestClient::ReadLoop() {
             }
             cv_.notify_one();
             
-            buffer.consume(sizeof(header) + len);
+            buffer.consume(header_size + len);
         }
     }
 }
 
-bool TestClient::WaitForPacket(uint16_t expected_cmd, std::string& out_body, int timeout_ms) {
+bool TestClient::WaitForPacket(uint16_t expected_cmd, std::string& out_body, int timeout_ms, uint32_t* out_seq) {
     std::unique_lock<std::mutex> lk(mtx_);
     auto start = std::chrono::steady_clock::now();
     
@@ -239,6 +253,7 @@ bool TestClient::WaitForPacket(uint16_t expected_cmd, std::string& out_body, int
             
             if (pkt.cmd_id == expected_cmd) {
                 out_body = pkt.body;
+                if (out_seq) *out_seq = pkt.seq;
                 return true;
             }
             // Ignore other packets (e.g. HeartbeatResp)
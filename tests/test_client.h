@@ -22,6 +22,7 @@ using tcp = boost::asio::ip::tcp;
 struct RecvPacket {
     uint16_t cmd_id;
     std::string body;
+    uint32_t seq = 0; // Echoed client seq (v2 frames only)
 };
 
 class TestClient {
@@ -41,11 +42,13 @@ public:
     
     // 3. Send
     void SendPacket(uint16_t cmd_id, const google::protobuf::Message& msg);
+    // Send with a v2 header carrying seq (pipelined requests)
+    void SendPacket(uint16_t cmd_id, const google::protobuf::Message& msg, uint32_t seq);
     
     // 4. Wait for Packet
     // If exact_cmd provided, waits for that specific cmd.
     // Else waits for any packet.
-    bool WaitForPacket(uint16_t expected_cmd, std::string& out_body, int timeout_ms = 2000);
+    bool WaitForPacket(uint16_t expected_cmd, std::string& out_body, int timeout_ms = 2000, uint32_t* out_seq = nullptr);
     
     int64_t GetUserId() const { return user_id_; }
     bool IsRunning() const { return running_; }
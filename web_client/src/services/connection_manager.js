@@ -104,8 +104,9 @@ export class ConnectionManager {
 
         ws.onmessage = (event) => {
             try {
-                const { header, body } = IMProtocol.parseMessage(event.data);
-                this.handleMessage(userId, header, body);
+                for (const { header, body } of IMProtocol.parseMessages(event.data)) {
+                    this.handleMessage(userId, header, body);
+                }
             } catch (e) {
                 this.log(userId, `Parse Error: ${e.message}`, 'err');
             }
@@ -162,10 +163,19 @@ export class ConnectionManager {
                     this.log(userId, `Ack Decode Err`, 'err');
                 }
                 break;
-            case CMD.MSG_PUSH_NOTIFY:
-                this.log(userId, 'New Message Received! Syncing...', 'rx');
-                this.syncMessages(userId);
+            case CMD.MSG_PUSH_NOTIFY: {
+                // Small messages arrive inline; apply only if it is exactly the next seq
+                const notify = IMProtocol.decodeMsgPushNotify(body);
+                const conn = this.connections.get(userId);
+                if (notify.msg && conn && notify.msg.seq_id === conn.localSeq + 1) {
+                    conn.localSeq = notify.msg.seq_id;
+                    this.log(userId, `From ${notify.msg.sender_id}: ${notify.msg.content || '(type ' + notify.msg.type + ')'}`, 'rx');
+                } else {
+                    this.log(userId, 'New Message Received! Syncing...', 'rx');
+                    this.syncMessages(userId);
+                }
                 break;
+            }
             case CMD.KICK_NOTIFY:
                 this.log(userId, 'KICKED by Server', 'err');
                 this.updateUserStatus(userId, 'kicked');
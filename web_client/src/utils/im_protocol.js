@@ -79,10 +79,30 @@ export class IMProtocol {
             length: view.getUint32(5, false)
         };
 
-        const body = data.slice(9);
+        const body = data.slice(9, 9 + header.length);
         return { header, body: new Uint8Array(body) };
     }
 
+    // The gateway may gather several packets into one WebSocket message
+    static parseMessages(data) {
+        const packets = [];
+        let offset = 0;
+        while (data.byteLength - offset >= 9) {
+            const view = new DataView(data, offset);
+            const headerLen = view.getUint8(2) >= 2 ? 13 : 9; // v2 adds a 4-byte seq
+            const length = view.getUint32(5, false);
+            if (data.byteLength - offset < headerLen + length) break;
+            const { header } = IMProtocol.parseMessage(data.slice(offset, offset + 9));
+            const body = data.slice(offset + headerLen, offset + headerLen + length);
+            packets.push({ header, body: new Uint8Array(body) });
+            offset += headerLen + length;
+        }
+        if (packets.length === 0) {
+            throw new Error("Message too short");
+        }
+        return packets;
+    }
+
     // --- Simple Protobuf-like Encoders (Matching C++ server logic) ---
 
     static encodeVarint(value) {
@@ -412,6 +432,39 @@ export class IMProtocol {
         return result;
     }
 
+    static decodeMsgPushNotify(buffer) {
+        // MsgPushNotify: 1:max_seq, 2:type, 3:group_id, 4:group_seq (varint), 5:msg (MessageData, inline)
+        const view = new DataView(buffer.buffer, buffer.byteOffset, buffer.byteLength);
+        let offset = 0;
+        const result = { max_seq: 0, type: 0, group_id: 0, group_seq: 0, msg: null };
+
+        while (offset < buffer.byteLength) {
+            const { value: tag, length: tagLen } = this.decodeVarint(view, offset);
+            offset += tagLen;
+            const fieldNum = tag >> 3;
+            const wireType = tag & 7;
+
+            if (wireType === 0) { // Varint
+                const { value, length } = this.decodeVarint(view, offset);
+                offset += length;
+                if (fieldNum === 1) result.max_seq = value;
+                else if (fieldNum === 2) result.type = value;
+                else if (fieldNum === 3) result.group_id = value;
+                else if (fieldNum === 4) result.group_seq = value;
+            } else if (wireType === 2) { // Length Delimited
+                const { value: len, length: lenLen } = this.decodeVarint(view, offset);
+                offset += lenLen;
+                if (fieldNum === 5) {
+                    result.msg = this.decodeMessageData(new Uint8Array(buffer.buffer, buffer.byteOffset + offset, len));
+                }
+                offset += len;
+            } else {
+                break;
+            }
+        }
+        return result;
+    }
+
     static decodeMessageData(buffer) {
         const view = new DataView(buffer.buffer, buffer.byteOffset, buffer.byteLength);
         let offset = 0;